@@ -21,6 +21,16 @@ typedef enum {
     ASM_JMP,
     ASM_JCC,
     ASM_LABEL,
+    ASM_ADD,            // addl src, dst
+    ASM_SUB,            // subl src, dst
+    ASM_IMUL,           // imull src, dst (src may be an immediate)
+    ASM_IMUL_EDX,       // imull %edx: %edx:%eax = %eax * %edx
+    ASM_SAR,            // sarl $src, dst
+    ASM_SHR,            // shrl $src, dst
+    ASM_SHL,            // shll $src, dst
+    ASM_AND,            // andl src, dst
+    ASM_XOR,            // xorl src, dst
+    ASM_DIV_ECX,        // divl %ecx: unsigned %edx:%eax / %ecx
 } AssemblyInstructionType;
 
 typedef enum {
@@ -49,7 +59,8 @@ typedef struct AssemblyInstruction {
     Operand src;
     Operand dst;
     AssemblyCondCode cond;
-    char *label;
+    int label;                 // TACKY label number for jumps and labels
+    unsigned char label_kind;  // TackyLabelKind, picks the printed prefix
     struct AssemblyInstruction *next;
 } AssemblyInstruction;
 
@@ -63,7 +74,9 @@ typedef struct {
     AssemblyFunction *function;
 } AssemblyProgram;
 
-AssemblyProgram *generate_assembly(TackyProgram *tacky);
+// use_ranges lets range analysis pick cheaper code (divl, and for % by a
+// power of two, xor for !); it is set when fold-ranges is enabled.
+AssemblyProgram *generate_assembly(TackyProgram *tacky, bool use_ranges);
 void print_assembly(AssemblyProgram *program);
 void free_assembly(AssemblyProgram *program);
 char *get_output_assembly_path(const char *source_file);
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include "../dump/dump.h"
+#include "../optimize/pass_manager.h"
 
 typedef enum {
     DRIVER_STAGE_FULL = 0,   // Run full pipeline
@@ -26,6 +27,12 @@ typedef struct {
     char *dump_tacky_path;
     bool quiet;
     bool run_exec;
+    bool interp;          // run TACKY on the bytecode interpreter instead of building
+    bool jit;             // run the assembly as machine code in-process instead of building
+    bool fuse_frontend;   // resolve names while lowering to TACKY
+    bool load_tacky;      // input is binary TACKY, not C source
+    int opt_level;        // -O0, -O1 or -O2
+    PassConfig passes;    // TACKY optimization passes: the -O preset plus overrides
 } DriverOptions;
 
 DriverOptions driver_parse_args(int argc, char **argv);
@@ -16,6 +16,7 @@ typedef enum {
     DUMP_TACKY_NONE = 0,
     DUMP_TACKY_TXT,
     DUMP_TACKY_JSON,
+    DUMP_TACKY_BIN,     // tacky_binary.h, readable by --load-tacky
 } DumpTackyFormat;
 
 void dump_ensure_out_dir(void);
@@ -0,0 +1,43 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <stdbool.h>
+#include "../tacky/tacky.h"
+
+// Register bytecode for one TackyFunction. Every operand is a register:
+// variables keep their TACKY index, and each constant operand gets a
+// register of its own after them, preloaded from init. Instructions are
+// an opcode word followed by their operands, jump targets being word
+// offsets into code:
+//   Mov d, s    Unary d, s    Binary d, a, b
+//   Jmp t       Jz/Jnz a, t   Ret a
+typedef struct {
+    int *code;
+    int code_len;
+    int *init;          // initial register values
+    int reg_count;
+} InterpProgram;
+
+typedef enum {
+    INTERP_EXITED,      // returned; value is the exit code (0..255)
+    INTERP_TRAPPED      // divided by zero or INT_MIN by -1; value is the signal
+} InterpStatus;
+
+typedef struct {
+    InterpStatus status;
+    int value;
+} InterpResult;
+
+void interp_compile(InterpProgram *prog, const TackyFunction *fn);
+void interp_free(InterpProgram *prog);
+
+// Runs prog with the semantics of the generated code: 32-bit wrap-around
+// arithmetic, division truncating toward zero, and a SIGFPE where idivl
+// would raise one. Does not return if prog does not.
+InterpResult interp_run(const InterpProgram *prog);
+
+// Compiles and runs fn, printing its exit code the way --run does.
+// Returns the exit status a shell would see.
+int interp_run_and_print_exit(const TackyFunction *fn);
+
+#endif
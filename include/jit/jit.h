@@ -0,0 +1,31 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "../assembly/assembly.h"
+
+// Machine code for one AssemblyFunction, callable as int (*)(void). The
+// mapping is written while it is read-write and only then made
+// read-execute, so it is never writable and executable at once.
+typedef struct {
+    unsigned char *code;
+    size_t size;        // bytes of code
+    size_t mapped;      // bytes mapped, a whole number of pages
+} JitCode;
+
+// Encodes program to x86-64 machine code. Returns false, with a message
+// on stderr, if the host is not x86-64 or the memory cannot be mapped.
+bool jit_compile(JitCode *jit, const AssemblyProgram *program);
+void jit_free(JitCode *jit);
+
+// Calls the code and stores its return value in *result. Returns 0, or
+// the signal number if it raised SIGFPE (dividing by zero or INT_MIN by
+// -1), as the built executable would have died of it.
+int jit_call(const JitCode *jit, int *result);
+
+// Compiles and runs program, printing its exit code the way --run does.
+// Returns the exit status a shell would see.
+int jit_run_and_print_exit(const AssemblyProgram *program);
+
+#endif
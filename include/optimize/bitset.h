@@ -0,0 +1,49 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Fixed-size bit sets for dataflow analyses. A set of n bits occupies
+// bitset_words(n) words; callers own the storage, usually one allocation
+// holding the sets of every block back to back.
+typedef uint64_t BitWord;
+
+static inline int bitset_words(int bits) { return (bits + 63) / 64; }
+
+static inline bool bitset_test(const BitWord *s, int i) { return (s[i >> 6] >> (i & 63)) & 1; }
+static inline void bitset_set(BitWord *s, int i) { s[i >> 6] |= (BitWord)1 << (i & 63); }
+static inline void bitset_clear(BitWord *s, int i) { s[i >> 6] &= ~((BitWord)1 << (i & 63)); }
+
+static inline void bitset_fill(BitWord *s, int words, bool value) {
+    memset(s, value ? 0xff : 0, (size_t)words * sizeof(BitWord));
+}
+
+static inline void bitset_copy(BitWord *dst, const BitWord *src, int words) {
+    memcpy(dst, src, (size_t)words * sizeof(BitWord));
+}
+
+static inline void bitset_and(BitWord *dst, const BitWord *src, int words) {
+    for (int w = 0; w < words; w++) dst[w] &= src[w];
+}
+
+static inline void bitset_or(BitWord *dst, const BitWord *src, int words) {
+    for (int w = 0; w < words; w++) dst[w] |= src[w];
+}
+
+// dst = gen | (in & ~kill); returns true if dst changed.
+static inline bool bitset_transfer(BitWord *dst, const BitWord *gen, const BitWord *in,
+                                   const BitWord *kill, int words) {
+    bool changed = false;
+    for (int w = 0; w < words; w++) {
+        BitWord v = gen[w] | (in[w] & ~kill[w]);
+        if (v != dst[w]) {
+            dst[w] = v;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "../tacky/tacky.h"
+
+// A maximal run of instructions body[start, end) entered only at its first
+// instruction and left only after its last one.
+typedef struct {
+    int start;
+    int end;
+    int succ[2];        // fall-through successor first, then a jump target
+    int succ_count;
+    int pred_start;     // this block's predecessors are
+    int pred_count;     //   Cfg.preds[pred_start .. pred_start + pred_count)
+    int rpo_index;      // position in Cfg.rpo, -1 if unreachable
+} BasicBlock;
+
+// Control-flow graph of one TackyFunction. Block 0 is the entry. The graph
+// refers to instruction indices, so it must be rebuilt after a pass inserts,
+// moves or compacts instructions; cfg_build reuses the previous buffers.
+typedef struct {
+    TackyFunction *fn;
+    BasicBlock *blocks;
+    int block_count;
+    int block_capacity;
+    int *label_block;   // label number -> block it starts, -1 if unplaced
+    int label_capacity;
+    int *preds;         // predecessor lists of all blocks, back to back
+    int pred_capacity;
+    int *rpo;           // reachable blocks in reverse postorder
+    int rpo_count;
+    int *scratch;       // DFS stack
+    int order_capacity; // blocks rpo and scratch have room for
+} Cfg;
+
+void cfg_build(Cfg *cfg, TackyFunction *fn);
+void cfg_free(Cfg *cfg);
+
+int cfg_block_of_label(const Cfg *cfg, int label);
+// The block holding body[instr]; blocks are laid out in instruction order.
+int cfg_block_of_instr(const Cfg *cfg, int instr);
+// Index of the block's last non-NOP instruction, or -1 if it has none.
+int cfg_last_instr(const Cfg *cfg, int block);
+
+#endif
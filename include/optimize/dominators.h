@@ -0,0 +1,31 @@
+#ifndef DOMINATORS_H
+#define DOMINATORS_H
+
+#include <stdbool.h>
+#include "cfg.h"
+
+// Dominator tree and dominance frontiers of the reachable part of a Cfg.
+// Per-block arrays are indexed by block number; unreachable blocks have
+// idom -1 and no children or frontier.
+typedef struct {
+    int *idom;          // immediate dominator; the entry is its own
+    int *child_start;   // children of b: children[child_start[b] .. child_start[b + 1])
+    int *children;
+    int *pre;           // preorder and postorder numbers in the tree, for
+    int *post;          //   constant-time dominance queries
+    int *df_start;      // frontier of b: frontier[df_start[b] .. df_start[b + 1])
+    int *frontier;
+    int block_count;
+} DomTree;
+
+// Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder.
+void dom_compute(DomTree *dt, const Cfg *cfg);
+void dom_free(DomTree *dt);
+
+// True if every path from the entry to b passes through a (a dominates
+// itself). Both blocks must be reachable.
+static inline bool dom_dominates(const DomTree *dt, int a, int b) {
+    return dt->pre[a] <= dt->pre[b] && dt->post[b] <= dt->post[a];
+}
+
+#endif
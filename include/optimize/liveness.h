@@ -0,0 +1,38 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include "bitset.h"
+#include "cfg.h"
+
+// Live variables at block boundaries: a variable is live at a point if
+// some path from there reads it before writing it. Only blocks reachable
+// from the entry are analysed; the sets of the others stay empty.
+typedef struct {
+    int words;          // words per set, bitset_words(var_count)
+    int block_count;
+    BitWord *sets;      // live-in, live-out, use and def of every block
+    size_t set_capacity; // words allocated in sets
+} Liveness;
+
+// Computes liveness for the function cfg was built over. Reuses the
+// buffers of a previous run.
+void liveness_compute(Liveness *lv, const Cfg *cfg);
+void liveness_free(Liveness *lv);
+
+static inline BitWord *liveness_in(const Liveness *lv, int block) {
+    return lv->sets + (size_t)(4 * block) * lv->words;
+}
+
+static inline BitWord *liveness_out(const Liveness *lv, int block) {
+    return liveness_in(lv, block) + lv->words;
+}
+
+// Variable written by ins, or -1.
+int tacky_instr_def(const TackyInstr *ins);
+// Stores the variables ins reads in uses (at most two) and returns how many.
+int tacky_instr_uses(const TackyInstr *ins, int uses[2]);
+
+// Moves live backwards over ins: removes what it writes, adds what it reads.
+void liveness_step(BitWord *live, const TackyInstr *ins);
+
+#endif
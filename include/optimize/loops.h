@@ -0,0 +1,71 @@
+#ifndef LOOPS_H
+#define LOOPS_H
+
+#include <stdbool.h>
+#include "bitset.h"
+#include "cfg.h"
+#include "dominators.h"
+
+// A natural loop: its header plus every block that reaches a back edge
+// (an edge into the header from a block the header dominates) without
+// passing through the header. Back edges into one header form one loop.
+typedef struct {
+    int header;
+    int parent;         // innermost enclosing loop, -1 if outermost
+    int depth;          // 1 for an outermost loop
+    int block_start;    // member blocks in ascending order:
+    int block_count;    //   LoopForest.blocks[block_start .. block_start + block_count)
+} Loop;
+
+// The natural loops of a Cfg, innermost first: every loop comes before the
+// loops that contain it. Retreating edges into a block that does not
+// dominate their source (irreducible control flow) form no loop.
+typedef struct {
+    Loop *loops;
+    int loop_count;
+    int *blocks;
+    int words;          // words per membership set, bitset_words(block_count)
+    BitWord *members;   // membership set of each loop, back to back
+} LoopForest;
+
+void loops_find(LoopForest *lf, const Cfg *cfg, const DomTree *dt);
+void loops_free(LoopForest *lf);
+
+static inline bool loop_contains(const LoopForest *lf, int loop, int block) {
+    return bitset_test(lf->members + (size_t)loop * lf->words, block);
+}
+
+// A basic induction variable of a loop: assigned exactly once inside it,
+// by i = i + step, either directly or through a temporary computed in the
+// same block just before (t = i + step; i = t, as loops are lowered).
+typedef struct {
+    int var;
+    int update;         // the instruction assigning var
+    int add;            // the Add or Subtract computing the new value
+    int step;
+} InductionVar;
+
+// Counts the assignments to each variable inside the loop and records the
+// index of the last one; both arrays have an entry per variable.
+void loop_count_defs(const Cfg *cfg, const LoopForest *lf, int loop, int *def_count, int *def_at);
+// Recognizes var as a basic induction variable, given the counts above.
+bool loop_induction_var(const Cfg *cfg, const int *def_count, const int *def_at, int var, InductionVar *out);
+// Constant value var holds on entry to the loop: the loop must be entered
+// from a single block outside it, which assigns a constant to var.
+bool loop_entry_constant(const Cfg *cfg, const LoopForest *lf, int loop, int var, int *value);
+// True if instruction instr lies in no loop nested inside this one, so it
+// runs at most once between two visits of the header.
+bool loop_runs_once(const Cfg *cfg, const LoopForest *lf, int loop, int instr);
+
+// Queues room on q for count instructions on the way into a loop, right
+// before its header, so they run once each time the loop is entered and
+// never again from inside it; jumps into the header from outside the loop
+// are redirected to a new label in front of the room. Returns the first
+// slot, to be filled by the caller, or NULL, changing nothing, if the
+// header is also entered by falling through from inside the loop. cfg, dt
+// and lf stay valid until q is applied. A second call for the same loop
+// queues its room behind the first.
+TackyInstr *loop_queue_preheader(TackyFunction *fn, TackyInsertions *q, const Cfg *cfg, const LoopForest *lf, int loop,
+                                 int count);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <stdbool.h>
+#include "../tacky/tacky.h"
+#include "ssa.h"
+
+// TACKY optimization passes. Each rewrites fn in place and returns true if
+// it changed anything.
+
+// Evaluates constant operations and applies algebraic identities within
+// basic blocks; folds conditional jumps on constants.
+bool fold_constants(TackyFunction *fn);
+
+// Global copy propagation over the control-flow graph: replaces reads of
+// x with y (or a constant) wherever the copy x = y reaches on every path,
+// and deletes copies that are redundant at their position.
+bool propagate_copies(TackyFunction *fn);
+
+// Removes instructions whose result is never read, using liveness over the
+// control-flow graph. Division and remainder that might trap are kept.
+bool eliminate_dead_stores(TackyFunction *fn);
+
+// Cleans up control flow: deletes unreachable blocks, threads jumps through
+// blocks that only pass control on, drops jumps to the next instruction
+// and removes labels no jump targets, which merges straight-line blocks.
+bool simplify_cfg(TackyFunction *fn);
+
+// Uses value ranges (see ranges.h) to fold comparisons and conditional
+// jumps whose outcome they decide, replace variables that can hold only
+// one value with it, reduce == and != of a 0/1 value against 0 or 1 to
+// the value or its negation, and fold a / d and a % d when |a| < |d|.
+bool fold_ranges(TackyFunction *fn);
+
+// Loop-invariant code motion: an operation whose operands do not change
+// inside a natural loop, and whose result is the loop's only definition of
+// its destination, moves to a preheader in front of the loop. Division and
+// remainder that may trap move only when they run on every trip through
+// the loop that ends.
+bool hoist_loop_invariants(TackyFunction *fn);
+
+// Induction-variable strength reduction: in a loop whose variable i steps
+// by a constant once per assignment, every i * k with a loop-invariant k
+// is replaced by a variable that starts at i * k in the preheader and
+// grows by step * k wherever i steps. A header exit test i < n on a
+// constant n is rewritten to compare that variable when no overflow is
+// possible, and i itself is removed if nothing else reads it.
+bool reduce_induction_variables(TackyFunction *fn);
+
+// Loop unrolling for loops whose trip count is known: the header compares
+// an induction variable that starts at a constant with a constant bound.
+// A loop whose iterations all fit a size budget is replaced by that many
+// copies of its body; a longer one gets the remainder of its trip count
+// peeled off in front and then runs 2, 4 or 8 copies per trip, testing
+// only once. break leaves from any copy; continue goes on to the next.
+bool unroll_loops(TackyFunction *fn);
+
+// Passes over SSA form (see ssa.h).
+
+// Sparse conditional constant propagation: values are propagated along
+// def-use chains and only across CFG edges shown to be executable, so a
+// branch decided by a constant neither runs nor feeds the phis below it.
+// Constant variables are replaced by their values, decided conditional
+// jumps become Jumps or disappear and unreachable blocks are emptied.
+bool propagate_constants(SsaForm *ssa);
+
+// Dominator-based global value numbering: a unary or binary operation
+// (with commutative operands normalized and a > b read as b < a) that
+// repeats one computed in a dominating block reuses its result. Copies are
+// folded into their uses and phis whose arguments agree are removed.
+bool number_values(SsaForm *ssa);
+
+// Constant evaluation with the semantics of the generated code (32-bit
+// two's complement). Returns false where the result is undefined or traps:
+// division or remainder by zero and INT_MIN / -1.
+bool tacky_eval_unary(TackyUnaryOp op, int src, int *out);
+bool tacky_eval_binary(TackyBinaryOp op, int a, int b, int *out);
+
+bool tacky_is_relational(TackyBinaryOp op);
+
+// True for a division or remainder whose operands do not rule out a trap.
+bool tacky_may_trap(const TackyInstr *ins);
+
+// Rewrites of instructions shared by the folding passes.
+TackyVal tacky_constant(int v);
+// Turns ins into dst = src, keeping its dst.
+void tacky_make_copy(TackyInstr *ins, TackyVal src);
+
+#endif
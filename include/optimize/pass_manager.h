@@ -0,0 +1,70 @@
+#ifndef PASS_MANAGER_H
+#define PASS_MANAGER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "../tacky/tacky.h"
+
+// Optimization passes, in the order the pipeline runs them.
+typedef enum {
+    PASS_SSA,                   // round trip through SSA form
+    PASS_SCCP,
+    PASS_GVN,
+    PASS_FOLD_CONSTANTS,
+    PASS_PROPAGATE_COPIES,
+    PASS_ELIMINATE_DEAD_STORES,
+    PASS_SIMPLIFY_CFG,
+    PASS_FOLD_RANGES,
+    PASS_LICM,
+    PASS_STRENGTH_REDUCE,
+    PASS_UNROLL,
+    PASS_COUNT
+} PassId;
+
+// SSA passes run once, inside the round trip through SSA form; cleanup
+// passes are repeated until none of them changes anything; loop passes
+// run in rounds, each followed by cleanup.
+typedef enum {
+    PASS_GROUP_SSA,
+    PASS_GROUP_CLEANUP,
+    PASS_GROUP_LOOP
+} PassGroup;
+
+typedef struct {
+    const char *name;       // command-line name: --<name> enables, --no-<name> disables
+    const char *summary;    // one line for --help
+    PassGroup group;
+    int level;              // lowest -O level that includes the pass, 0 if none does
+} PassInfo;
+
+const PassInfo *pass_info(PassId id);
+// Pass with the given command-line name, or PASS_COUNT if there is none.
+PassId pass_lookup(const char *name);
+
+#define PASS_MAX_LEVEL 2
+
+// Loop rounds are capped; cleanup always runs until it is done.
+#define PASS_MAX_ROUNDS 8
+
+typedef struct {
+    bool enabled[PASS_COUNT];
+    bool stats;             // collect per-pass statistics
+} PassConfig;
+
+// The preset of -O<level>: every pass whose level is in 1..level.
+void pass_config_init(PassConfig *config, int level);
+
+typedef struct {
+    int runs;
+    int changes;            // runs that changed the function
+    double seconds;
+    int instrs_before;      // instructions before its first run
+    int instrs_after;       // and after its last one
+} PassStats;
+
+// Runs the enabled passes over fn. stats, if not NULL, holds PASS_COUNT
+// entries (zeroed by the caller) and accumulates over calls.
+void pass_manager_run(TackyFunction *fn, const PassConfig *config, PassStats *stats);
+void pass_stats_print(const PassStats *stats, FILE *out);
+
+#endif
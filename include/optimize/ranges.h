@@ -0,0 +1,57 @@
+#ifndef RANGES_H
+#define RANGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "cfg.h"
+
+// What is known about a 32-bit value: it lies in the signed interval
+// [lo, hi], and the bits set in zeros (ones) are 0 (1) in it. The two
+// views are kept consistent, so each is as tight as the other allows.
+typedef struct {
+    int lo;
+    int hi;
+    unsigned zeros;
+    unsigned ones;
+} ValueRange;
+
+ValueRange range_full(void);
+ValueRange range_const(int value);
+
+static inline bool range_is_const(const ValueRange *r) { return r->lo == r->hi; }
+static inline bool range_is_nonneg(const ValueRange *r) { return r->lo >= 0; }
+static inline bool range_is_bool(const ValueRange *r) { return r->lo >= 0 && r->hi <= 1; }
+
+// Decides op on values in a and b: true, with the result in *out, if it is
+// the same for every pair of them.
+bool range_compare(TackyBinaryOp op, const ValueRange *a, const ValueRange *b, int *out);
+
+// Ranges of every variable over the control-flow graph, found by forward
+// dataflow with widening at loop heads. A conditional jump on a comparison
+// narrows its operands along each edge (i < n holds in the loop body, fails
+// at its exit), and an edge whose narrowed range is empty is never taken.
+// Results are stored per instruction: the ranges of src1 and src2 as it
+// reads them, constants included. Instructions in blocks no executable
+// edge reaches get full ranges.
+typedef struct {
+    int instr_count;
+    ValueRange *operands;       // 2 * instr_count: src1 and src2 of each
+    size_t operand_capacity;
+    bool *reached;              // per block: some executable edge enters it
+    int block_capacity;
+} RangeAnalysis;
+
+// Computes ranges for the function cfg was built over. Reuses the buffers
+// of a previous run.
+void ranges_compute(RangeAnalysis *ra, const Cfg *cfg);
+void ranges_free(RangeAnalysis *ra);
+
+static inline const ValueRange *ranges_src1(const RangeAnalysis *ra, int instr) {
+    return &ra->operands[2 * instr];
+}
+
+static inline const ValueRange *ranges_src2(const RangeAnalysis *ra, int instr) {
+    return &ra->operands[2 * instr + 1];
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "cfg.h"
+#include "dominators.h"
+
+// A phi function at the top of a block: dst takes the value of the
+// argument belonging to the predecessor control arrived from.
+typedef struct {
+    int dst;            // SSA variable defined, -1 once a pass deletes it
+    int var;            // variable of the original function it versions
+    int block;
+    int arg_start;      // args[arg_start .. arg_start + arg_count)
+    int arg_count;
+} SsaPhi;
+
+typedef struct {
+    int pred;           // predecessor block the value flows in from
+    TackyVal value;
+} SsaPhiArg;
+
+// A function in SSA form. The instructions live in fn->body as usual,
+// renamed so that every variable has at most one definition; phis live in
+// side tables since their operand count varies. Variables that are read
+// before any assignment keep their original index, which stands for the
+// (undefined) value on entry.
+//
+// Passes running on SSA form may rewrite operands and turn instructions
+// into NOPs, but must not add, move or compact instructions: the CFG and
+// the phi tables refer to block numbers and instruction indices. A
+// conditional jump may also become a Jump or a NOP; ssa_destroy follows
+// the jumps as they stand and drops phi arguments of edges that are gone.
+typedef struct {
+    TackyFunction *fn;
+    Cfg cfg;
+    DomTree dom;
+    SsaPhi *phis;       // grouped by block
+    int phi_count;
+    int *phi_start;     // phis of block b: phis[phi_start[b] .. phi_start[b + 1])
+    SsaPhiArg *args;
+    int arg_count;
+    int *origin;        // SSA variable -> original variable
+    int origin_count;
+    int entry_label;    // label ssa_build added at the top, or -1
+} SsaForm;
+
+// Converts fn to pruned SSA form. A label is added at the top first if
+// the entry block is the target of a jump, so the entry has no
+// predecessors.
+void ssa_build(SsaForm *ssa, TackyFunction *fn);
+
+// Leaves SSA form: every phi becomes copies on the incoming edges,
+// splitting critical edges into new blocks and ordering the copies of
+// each edge as a parallel assignment. Frees the side tables and compacts
+// the function.
+void ssa_destroy(SsaForm *ssa);
+
+#endif
@@ -49,6 +49,7 @@ typedef struct ASTNode {
     struct ASTNode *fourth;
     char *value;
     bool owns_value;
+    int var_id;     // resolver's variable index, -1 if unresolved
 } ASTNode;
 
 typedef struct {
@@ -1,9 +1,45 @@
 #ifndef SEMANTIC_H
 #define SEMANTIC_H
 
+#include <stdbool.h>
 #include "../parser/parser.h"
 
-// Exits with a non-zero status if semantic errors are encountered.
-void resolve_variables(ASTNode *program);
+// What the resolver learned about one variable, indexed by ASTNode.var_id.
+typedef struct {
+    int uses;           // reads, including assignments whose value is used
+    int assignments;    // stores, including the initializer
+    bool constant;      // every store writes the literal const_value
+    int const_value;
+    int loop_depth;     // deepest loop nesting of any read, loop tests and steps
+                        // included; nothing reads it yet
+} VarUsage;
+
+typedef struct {
+    VarUsage *vars;
+    int count;
+    int capacity;
+} VarUsageTable;
+
+// Exits with a non-zero status if semantic errors are encountered. When
+// usage is non-NULL it receives per-variable use/def counts.
+void resolve_variables(ASTNode *program, VarUsageTable *usage);
+void var_usage_free(VarUsageTable *usage);
+
+// Incremental resolver for front ends that resolve names while walking the
+// AST for another purpose (see tacky_from_ast_fused). It reports the same
+// diagnostics as resolve_variables but leaves the AST untouched; returned
+// names stay valid until the resolver is destroyed.
+typedef struct Resolver Resolver;
+
+Resolver *resolver_create(void);
+void resolver_destroy(Resolver *r);
+void resolver_scope_push(Resolver *r);
+void resolver_scope_pop(Resolver *r);
+void resolver_loop_enter(Resolver *r);
+void resolver_loop_exit(Resolver *r);
+const char *resolver_declare(Resolver *r, ASTNode *decl);
+const char *resolver_lookup(Resolver *r, ASTNode *var);
+const char *resolver_assignment_target(Resolver *r, ASTNode *assign);
+void resolver_check_jump(Resolver *r, ASTNode *stmt);
 
 #endif
@@ -2,7 +2,9 @@
 #define TACKY_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "../parser/parser.h"
+#include "../semantic/semantic.h"
 
 typedef enum {
     TACKY_VAL_CONSTANT,
@@ -11,9 +13,7 @@ typedef enum {
 
 typedef struct {
     TackyValKind kind;
-    int constant;      // valid if kind == TACKY_VAL_CONSTANT
-    char *var_name;    // valid if kind == TACKY_VAL_VAR
-    bool owns_name;
+    int value;         // the constant, or an index into TackyFunction.var_names
 } TackyVal;
 
 typedef enum {
@@ -36,6 +36,29 @@ typedef enum {
     TACKY_BIN_GREATER_EQUAL
 } TackyBinaryOp;
 
+// Labels are numbered per function; the kind only picks a readable prefix
+// for printed and emitted names ("while_cond4", ".Lfor_end7").
+typedef enum {
+    TACKY_LABEL_AND_FALSE,
+    TACKY_LABEL_AND_END,
+    TACKY_LABEL_OR_TRUE,
+    TACKY_LABEL_OR_END,
+    TACKY_LABEL_COND_ELSE,
+    TACKY_LABEL_COND_END,
+    TACKY_LABEL_IF_ELSE,
+    TACKY_LABEL_IF_END,
+    TACKY_LABEL_WHILE_COND,
+    TACKY_LABEL_WHILE_END,
+    TACKY_LABEL_DO_BODY,
+    TACKY_LABEL_DO_CONTINUE,
+    TACKY_LABEL_DO_END,
+    TACKY_LABEL_FOR_COND,
+    TACKY_LABEL_FOR_CONTINUE,
+    TACKY_LABEL_FOR_END,
+    TACKY_LABEL_BLOCK,      // blocks created by optimization passes
+    TACKY_LABEL_PREHEADER   // entries to loops made by loop passes
+} TackyLabelKind;
+
 typedef enum {
     TACKY_INSTR_RETURN,
     TACKY_INSTR_UNARY,
@@ -44,45 +67,94 @@ typedef enum {
     TACKY_INSTR_JUMP,
     TACKY_INSTR_JUMP_IF_ZERO,
     TACKY_INSTR_JUMP_IF_NOT_ZERO,
-    TACKY_INSTR_LABEL
+    TACKY_INSTR_LABEL,
+    TACKY_INSTR_NOP     // tombstone left by passes; dropped by tacky_compact
 } TackyInstrKind;
 
+// Every instruction uses the same three-operand layout:
+//   Return          src1
+//   Unary           op src1 -> dst
+//   Binary          op src1, src2 -> dst
+//   Copy            src1 -> dst
+//   Jump            -> label
+//   JumpIf[Not]Zero src1 -> label
+//   Label           label
 typedef struct TackyInstr {
-    TackyInstrKind kind;
-    TackyVal ret_val;
-    TackyUnaryOp un_op;
-    TackyVal un_src;
-    char *un_dst; // destination variable name
-
-    TackyBinaryOp bin_op;
-    TackyVal bin_src1;
-    TackyVal bin_src2;
-    char *bin_dst; // destination variable name for binary
-
-    TackyVal copy_src;
-    char *copy_dst;
-
-    char *jump_target;
-    TackyVal cond_val;
-
-    char *label;
-
-    struct TackyInstr *next;
+    unsigned char kind;     // TackyInstrKind
+    unsigned char op;       // TackyUnaryOp or TackyBinaryOp
+    union {
+        int dst;            // destination variable index
+        int label;          // label number, < TackyFunction.label_count
+    };
+    TackyVal src1;
+    TackyVal src2;
 } TackyInstr;
 
 typedef struct {
     char *name;         // function name
-    TackyInstr *body;   // linked list of instructions
+    TackyInstr *body;   // instruction array, indices are stable until compaction
+    int instr_count;
+    int instr_capacity;
+    char **var_names;   // source variables by index; NULL for temporaries
+    int var_count;
+    int var_capacity;
+    unsigned char *label_kinds; // TackyLabelKind of each label
+    int label_count;
+    int label_capacity;
 } TackyFunction;
 
+// Large enough for any printed temporary or label name.
+#define TACKY_NAME_MAX 48
+
 typedef struct {
     TackyFunction *fn;
 } TackyProgram;
 
-TackyProgram *tacky_from_ast(ASTNode *ast);
-
-void tacky_print_txt(TackyProgram *p);
-void tacky_print_json(TackyProgram *p);
+// usage (optional) lets the generator drop stores to variables that are
+// never read and replace reads of constant variables with the constant.
+TackyProgram *tacky_from_ast(ASTNode *ast, const VarUsageTable *usage);
+// Resolves variable names while lowering, in a single walk over an AST that
+// has not been through resolve_variables. Exits on semantic errors.
+TackyProgram *tacky_from_ast_fused(ASTNode *ast);
+
+// Instruction storage. Pointers returned by tacky_append/tacky_insert are
+// only valid until the next call that can grow the array. Passes delete by
+// turning instructions into TACKY_INSTR_NOP and compact once at the end.
+TackyInstr *tacky_append(TackyFunction *fn, TackyInstrKind kind);
+TackyInstr *tacky_insert(TackyFunction *fn, int at, int count);
+void tacky_compact(TackyFunction *fn);
+
+// Insertions a pass queues while it keeps working with the indices its
+// analyses were built on. Each queued run goes in front of body[at], runs
+// for the same index in the order they were queued; tacky_apply_insertions
+// places them all in one pass over the body and empties the queue.
+typedef struct {
+    TackyInstr *instrs;
+    int *at;            // index each queued instruction goes in front of
+    int count;
+    int capacity;
+} TackyInsertions;
+
+// Queues count NOPs in front of body[at] and returns the first, to be
+// filled in before the next call.
+TackyInstr *tacky_queue_insert(TackyInsertions *q, int at, int count);
+void tacky_apply_insertions(TackyFunction *fn, TackyInsertions *q);
+void tacky_insertions_free(TackyInsertions *q);
+
+// Fresh temporaries and labels for passes that rewrite a function.
+// tacky_new_var copies name; a NULL name makes a temporary.
+int tacky_new_temp(TackyFunction *fn);
+int tacky_new_var(TackyFunction *fn, const char *name);
+int tacky_new_label(TackyFunction *fn, TackyLabelKind kind);
+
+// Printable names. Temporaries and labels have no stored name; theirs is
+// formatted into buf, which must hold TACKY_NAME_MAX bytes.
+const char *tacky_var_name(const TackyFunction *fn, int var, char *buf);
+const char *tacky_label_prefix(TackyLabelKind kind);
+const char *tacky_label_name(const TackyFunction *fn, int label, char *buf);
+
+void tacky_print_txt(TackyProgram *p, FILE *out);
+void tacky_print_json(TackyProgram *p, FILE *out);
 
 void tacky_free(TackyProgram *p);
 
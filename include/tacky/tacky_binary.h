@@ -0,0 +1,57 @@
+#ifndef TACKY_BINARY_H
+#define TACKY_BINARY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tacky.h"
+
+// Binary TACKY, one function per file, little-endian throughout. Every
+// section starts on a 4-byte boundary and holds fixed-width records, so a
+// mapped file can be read in place through the structs below:
+//
+//   TackyBinHeader
+//   TackyBinInstr   [instr_count]
+//   uint32_t        [var_count]      name of each variable: strtab offset,
+//                                    TACKY_BIN_NO_NAME for temporaries
+//   uint8_t         [label_count]    TackyLabelKind of each label, padded
+//                                    to a multiple of 4 bytes
+//   char            [strtab_size]    NUL-terminated names
+//
+// A reader rejects any other version; readers of a later version can
+// still tell an old file by it.
+#define TACKY_BIN_MAGIC "TACKYBIN"
+#define TACKY_BIN_VERSION 1
+#define TACKY_BIN_NO_NAME 0xffffffffu
+
+typedef struct {
+    char magic[8];              // TACKY_BIN_MAGIC, without its NUL
+    uint32_t version;
+    uint32_t instr_count;
+    uint32_t var_count;
+    uint32_t label_count;
+    uint32_t strtab_size;
+    uint32_t name;              // strtab offset of the function name
+} TackyBinHeader;
+
+// TackyInstr with its operands spelled out: dst_or_label is the
+// destination variable or the label, as the kind says.
+typedef struct {
+    uint8_t kind;               // TackyInstrKind
+    uint8_t op;                 // TackyUnaryOp or TackyBinaryOp
+    uint8_t src1_kind;          // TackyValKind
+    uint8_t src2_kind;
+    int32_t dst_or_label;
+    int32_t src1;
+    int32_t src2;
+} TackyBinInstr;
+
+// Writes the program's function; false if writing fails.
+bool tacky_write_binary(const TackyProgram *p, FILE *out);
+
+// Maps (or reads) path and checks every count, offset and index in it
+// before building a TackyProgram; NULL, with a message on stderr, if the
+// file is not valid binary TACKY of this version.
+TackyProgram *tacky_load_binary(const char *path);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef UTIL_ALLOC_H
+#define UTIL_ALLOC_H
+
+#include <stddef.h>
+
+// malloc, calloc and realloc that report running out of memory and exit
+// instead of returning NULL. A zero size still returns a unique pointer.
+void *xmalloc(size_t size);
+void *xcalloc(size_t count, size_t size);
+void *xrealloc(void *ptr, size_t size);
+
+#endif
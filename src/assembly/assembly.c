@@ -1,8 +1,10 @@
 #include "../../include/assembly/assembly.h"
 #include "../../include/tacky/tacky.h"
+#include "../../include/optimize/ranges.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/stat.h>
 
 #ifdef _WIN32
@@ -40,94 +42,122 @@ static AssemblyInstruction *create_instruction(AssemblyInstructionType type, Ope
     instr->src = src;
     instr->dst = dst;
     instr->cond = ASM_COND_NONE;
-    instr->label = NULL;
+    instr->label = -1;
+    instr->label_kind = 0;
     instr->next = NULL;
     return instr;
 }
 
-static char *xstrdup_local(const char *s) {
-    size_t n = strlen(s) + 1;
-    char *p = (char *)malloc(n);
-    if (!p) return NULL;
-    memcpy(p, s, n);
-    return p;
-}
-
 static void append_instr(AssemblyInstruction **head, AssemblyInstruction **tail, AssemblyInstruction *ins) {
     ins->next = NULL;
     if (!*head) { *head = *tail = ins; }
     else { (*tail)->next = ins; *tail = ins; }
 }
 
-static int is_name_in_list(char **names, int count, const char *name) {
-    for (int i = 0; i < count; i++) {
-        if (strcmp(names[i], name) == 0) return 1;
+// Stack slot of each TACKY variable index, numbered in order of first
+// appearance. Variables that no instruction mentions get no slot.
+typedef struct {
+    int *slot_of; // var index -> slot number + 1, 0 when unused
+    int count;
+} SlotMap;
+
+static void ensure_slot(SlotMap *slots, TackyVal val) {
+    if (val.kind == TACKY_VAL_VAR && !slots->slot_of[val.value]) {
+        slots->slot_of[val.value] = ++slots->count;
     }
-    return 0;
 }
 
-static void ensure_slot_name(char ***names, int *count, int *cap, const char *name) {
-    if (!name) return;
-    if (is_name_in_list(*names, *count, name)) return;
-    if (*count == *cap) {
-        *cap = (*cap == 0) ? 8 : (*cap * 2);
-        char **resized = (char **)realloc(*names, sizeof(char *) * (*cap));
-        if (!resized) {
-            fprintf(stderr, "Out of memory while collecting temporaries\n");
-            exit(1);
-        }
-        *names = resized;
+static void ensure_slot_var(SlotMap *slots, int var) {
+    if (!slots->slot_of[var]) slots->slot_of[var] = ++slots->count;
+}
+
+static int is_relational_binop(TackyBinaryOp op) {
+    switch (op) {
+        case TACKY_BIN_EQUAL:
+        case TACKY_BIN_NOT_EQUAL:
+        case TACKY_BIN_LESS:
+        case TACKY_BIN_LESS_EQUAL:
+        case TACKY_BIN_GREATER:
+        case TACKY_BIN_GREATER_EQUAL:
+            return 1;
+        default:
+            return 0;
     }
-    (*names)[(*count)++] = strdup(name);
 }
 
-static void collect_from_val(TackyVal val, char ***names, int *count, int *cap) {
-    if (val.kind == TACKY_VAL_VAR && val.var_name) {
-        ensure_slot_name(names, count, cap, val.var_name);
+// Marks the relational instructions whose result only feeds the
+// conditional jump right after them. Such a pair becomes one cmpl and a
+// jcc on its flags, so the 0/1 value is never materialized with setcc,
+// stored and compared against 0 again, and needs no stack slot.
+static bool *find_fused_compares(const TackyFunction *fn) {
+    bool *fused = (bool *)calloc((size_t)fn->instr_count + 1, sizeof(bool));
+    int *uses = (int *)calloc((size_t)fn->var_count + 1, sizeof(int));
+    if (!fused || !uses) {
+        fprintf(stderr, "Out of memory while selecting compare-and-jump pairs\n");
+        exit(1);
+    }
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (ins->kind == TACKY_INSTR_LABEL || ins->kind == TACKY_INSTR_JUMP || ins->kind == TACKY_INSTR_NOP) continue;
+        if (ins->src1.kind == TACKY_VAL_VAR) uses[ins->src1.value]++;
+        if (ins->kind == TACKY_INSTR_BINARY && ins->src2.kind == TACKY_VAL_VAR) uses[ins->src2.value]++;
     }
+    for (int i = 0; i + 1 < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        const TackyInstr *next = &fn->body[i + 1];
+        if (ins->kind != TACKY_INSTR_BINARY || !is_relational_binop((TackyBinaryOp)ins->op)) continue;
+        if (next->kind != TACKY_INSTR_JUMP_IF_ZERO && next->kind != TACKY_INSTR_JUMP_IF_NOT_ZERO) continue;
+        if (next->src1.kind != TACKY_VAL_VAR || next->src1.value != ins->dst) continue;
+        fused[i] = uses[ins->dst] == 1;
+    }
+    free(uses);
+    return fused;
 }
 
-static int collect_temp_vars(TackyFunction *fn, char ***out_names) {
-    int cap = 0, count = 0;
-    char **names = NULL;
-    for (TackyInstr *ins = fn->body; ins; ins = ins->next) {
+static SlotMap collect_temp_vars(TackyFunction *fn, const bool *fused) {
+    SlotMap slots = {0};
+    slots.slot_of = (int *)calloc((size_t)fn->var_count + 1, sizeof(int));
+    if (!slots.slot_of) {
+        fprintf(stderr, "Out of memory while collecting temporaries\n");
+        exit(1);
+    }
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
         switch (ins->kind) {
             case TACKY_INSTR_UNARY:
-                collect_from_val(ins->un_src, &names, &count, &cap);
-                ensure_slot_name(&names, &count, &cap, ins->un_dst);
+            case TACKY_INSTR_COPY:
+                ensure_slot(&slots, ins->src1);
+                ensure_slot_var(&slots, ins->dst);
                 break;
             case TACKY_INSTR_BINARY:
-                collect_from_val(ins->bin_src1, &names, &count, &cap);
-                collect_from_val(ins->bin_src2, &names, &count, &cap);
-                ensure_slot_name(&names, &count, &cap, ins->bin_dst);
-                break;
-            case TACKY_INSTR_COPY:
-                collect_from_val(ins->copy_src, &names, &count, &cap);
-                ensure_slot_name(&names, &count, &cap, ins->copy_dst);
+                ensure_slot(&slots, ins->src1);
+                ensure_slot(&slots, ins->src2);
+                if (fused[i]) {
+                    i++;    // the jump reads the flags, not the value
+                    break;
+                }
+                ensure_slot_var(&slots, ins->dst);
                 break;
             case TACKY_INSTR_JUMP_IF_ZERO:
             case TACKY_INSTR_JUMP_IF_NOT_ZERO:
-                collect_from_val(ins->cond_val, &names, &count, &cap);
-                break;
             case TACKY_INSTR_RETURN:
-                collect_from_val(ins->ret_val, &names, &count, &cap);
+                ensure_slot(&slots, ins->src1);
                 break;
             default:
                 break;
         }
     }
-    *out_names = names;
-    return count;
+    return slots;
 }
 
-static int slot_offset_for(char **names, int n, const char *name) {
-    for (int i = 0; i < n; i++) {
-        if (strcmp(names[i], name) == 0) {
-            // Slots are -4, -8, ... relative to %rbp
-            return -4 * (i + 1);
-        }
-    }
-    return 0; // shouldn't happen
+static int slot_offset_for(const SlotMap *slots, int var) {
+    // Slots are -4, -8, ... relative to %rbp
+    return -4 * slots->slot_of[var];
+}
+
+static Operand slot_operand(const SlotMap *slots, int var) {
+    Operand op = { .type = OPERAND_MEM_RBP_OFFSET, .value = slot_offset_for(slots, var) };
+    return op;
 }
 
 static const char *reg32_name(int id) {
@@ -167,12 +197,12 @@ static void print_operand(FILE *out, Operand op, int byte_reg) {
     }
 }
 
-static Operand operand_from_val(TackyVal val, char **slot_names, int nslots) {
+static Operand operand_from_val(TackyVal val, const SlotMap *slots) {
     if (val.kind == TACKY_VAL_CONSTANT) {
-        Operand op = { .type = OPERAND_IMMEDIATE, .value = val.constant };
+        Operand op = { .type = OPERAND_IMMEDIATE, .value = val.value };
         return op;
     }
-    int off = slot_offset_for(slot_names, nslots, val.var_name);
+    int off = slot_offset_for(slots, val.value);
     Operand op = { .type = OPERAND_MEM_RBP_OFFSET, .value = off };
     return op;
 }
@@ -204,6 +234,138 @@ static void append_move_with_fixups(AssemblyInstruction **head, AssemblyInstruct
     append_instr(head, tail, create_instruction(ASM_MOV, src, dst));
 }
 
+static Operand reg_operand(int id) {
+    Operand op = { .type = OPERAND_REGISTER, .value = id };
+    return op;
+}
+
+static Operand imm_operand(int value) {
+    Operand op = { .type = OPERAND_IMMEDIATE, .value = value };
+    return op;
+}
+
+static void append_op(AssemblyInstruction **head, AssemblyInstruction **tail, AssemblyInstructionType type, Operand src, Operand dst) {
+    append_instr(head, tail, create_instruction(type, src, dst));
+}
+
+// Magic multiplier and shift for signed division by d, |d| >= 2: the high
+// half of n * multiplier, corrected by n when the multiplier's sign
+// differs from d's, shifted right arithmetically by shift and incremented
+// if negative, is n / d truncated toward zero (Hacker's Delight, 10-1).
+static void signed_div_magic(int d, int *multiplier, int *shift) {
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? 0u - (unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;     // largest n with n % ad == ad - 1
+    int p = 31;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    do {
+        p++;
+        q1 *= 2; r1 *= 2;
+        if (r1 >= anc) { q1++; r1 -= anc; }
+        q2 *= 2; r2 *= 2;
+        if (r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    unsigned m = q2 + 1;
+    *multiplier = (int)(d < 0 ? 0u - m : m);
+    *shift = p - 32;
+}
+
+// Division and remainder by a constant other than 0, 1, -1 and INT_MIN,
+// without idivl. Leaves the result in %eax.
+// 2^k: (n + (n < 0 ? 2^k - 1 : 0)) >> k, the bias coming from the sign
+// bits shifted down; -2^k negates that. Other divisors multiply by the
+// magic number instead. A remainder is then n - q * d.
+// A dividend known to be non-negative (nonneg) needs no bias, has its low
+// k bits as remainder by +-2^k, and over a positive divisor has a
+// quotient that needs no rounding toward zero.
+static void append_div_by_constant(AssemblyInstruction **head, AssemblyInstruction **tail, Operand dividend, int d,
+                                   bool remainder, bool nonneg) {
+    Operand eax = reg_operand(0), ecx = reg_operand(1), edx = reg_operand(2);
+    unsigned ad = d < 0 ? 0u - (unsigned)d : (unsigned)d;
+    bool power_of_two = (ad & (ad - 1)) == 0;
+    int k = 0;
+    while (power_of_two && (1u << k) != ad) k++;
+    append_move_with_fixups(head, tail, dividend, eax);
+
+    if (power_of_two && nonneg) {
+        if (remainder) {
+            append_op(head, tail, ASM_AND, imm_operand((int)(ad - 1)), eax);
+            return;
+        }
+        append_op(head, tail, ASM_SHR, imm_operand(k), eax);
+        if (d < 0) append_instr(head, tail, create_instruction(ASM_NEG, eax, (Operand){0}));
+        return;
+    }
+
+    append_op(head, tail, ASM_MOV, eax, ecx);
+    if (power_of_two) {
+        append_op(head, tail, ASM_MOV, eax, edx);
+        append_op(head, tail, ASM_SAR, imm_operand(31), edx);
+        append_op(head, tail, ASM_SHR, imm_operand(32 - k), edx);
+        append_op(head, tail, ASM_ADD, edx, eax);
+        if (remainder) {
+            // n % d == n % |d| == n - ((n + bias) & -2^k)
+            append_op(head, tail, ASM_SAR, imm_operand(k), eax);
+            append_op(head, tail, ASM_SHL, imm_operand(k), eax);
+            append_op(head, tail, ASM_SUB, eax, ecx);
+            append_op(head, tail, ASM_MOV, ecx, eax);
+            return;
+        }
+        append_op(head, tail, ASM_SAR, imm_operand(k), eax);
+        if (d < 0) append_instr(head, tail, create_instruction(ASM_NEG, eax, (Operand){0}));
+        return;
+    }
+
+    int multiplier, shift;
+    signed_div_magic(d, &multiplier, &shift);
+    append_op(head, tail, ASM_MOV, imm_operand(multiplier), edx);
+    append_op(head, tail, ASM_IMUL_EDX, (Operand){0}, (Operand){0});
+    if (d > 0 && multiplier < 0) append_op(head, tail, ASM_ADD, ecx, edx);
+    if (d < 0 && multiplier > 0) append_op(head, tail, ASM_SUB, ecx, edx);
+    if (shift > 0) append_op(head, tail, ASM_SAR, imm_operand(shift), edx);
+    append_op(head, tail, ASM_MOV, edx, eax);
+    if (!nonneg || d < 0) {
+        append_op(head, tail, ASM_SHR, imm_operand(31), eax);
+        append_op(head, tail, ASM_ADD, edx, eax);
+    }
+    if (remainder) {
+        append_op(head, tail, ASM_IMUL, imm_operand(d), eax);
+        append_op(head, tail, ASM_SUB, eax, ecx);
+        append_op(head, tail, ASM_MOV, ecx, eax);
+    }
+}
+
+// Extends %eax into %edx for a division: cltd, or zeroing %edx for divl.
+static void append_sign_extend(AssemblyInstruction **head, AssemblyInstruction **tail, bool unsigned_div) {
+    if (unsigned_div) append_op(head, tail, ASM_XOR, reg_operand(2), reg_operand(2));
+    else append_instr(head, tail, create_instruction(ASM_CLTD, (Operand){0}, (Operand){0}));
+}
+
+// What range analysis knows of the operands of instruction i. It runs only
+// when fold-ranges is enabled; without it, ranges is NULL and nothing is.
+static bool src1_is_bool(const RangeAnalysis *ranges, int i) {
+    return ranges && range_is_bool(ranges_src1(ranges, i));
+}
+
+static bool src1_is_nonneg(const RangeAnalysis *ranges, int i) {
+    return ranges && range_is_nonneg(ranges_src1(ranges, i));
+}
+
+static bool src2_is_nonneg(const RangeAnalysis *ranges, int i) {
+    return ranges && range_is_nonneg(ranges_src2(ranges, i));
+}
+
+static bool divides_without_idiv(const TackyInstr *ins) {
+    if (ins->op != TACKY_BIN_DIV && ins->op != TACKY_BIN_REM) return false;
+    if (ins->src2.kind != TACKY_VAL_CONSTANT) return false;
+    int d = ins->src2.value;
+    return d != 0 && d != 1 && d != -1 && d != INT_MIN;
+}
+
 static AssemblyCondCode cond_from_relop(TackyBinaryOp op) {
     switch (op) {
         case TACKY_BIN_EQUAL: return ASM_COND_E;
@@ -216,20 +378,6 @@ static AssemblyCondCode cond_from_relop(TackyBinaryOp op) {
     }
 }
 
-static int is_relational_binop(TackyBinaryOp op) {
-    switch (op) {
-        case TACKY_BIN_EQUAL:
-        case TACKY_BIN_NOT_EQUAL:
-        case TACKY_BIN_LESS:
-        case TACKY_BIN_LESS_EQUAL:
-        case TACKY_BIN_GREATER:
-        case TACKY_BIN_GREATER_EQUAL:
-            return 1;
-        default:
-            return 0;
-    }
-}
-
 static const char *cond_suffix(AssemblyCondCode cond) {
     switch (cond) {
         case ASM_COND_E: return "e";
@@ -242,64 +390,93 @@ static const char *cond_suffix(AssemblyCondCode cond) {
     }
 }
 
-static AssemblyInstruction *generate_instructions_from_tacky(TackyFunction *fn, char **slot_names, int nslots) {
+static AssemblyCondCode invert_cond(AssemblyCondCode cond) {
+    switch (cond) {
+        case ASM_COND_E: return ASM_COND_NE;
+        case ASM_COND_NE: return ASM_COND_E;
+        case ASM_COND_L: return ASM_COND_GE;
+        case ASM_COND_LE: return ASM_COND_G;
+        case ASM_COND_G: return ASM_COND_LE;
+        case ASM_COND_GE: return ASM_COND_L;
+        default: return cond;
+    }
+}
+
+static AssemblyInstruction *generate_instructions_from_tacky(TackyFunction *fn, const SlotMap *slots, const bool *fused,
+                                                             const RangeAnalysis *ranges) {
     if (!fn) return NULL;
     AssemblyInstruction *head = NULL, *tail = NULL;
 
-    for (TackyInstr *ins = fn->body; ins; ins = ins->next) {
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
         switch (ins->kind) {
             case TACKY_INSTR_UNARY: {
-                if (ins->un_op == TACKY_UN_NOT) {
+                if (ins->op == TACKY_UN_NOT && src1_is_bool(ranges, i)) {
+                    // !x is x ^ 1 when x is 0 or 1.
+                    Operand dst = slot_operand(slots, ins->dst);
+                    append_move_with_fixups(&head, &tail, operand_from_val(ins->src1, slots), dst);
+                    append_op(&head, &tail, ASM_XOR, imm_operand(1), dst);
+                } else if (ins->op == TACKY_UN_NOT) {
                     Operand zero = { .type = OPERAND_IMMEDIATE, .value = 0 };
-                    Operand cond_op = operand_from_val(ins->un_src, slot_names, nslots);
+                    Operand cond_op = operand_from_val(ins->src1, slots);
                     append_cmp_with_fixups(&head, &tail, zero, cond_op);
-                    if (ins->un_dst) {
-                        Operand dst = { .type = OPERAND_MEM_RBP_OFFSET, .value = slot_offset_for(slot_names, nslots, ins->un_dst) };
-                        append_move_with_fixups(&head, &tail, zero, dst);
-                        AssemblyInstruction *set = create_instruction(ASM_SETCC, (Operand){0}, dst);
-                        set->cond = ASM_COND_E;
-                        append_instr(&head, &tail, set);
-                    }
+                    Operand dst = slot_operand(slots, ins->dst);
+                    append_move_with_fixups(&head, &tail, zero, dst);
+                    AssemblyInstruction *set = create_instruction(ASM_SETCC, (Operand){0}, dst);
+                    set->cond = ASM_COND_E;
+                    append_instr(&head, &tail, set);
                 } else {
                     Operand eax = { .type = OPERAND_REGISTER, .value = 0 };
-                    Operand dst = {0};
-                    if (ins->un_dst) {
-                        dst.type = OPERAND_MEM_RBP_OFFSET;
-                        dst.value = slot_offset_for(slot_names, nslots, ins->un_dst);
-                    }
-                    Operand src = operand_from_val(ins->un_src, slot_names, nslots);
+                    Operand dst = slot_operand(slots, ins->dst);
+                    Operand src = operand_from_val(ins->src1, slots);
                     append_move_with_fixups(&head, &tail, src, eax);
-                    AssemblyInstructionType op = (ins->un_op == TACKY_UN_NEGATE) ? ASM_NEG : ASM_NOT;
+                    AssemblyInstructionType op = (ins->op == TACKY_UN_NEGATE) ? ASM_NEG : ASM_NOT;
                     append_instr(&head, &tail, create_instruction(op, eax, (Operand){0}));
-                    if (ins->un_dst) {
-                        append_move_with_fixups(&head, &tail, eax, dst);
-                    }
+                    append_move_with_fixups(&head, &tail, eax, dst);
                 }
                 break;
             }
             case TACKY_INSTR_BINARY: {
-                if (is_relational_binop(ins->bin_op)) {
-                    Operand left = operand_from_val(ins->bin_src2, slot_names, nslots);
-                    Operand right = operand_from_val(ins->bin_src1, slot_names, nslots);
+                if (fused[i]) {
+                    // cmpl src2, src1 sets the flags of src1 op src2; JumpIfZero
+                    // jumps when the relation fails, on the inverted condition.
+                    const TackyInstr *jump = &fn->body[++i];
+                    append_cmp_with_fixups(&head, &tail, operand_from_val(ins->src2, slots), operand_from_val(ins->src1, slots));
+                    AssemblyInstruction *jcc = create_instruction(ASM_JCC, (Operand){0}, (Operand){0});
+                    jcc->cond = cond_from_relop(ins->op);
+                    if (jump->kind == TACKY_INSTR_JUMP_IF_ZERO) jcc->cond = invert_cond(jcc->cond);
+                    jcc->label = jump->label;
+                    jcc->label_kind = fn->label_kinds[jump->label];
+                    append_instr(&head, &tail, jcc);
+                } else if (divides_without_idiv(ins)) {
+                    append_div_by_constant(&head, &tail, operand_from_val(ins->src1, slots), ins->src2.value,
+                                           ins->op == TACKY_BIN_REM, src1_is_nonneg(ranges, i));
+                    append_move_with_fixups(&head, &tail, reg_operand(0), slot_operand(slots, ins->dst));
+                } else if (is_relational_binop(ins->op)) {
+                    Operand left = operand_from_val(ins->src2, slots);
+                    Operand right = operand_from_val(ins->src1, slots);
                     append_cmp_with_fixups(&head, &tail, left, right);
-                    if (ins->bin_dst) {
-                        Operand dst = { .type = OPERAND_MEM_RBP_OFFSET, .value = slot_offset_for(slot_names, nslots, ins->bin_dst) };
-                        Operand zero = { .type = OPERAND_IMMEDIATE, .value = 0 };
-                        append_move_with_fixups(&head, &tail, zero, dst);
-                        AssemblyInstruction *set = create_instruction(ASM_SETCC, (Operand){0}, dst);
-                        set->cond = cond_from_relop(ins->bin_op);
-                        append_instr(&head, &tail, set);
-                    }
+                    Operand dst = slot_operand(slots, ins->dst);
+                    Operand zero = { .type = OPERAND_IMMEDIATE, .value = 0 };
+                    append_move_with_fixups(&head, &tail, zero, dst);
+                    AssemblyInstruction *set = create_instruction(ASM_SETCC, (Operand){0}, dst);
+                    set->cond = cond_from_relop(ins->op);
+                    append_instr(&head, &tail, set);
                 } else {
                     Operand eax = { .type = OPERAND_REGISTER, .value = 0 };
                     Operand ecx = { .type = OPERAND_REGISTER, .value = 1 };
-                    Operand src1 = operand_from_val(ins->bin_src1, slot_names, nslots);
-                    Operand src2 = operand_from_val(ins->bin_src2, slot_names, nslots);
+                    Operand src1 = operand_from_val(ins->src1, slots);
+                    Operand src2 = operand_from_val(ins->src2, slots);
                     append_move_with_fixups(&head, &tail, src1, eax);
                     append_move_with_fixups(&head, &tail, eax, ecx);
                     append_move_with_fixups(&head, &tail, src2, eax);
+                    // Unsigned division agrees with signed division when
+                    // neither operand is negative, and needs %edx zeroed
+                    // rather than sign-extended.
+                    bool unsigned_div = src1_is_nonneg(ranges, i) && src2_is_nonneg(ranges, i);
+                    AssemblyInstructionType div = unsigned_div ? ASM_DIV_ECX : ASM_IDIV_ECX;
 
-                    switch (ins->bin_op) {
+                    switch (ins->op) {
                         case TACKY_BIN_ADD:
                             append_instr(&head, &tail, create_instruction(ASM_ADD_ECX_EAX, (Operand){0}, (Operand){0}));
                             break;
@@ -311,78 +488,81 @@ static AssemblyInstruction *generate_instructions_from_tacky(TackyFunction *fn,
                             break;
                         case TACKY_BIN_DIV:
                             append_instr(&head, &tail, create_instruction(ASM_XCHG_EAX_ECX, (Operand){0}, (Operand){0}));
-                            append_instr(&head, &tail, create_instruction(ASM_CLTD, (Operand){0}, (Operand){0}));
-                            append_instr(&head, &tail, create_instruction(ASM_IDIV_ECX, (Operand){0}, (Operand){0}));
+                            append_sign_extend(&head, &tail, unsigned_div);
+                            append_instr(&head, &tail, create_instruction(div, (Operand){0}, (Operand){0}));
                             break;
                         case TACKY_BIN_REM:
                             append_instr(&head, &tail, create_instruction(ASM_XCHG_EAX_ECX, (Operand){0}, (Operand){0}));
-                            append_instr(&head, &tail, create_instruction(ASM_CLTD, (Operand){0}, (Operand){0}));
-                            append_instr(&head, &tail, create_instruction(ASM_IDIV_ECX, (Operand){0}, (Operand){0}));
+                            append_sign_extend(&head, &tail, unsigned_div);
+                            append_instr(&head, &tail, create_instruction(div, (Operand){0}, (Operand){0}));
                             append_instr(&head, &tail, create_instruction(ASM_MOV_EDX_EAX, (Operand){0}, (Operand){0}));
                             break;
                         default:
                             break;
                     }
 
-                    if (ins->bin_dst) {
-                        Operand dst = { .type = OPERAND_MEM_RBP_OFFSET, .value = slot_offset_for(slot_names, nslots, ins->bin_dst) };
-                        append_move_with_fixups(&head, &tail, eax, dst);
-                    }
+                    append_move_with_fixups(&head, &tail, eax, slot_operand(slots, ins->dst));
                 }
                 break;
             }
             case TACKY_INSTR_COPY: {
-                Operand src = operand_from_val(ins->copy_src, slot_names, nslots);
-                Operand dst = { .type = OPERAND_MEM_RBP_OFFSET, .value = slot_offset_for(slot_names, nslots, ins->copy_dst) };
+                Operand src = operand_from_val(ins->src1, slots);
+                Operand dst = slot_operand(slots, ins->dst);
                 append_move_with_fixups(&head, &tail, src, dst);
                 break;
             }
             case TACKY_INSTR_JUMP: {
                 AssemblyInstruction *jmp = create_instruction(ASM_JMP, (Operand){0}, (Operand){0});
-                jmp->label = xstrdup_local(ins->jump_target);
+                jmp->label = ins->label;
+                jmp->label_kind = fn->label_kinds[ins->label];
                 append_instr(&head, &tail, jmp);
                 break;
             }
             case TACKY_INSTR_JUMP_IF_ZERO: {
                 Operand zero = { .type = OPERAND_IMMEDIATE, .value = 0 };
-                Operand cond = operand_from_val(ins->cond_val, slot_names, nslots);
+                Operand cond = operand_from_val(ins->src1, slots);
                 append_cmp_with_fixups(&head, &tail, zero, cond);
                 AssemblyInstruction *jcc = create_instruction(ASM_JCC, (Operand){0}, (Operand){0});
                 jcc->cond = ASM_COND_E;
-                jcc->label = xstrdup_local(ins->jump_target);
+                jcc->label = ins->label;
+                jcc->label_kind = fn->label_kinds[ins->label];
                 append_instr(&head, &tail, jcc);
                 break;
             }
             case TACKY_INSTR_JUMP_IF_NOT_ZERO: {
                 Operand zero = { .type = OPERAND_IMMEDIATE, .value = 0 };
-                Operand cond = operand_from_val(ins->cond_val, slot_names, nslots);
+                Operand cond = operand_from_val(ins->src1, slots);
                 append_cmp_with_fixups(&head, &tail, zero, cond);
                 AssemblyInstruction *jcc = create_instruction(ASM_JCC, (Operand){0}, (Operand){0});
                 jcc->cond = ASM_COND_NE;
-                jcc->label = xstrdup_local(ins->jump_target);
+                jcc->label = ins->label;
+                jcc->label_kind = fn->label_kinds[ins->label];
                 append_instr(&head, &tail, jcc);
                 break;
             }
             case TACKY_INSTR_LABEL: {
                 AssemblyInstruction *lab = create_instruction(ASM_LABEL, (Operand){0}, (Operand){0});
-                lab->label = xstrdup_local(ins->label);
+                lab->label = ins->label;
+                lab->label_kind = fn->label_kinds[ins->label];
                 append_instr(&head, &tail, lab);
                 break;
             }
             case TACKY_INSTR_RETURN: {
                 Operand eax = { .type = OPERAND_REGISTER, .value = 0 };
-                Operand src = operand_from_val(ins->ret_val, slot_names, nslots);
+                Operand src = operand_from_val(ins->src1, slots);
                 append_move_with_fixups(&head, &tail, src, eax);
                 append_instr(&head, &tail, create_instruction(ASM_RET, (Operand){0}, (Operand){0}));
                 break;
             }
+            case TACKY_INSTR_NOP:
+                break;
         }
     }
 
     return head;
 }
 
-AssemblyProgram *generate_assembly(TackyProgram *tacky) {
+AssemblyProgram *generate_assembly(TackyProgram *tacky, bool use_ranges) {
     if (!tacky || !tacky->fn) {
         fprintf(stderr, "Invalid TACKY structure for assembly generation\n");
         exit(1);
@@ -392,16 +572,25 @@ AssemblyProgram *generate_assembly(TackyProgram *tacky) {
     program->function = (AssemblyFunction *)malloc(sizeof(AssemblyFunction));
     program->function->name = strdup(tacky->fn->name);
 
-    char **slots = NULL;
-    int nslots = collect_temp_vars(tacky->fn, &slots);
-    int raw = nslots * 4;
+    Cfg cfg = {0};
+    RangeAnalysis ranges = {0};
+    if (use_ranges) {
+        cfg_build(&cfg, tacky->fn);
+        ranges_compute(&ranges, &cfg);
+    }
+    bool *fused = find_fused_compares(tacky->fn);
+    SlotMap slots = collect_temp_vars(tacky->fn, fused);
+    int raw = slots.count * 4;
     int aligned = ((raw + 15) / 16) * 16; // 16-byte alignment
     program->function->stack_size = aligned;
 
-    program->function->instructions = generate_instructions_from_tacky(tacky->fn, slots, nslots);
+    program->function->instructions = generate_instructions_from_tacky(tacky->fn, &slots, fused,
+                                                                       use_ranges ? &ranges : NULL);
 
-    for (int i = 0; i < nslots; i++) free(slots[i]);
-    free(slots);
+    free(slots.slot_of);
+    free(fused);
+    ranges_free(&ranges);
+    cfg_free(&cfg);
 
     return program;
 }
@@ -475,7 +664,6 @@ void free_assembly(AssemblyProgram *program) {
     AssemblyInstruction *instr = program->function->instructions;
     while (instr) {
         AssemblyInstruction *next = instr->next;
-        free(instr->label);
         free(instr);
         instr = next;
     }
@@ -485,6 +673,20 @@ void free_assembly(AssemblyProgram *program) {
     free(program);
 }
 
+static const char *binary_mnemonic(AssemblyInstructionType type) {
+    switch (type) {
+        case ASM_ADD: return "addl";
+        case ASM_SUB: return "subl";
+        case ASM_IMUL: return "imull";
+        case ASM_SAR: return "sarl";
+        case ASM_SHR: return "shrl";
+        case ASM_SHL: return "shll";
+        case ASM_AND: return "andl";
+        case ASM_XOR: return "xorl";
+        default: return "?";
+    }
+}
+
 void write_assembly_to_stream(AssemblyProgram *program, FILE *out) {
     if (!program || !program->function || !out) return;
 
@@ -530,6 +732,9 @@ void write_assembly_to_stream(AssemblyProgram *program, FILE *out) {
             case ASM_IDIV_ECX:
                 fprintf(out, "  idivl %%ecx\n");
                 break;
+            case ASM_DIV_ECX:
+                fprintf(out, "  divl %%ecx\n");
+                break;
             case ASM_MOV_EDX_EAX:
                 fprintf(out, "  movl %%edx, %%eax\n");
                 break;
@@ -546,18 +751,35 @@ void write_assembly_to_stream(AssemblyProgram *program, FILE *out) {
                 fprintf(out, "\n");
                 break;
             case ASM_JMP:
-                fprintf(out, "  jmp %s%s\n", LOCAL_LABEL_PREFIX, instr->label);
+                fprintf(out, "  jmp %s%s%d\n", LOCAL_LABEL_PREFIX, tacky_label_prefix((TackyLabelKind)instr->label_kind), instr->label);
                 break;
             case ASM_JCC:
-                fprintf(out, "  j%s %s%s\n", cond_suffix(instr->cond), LOCAL_LABEL_PREFIX, instr->label);
+                fprintf(out, "  j%s %s%s%d\n", cond_suffix(instr->cond), LOCAL_LABEL_PREFIX, tacky_label_prefix((TackyLabelKind)instr->label_kind), instr->label);
                 break;
             case ASM_LABEL:
-                fprintf(out, "%s%s:\n", LOCAL_LABEL_PREFIX, instr->label);
+                fprintf(out, "%s%s%d:\n", LOCAL_LABEL_PREFIX, tacky_label_prefix((TackyLabelKind)instr->label_kind), instr->label);
                 break;
             case ASM_RET:
                 fprintf(out, "  leave\n");
                 fprintf(out, "  ret\n");
                 break;
+            case ASM_ADD:
+            case ASM_SUB:
+            case ASM_IMUL:
+            case ASM_SAR:
+            case ASM_SHR:
+            case ASM_SHL:
+            case ASM_AND:
+            case ASM_XOR:
+                fprintf(out, "  %s ", binary_mnemonic(instr->type));
+                print_operand(out, instr->src, 0);
+                fprintf(out, ", ");
+                print_operand(out, instr->dst, 0);
+                fprintf(out, "\n");
+                break;
+            case ASM_IMUL_EDX:
+                fprintf(out, "  imull %%edx\n");
+                break;
         }
         instr = instr->next;
     }
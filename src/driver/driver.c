@@ -9,7 +9,7 @@ static int has_prefix(const char *s, const char *p) {
 
 void driver_print_usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s [--lex | --parse | --validate | --tacky | --codegen] [-S] [--dump-tokens[=<path>]] [--dump-ast[=txt|dot|json] [--dump-ast-path=<path>]] [--dump-tacky[=txt|json] [--dump-tacky-path=<path>]] [--quiet] [--help|-h] <source.c>\n\n"
+            "Usage: %s [--lex | --parse | --validate | --tacky | --codegen] [-S] [--dump-tokens[=<path>]] [--dump-ast[=txt|dot|json] [--dump-ast-path=<path>]] [--dump-tacky[=txt|json|bin] [--dump-tacky-path=<path>]] [--fuse-frontend | --load-tacky] [-O0|-O1|-O2] [--<pass>|--no-<pass>]... [--pass-stats] [--quiet] [--run | --interp | --jit] [--help|-h] <source.c>\n\n"
             "Stages (choose at most one):\n"
             "  --lex                   Run lexer only (no files written)\n"
             "  --parse                 Run lexer+parser (no files written)\n"
@@ -18,27 +18,49 @@ void driver_print_usage(const char *prog) {
             "  --codegen               Run up to assembly IR generation (no emission)\n\n"
             "Emission:\n"
             "  -S                      Emit assembly .s file next to source (no assemble/link)\n\n"
+            "Front end:\n"
+            "  --fuse-frontend         Resolve variables while generating TACKY (single AST walk)\n"
+            "  --load-tacky            Read the input as binary TACKY (--dump-tacky=bin) instead of C\n\n"
+            "Optimizations:\n"
+            "  -O0                     No optimization (default)\n"
+            "  -O1                     Cleanup passes, repeated until none changes anything\n"
+            "  -O2                     -O1 plus SSA and loop passes\n"
+            "  --<pass>, --no-<pass>   Enable or disable one pass on top of the -O level\n"
+            "  --pass-stats            Print runs, time and instruction counts per pass to stderr\n\n"
+            "Passes:\n",
+            prog);
+    for (int id = 0; id < PASS_COUNT; id++) {
+        const PassInfo *pass = pass_info((PassId)id);
+        fprintf(stderr, "  --%-21s %s\n", pass->name, pass->summary);
+    }
+    fprintf(stderr,
+            "\n"
             "Dumpers (write under out/ by default):\n"
             "  --dump-tokens[=<path>]  Dump token stream to <path> or out/<name>.tokens\n"
             "  --dump-ast[=fmt]        Dump AST: fmt = txt (default), dot, json\n"
             "  --dump-ast-path=<path>  Override AST dump path\n"
-            "  --dump-tacky[=fmt]      Dump TACKY: fmt = txt (default) or json\n"
+            "  --dump-tacky[=fmt]      Dump TACKY: fmt = txt (default), json or bin\n"
             "  --dump-tacky-path=<path> Override TACKY dump path\n\n"
             "Output control:\n"
             "  --quiet                 Suppress stdout prints for AST/assembly\n"
             "  --run                   Run the produced executable and print its exit code (full pipeline only)\n"
+            "  --interp                Run the program in-process on a bytecode interpreter instead of building it\n"
+            "  --jit                   Encode the assembly to x86-64 machine code in memory and run it in-process\n"
             "  --help, -h              Show this help and exit\n\n"
             "Defaults and notes:\n"
             "  • Without a stage flag, the full pipeline runs, prints AST/assembly, and builds an executable via cc (pipe).\n"
             "  • When a stage flag is used, -S is ignored (no emission in partial stages).\n"
             "  • Only one stage flag may be provided.\n"
+            "  • --run, --interp and --jit exclude each other, and --interp and --jit cannot be combined with a stage flag.\n"
+            "  • --fuse-frontend and --load-tacky exclude each other.\n"
             "  • Dumpers create files under ./out using the input basename.\n\n"
             "Examples:\n"
             "  %s examples/neg.c\n"
             "  %s --lex examples/neg.c\n"
             "  %s --parse --dump-ast=dot examples/neg.c\n"
             "  %s --tacky --dump-tacky=json examples/neg.c\n"
-            "  %s -S --quiet examples/neg.c\n",
+            "  %s -S --quiet examples/neg.c\n"
+            "  %s -O2 --no-unroll --pass-stats examples/neg.c\n",
             prog, prog, prog, prog, prog, prog);
 }
 
@@ -61,9 +83,19 @@ DriverOptions driver_parse_args(int argc, char **argv) {
     opts.dump_ast_path = NULL;
     opts.quiet = false;
     opts.run_exec = false;
+    opts.interp = false;
+    opts.jit = false;
+    opts.fuse_frontend = false;
+    opts.load_tacky = false;
+    opts.opt_level = 0;
     opts.dump_tacky_format = DUMP_TACKY_NONE;
     opts.dump_tacky_path = NULL;
 
+    bool pass_stats = false;
+    // Per-pass overrides: 1 for --<pass>, -1 for --no-<pass>, applied on
+    // top of the -O level whichever order they come in.
+    signed char pass_override[PASS_COUNT] = {0};
+
     if (argc < 2) {
         driver_print_usage(argv[0]);
         exit(1);
@@ -116,6 +148,22 @@ DriverOptions driver_parse_args(int argc, char **argv) {
             opts.quiet = true;
         } else if (strcmp(arg, "--run") == 0) {
             opts.run_exec = true;
+        } else if (strcmp(arg, "--interp") == 0) {
+            opts.interp = true;
+        } else if (strcmp(arg, "--jit") == 0) {
+            opts.jit = true;
+        } else if (strcmp(arg, "--fuse-frontend") == 0) {
+            opts.fuse_frontend = true;
+        } else if (strcmp(arg, "--load-tacky") == 0) {
+            opts.load_tacky = true;
+        } else if (arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '0' + PASS_MAX_LEVEL && arg[3] == '\0') {
+            opts.opt_level = arg[2] - '0';
+        } else if (strcmp(arg, "--pass-stats") == 0) {
+            pass_stats = true;
+        } else if (has_prefix(arg, "--no-") && pass_lookup(arg + strlen("--no-")) != PASS_COUNT) {
+            pass_override[pass_lookup(arg + strlen("--no-"))] = -1;
+        } else if (has_prefix(arg, "--") && pass_lookup(arg + 2) != PASS_COUNT) {
+            pass_override[pass_lookup(arg + 2)] = 1;
         } else if (has_prefix(arg, "--dump-tokens")) {
             opts.dump_tokens = true;
             const char *eq = strchr(arg, '=');
@@ -158,6 +206,7 @@ DriverOptions driver_parse_args(int argc, char **argv) {
                 const char *fmt = eq + 1;
                 if (strcmp(fmt, "txt") == 0) opts.dump_tacky_format = DUMP_TACKY_TXT;
                 else if (strcmp(fmt, "json") == 0) opts.dump_tacky_format = DUMP_TACKY_JSON;
+                else if (strcmp(fmt, "bin") == 0) opts.dump_tacky_format = DUMP_TACKY_BIN;
                 else {
                     fprintf(stderr, "Unknown TACKY dump format: %s\n", fmt);
                     driver_print_usage(argv[0]);
@@ -183,9 +232,40 @@ DriverOptions driver_parse_args(int argc, char **argv) {
         exit(1);
     }
 
+    if ((int)opts.run_exec + (int)opts.interp + (int)opts.jit > 1) {
+        fprintf(stderr, "Error: Multiple run modes provided.\n");
+        driver_print_usage(argv[0]);
+        exit(1);
+    }
+
+    if ((opts.interp || opts.jit) && opts.stage != DRIVER_STAGE_FULL) {
+        fprintf(stderr, "Error: --interp and --jit cannot be combined with a stage flag.\n");
+        driver_print_usage(argv[0]);
+        exit(1);
+    }
+
+    if (opts.fuse_frontend && opts.load_tacky) {
+        fprintf(stderr, "Error: Multiple front ends provided.\n");
+        driver_print_usage(argv[0]);
+        exit(1);
+    }
+
+    if (opts.load_tacky && (opts.stage == DRIVER_STAGE_LEX || opts.stage == DRIVER_STAGE_PARSE ||
+                            opts.stage == DRIVER_STAGE_VALIDATE)) {
+        fprintf(stderr, "Error: --load-tacky input has no source to lex, parse or validate.\n");
+        driver_print_usage(argv[0]);
+        exit(1);
+    }
+
     if (opts.stage != DRIVER_STAGE_FULL) {
         opts.emit_asm = false;
     }
 
+    pass_config_init(&opts.passes, opts.opt_level);
+    for (int id = 0; id < PASS_COUNT; id++) {
+        if (pass_override[id]) opts.passes.enabled[id] = pass_override[id] > 0;
+    }
+    opts.passes.stats = pass_stats;
+
     return opts;
 }
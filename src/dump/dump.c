@@ -1,6 +1,7 @@
 #include "../../include/dump/dump.h"
 #include "../../include/lexer/lexer.h"
 #include "../../include/util/diag.h"
+#include "../../include/tacky/tacky_binary.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,7 +36,7 @@ static char *basename_no_ext(const char *path) {
     size_t len = strlen(base);
     if (len >= 2) {
         const char *dot = strrchr(base, '.');
-        if (dot && strcmp(dot, ".c") == 0) {
+        if (dot && (strcmp(dot, ".c") == 0 || strcmp(dot, ".tacky") == 0)) {
             len = (size_t)(dot - base);
         }
     }
@@ -225,145 +226,19 @@ bool dump_ast_file(ASTNode *ast, const char *input_path, DumpAstFormat fmt, cons
 }
 
 bool dump_tacky_file(TackyProgram *p, const char *input_path, DumpTackyFormat fmt, const char *out_path) {
-    const char *ext = (fmt == DUMP_TACKY_JSON) ? ".tacky.json" : ".tacky.txt";
+    const char *ext = (fmt == DUMP_TACKY_JSON) ? ".tacky.json" : (fmt == DUMP_TACKY_BIN) ? ".tacky" : ".tacky.txt";
     char *path = NULL;
     if (out_path) path = (char *)xstrdup(out_path);
     else path = dump_default_path(input_path, ext);
     if (!path) return false;
-    FILE *f = fopen(path, "w");
+    FILE *f = fopen(path, fmt == DUMP_TACKY_BIN ? "wb" : "w");
     if (!f) { free(path); return false; }
 
-    if (fmt == DUMP_TACKY_JSON) {
-        fprintf(f, "{\n  \"function\": \"%s\",\n  \"body\": [\n", p->fn ? p->fn->name : "");
-        int first = 1;
-        for (TackyInstr *ins = p->fn ? p->fn->body : NULL; ins; ins = ins->next) {
-            if (!first) fprintf(f, ",\n");
-            first = 0;
-            fprintf(f, "    {");
-            if (ins->kind == TACKY_INSTR_UNARY) {
-                const char *op = (ins->un_op == TACKY_UN_NEGATE) ? "Negate" : (ins->un_op == TACKY_UN_COMPLEMENT ? "Complement" : "Not");
-                fprintf(f, "\"kind\": \"Unary\", \"op\": \"%s\", \"src\": ", op);
-                if (ins->un_src.kind == TACKY_VAL_CONSTANT) fprintf(f, "{\"const\": %d}", ins->un_src.constant);
-                else fprintf(f, "{\"var\": \"%s\"}", ins->un_src.var_name);
-                fprintf(f, ", \"dst\": \"%s\"", ins->un_dst);
-            } else if (ins->kind == TACKY_INSTR_BINARY) {
-                const char *op = "?";
-                switch (ins->bin_op) {
-                    case TACKY_BIN_ADD: op = "Add"; break;
-                    case TACKY_BIN_SUB: op = "Subtract"; break;
-                    case TACKY_BIN_MUL: op = "Multiply"; break;
-                    case TACKY_BIN_DIV: op = "Divide"; break;
-                    case TACKY_BIN_REM: op = "Remainder"; break;
-                    case TACKY_BIN_EQUAL: op = "Equal"; break;
-                    case TACKY_BIN_NOT_EQUAL: op = "NotEqual"; break;
-                    case TACKY_BIN_LESS: op = "LessThan"; break;
-                    case TACKY_BIN_LESS_EQUAL: op = "LessOrEqual"; break;
-                    case TACKY_BIN_GREATER: op = "GreaterThan"; break;
-                    case TACKY_BIN_GREATER_EQUAL: op = "GreaterOrEqual"; break;
-                }
-                fprintf(f, "\"kind\": \"Binary\", \"op\": \"%s\", \"src1\": ", op);
-                if (ins->bin_src1.kind == TACKY_VAL_CONSTANT) fprintf(f, "{\"const\": %d}", ins->bin_src1.constant);
-                else fprintf(f, "{\"var\": \"%s\"}", ins->bin_src1.var_name);
-                fprintf(f, ", \"src2\": ");
-                if (ins->bin_src2.kind == TACKY_VAL_CONSTANT) fprintf(f, "{\"const\": %d}", ins->bin_src2.constant);
-                else fprintf(f, "{\"var\": \"%s\"}", ins->bin_src2.var_name);
-                fprintf(f, ", \"dst\": \"%s\"", ins->bin_dst);
-            } else if (ins->kind == TACKY_INSTR_COPY) {
-                fprintf(f, "\"kind\": \"Copy\", \"src\": ");
-                if (ins->copy_src.kind == TACKY_VAL_CONSTANT) fprintf(f, "{\"const\": %d}", ins->copy_src.constant);
-                else fprintf(f, "{\"var\": \"%s\"}", ins->copy_src.var_name);
-                fprintf(f, ", \"dst\": \"%s\"", ins->copy_dst);
-            } else if (ins->kind == TACKY_INSTR_JUMP) {
-                fprintf(f, "\"kind\": \"Jump\", \"target\": \"%s\"", ins->jump_target);
-            } else if (ins->kind == TACKY_INSTR_JUMP_IF_ZERO) {
-                fprintf(f, "\"kind\": \"JumpIfZero\", \"condition\": ");
-                if (ins->cond_val.kind == TACKY_VAL_CONSTANT) fprintf(f, "{\"const\": %d}", ins->cond_val.constant);
-                else fprintf(f, "{\"var\": \"%s\"}", ins->cond_val.var_name);
-                fprintf(f, ", \"target\": \"%s\"", ins->jump_target);
-            } else if (ins->kind == TACKY_INSTR_JUMP_IF_NOT_ZERO) {
-                fprintf(f, "\"kind\": \"JumpIfNotZero\", \"condition\": ");
-                if (ins->cond_val.kind == TACKY_VAL_CONSTANT) fprintf(f, "{\"const\": %d}", ins->cond_val.constant);
-                else fprintf(f, "{\"var\": \"%s\"}", ins->cond_val.var_name);
-                fprintf(f, ", \"target\": \"%s\"", ins->jump_target);
-            } else if (ins->kind == TACKY_INSTR_LABEL) {
-                fprintf(f, "\"kind\": \"Label\", \"name\": \"%s\"", ins->label);
-            } else if (ins->kind == TACKY_INSTR_RETURN) {
-                fprintf(f, "\"kind\": \"Return\", \"value\": ");
-                if (ins->ret_val.kind == TACKY_VAL_CONSTANT) fprintf(f, "{\"const\": %d}", ins->ret_val.constant);
-                else fprintf(f, "{\"var\": \"%s\"}", ins->ret_val.var_name);
-            }
-            fprintf(f, "}");
-        }
-        fprintf(f, "\n  ]\n}\n");
-    } else {
-        fprintf(f, "Function %s()\n", p->fn ? p->fn->name : "");
-        for (TackyInstr *ins = p->fn ? p->fn->body : NULL; ins; ins = ins->next) {
-            switch (ins->kind) {
-                case TACKY_INSTR_UNARY: {
-                    const char *op = (ins->un_op == TACKY_UN_NEGATE) ? "Negate" : (ins->un_op == TACKY_UN_COMPLEMENT ? "Complement" : "Not");
-                    if (ins->un_src.kind == TACKY_VAL_CONSTANT)
-                        fprintf(f, "  %s %d -> %s\n", op, ins->un_src.constant, ins->un_dst);
-                    else
-                        fprintf(f, "  %s %s -> %s\n", op, ins->un_src.var_name, ins->un_dst);
-                    break;
-                }
-                case TACKY_INSTR_BINARY: {
-                    const char *op = "?";
-                    switch (ins->bin_op) {
-                        case TACKY_BIN_ADD: op = "Add"; break;
-                        case TACKY_BIN_SUB: op = "Subtract"; break;
-                        case TACKY_BIN_MUL: op = "Multiply"; break;
-                        case TACKY_BIN_DIV: op = "Divide"; break;
-                        case TACKY_BIN_REM: op = "Remainder"; break;
-                        case TACKY_BIN_EQUAL: op = "Equal"; break;
-                        case TACKY_BIN_NOT_EQUAL: op = "NotEqual"; break;
-                        case TACKY_BIN_LESS: op = "LessThan"; break;
-                        case TACKY_BIN_LESS_EQUAL: op = "LessOrEqual"; break;
-                        case TACKY_BIN_GREATER: op = "GreaterThan"; break;
-                        case TACKY_BIN_GREATER_EQUAL: op = "GreaterOrEqual"; break;
-                    }
-                    fprintf(f, "  %s ", op);
-                    if (ins->bin_src1.kind == TACKY_VAL_CONSTANT) fprintf(f, "%d, ", ins->bin_src1.constant);
-                    else fprintf(f, "%s, ", ins->bin_src1.var_name);
-                    if (ins->bin_src2.kind == TACKY_VAL_CONSTANT) fprintf(f, "%d ", ins->bin_src2.constant);
-                    else fprintf(f, "%s ", ins->bin_src2.var_name);
-                    fprintf(f, "-> %s\n", ins->bin_dst);
-                    break;
-                }
-                case TACKY_INSTR_COPY:
-                    fprintf(f, "  Copy ");
-                    if (ins->copy_src.kind == TACKY_VAL_CONSTANT) fprintf(f, "%d", ins->copy_src.constant);
-                    else fprintf(f, "%s", ins->copy_src.var_name);
-                    fprintf(f, " -> %s\n", ins->copy_dst);
-                    break;
-                case TACKY_INSTR_JUMP:
-                    fprintf(f, "  Jump %s\n", ins->jump_target);
-                    break;
-                case TACKY_INSTR_JUMP_IF_ZERO:
-                    fprintf(f, "  JumpIfZero ");
-                    if (ins->cond_val.kind == TACKY_VAL_CONSTANT) fprintf(f, "%d", ins->cond_val.constant);
-                    else fprintf(f, "%s", ins->cond_val.var_name);
-                    fprintf(f, " -> %s\n", ins->jump_target);
-                    break;
-                case TACKY_INSTR_JUMP_IF_NOT_ZERO:
-                    fprintf(f, "  JumpIfNotZero ");
-                    if (ins->cond_val.kind == TACKY_VAL_CONSTANT) fprintf(f, "%d", ins->cond_val.constant);
-                    else fprintf(f, "%s", ins->cond_val.var_name);
-                    fprintf(f, " -> %s\n", ins->jump_target);
-                    break;
-                case TACKY_INSTR_LABEL:
-                    fprintf(f, "  Label %s\n", ins->label);
-                    break;
-                case TACKY_INSTR_RETURN:
-                    if (ins->ret_val.kind == TACKY_VAL_CONSTANT)
-                        fprintf(f, "  Return %d\n", ins->ret_val.constant);
-                    else
-                        fprintf(f, "  Return %s\n", ins->ret_val.var_name);
-                    break;
-            }
-        }
-    }
-    fclose(f);
+    bool ok = true;
+    if (fmt == DUMP_TACKY_JSON) tacky_print_json(p, f);
+    else if (fmt == DUMP_TACKY_BIN) ok = tacky_write_binary(p, f);
+    else tacky_print_txt(p, f);
+    if (fclose(f) != 0) ok = false;
     free(path);
-    return true;
+    return ok;
 }
@@ -0,0 +1,224 @@
+#include "../../include/interp/interp.h"
+#include "../../include/util/alloc.h"
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Unary and binary opcodes follow the order of TackyUnaryOp and
+// TackyBinaryOp, so lowering one is an addition.
+typedef enum {
+    OP_MOV,
+    OP_NEG, OP_COMPL, OP_NOT,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_REM,
+    OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+    OP_JMP, OP_JZ, OP_JNZ,
+    OP_RET,
+    OP_COUNT
+} Opcode;
+
+// Words taken by an instruction, opcode included; labels and NOPs take none.
+static int instr_size(const TackyInstr *ins) {
+    switch (ins->kind) {
+        case TACKY_INSTR_RETURN: return 2;
+        case TACKY_INSTR_UNARY: return 3;
+        case TACKY_INSTR_BINARY: return 4;
+        case TACKY_INSTR_COPY: return 3;
+        case TACKY_INSTR_JUMP: return 2;
+        case TACKY_INSTR_JUMP_IF_ZERO:
+        case TACKY_INSTR_JUMP_IF_NOT_ZERO: return 3;
+        default: return 0;
+    }
+}
+
+static int const_operands(const TackyInstr *ins) {
+    int n = 0;
+    switch (ins->kind) {
+        case TACKY_INSTR_BINARY:
+            n += ins->src2.kind == TACKY_VAL_CONSTANT;
+            // fall through
+        case TACKY_INSTR_RETURN:
+        case TACKY_INSTR_UNARY:
+        case TACKY_INSTR_COPY:
+        case TACKY_INSTR_JUMP_IF_ZERO:
+        case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+            n += ins->src1.kind == TACKY_VAL_CONSTANT;
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+typedef struct {
+    InterpProgram *prog;
+    int len;
+    int next_const;     // next free constant register
+} Builder;
+
+static void emit(Builder *b, int word) {
+    b->prog->code[b->len++] = word;
+}
+
+static void emit_operand(Builder *b, TackyVal v) {
+    if (v.kind == TACKY_VAL_VAR) {
+        emit(b, v.value);
+        return;
+    }
+    b->prog->init[b->next_const] = v.value;
+    emit(b, b->next_const++);
+}
+
+void interp_compile(InterpProgram *prog, const TackyFunction *fn) {
+    int *label_at = (int *)xmalloc(sizeof(int) * (size_t)fn->label_count);
+    int len = 0, consts = 0;
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (ins->kind == TACKY_INSTR_LABEL) label_at[ins->label] = len;
+        len += instr_size(ins);
+        consts += const_operands(ins);
+    }
+    // A final Ret 0 for control falling off the end, as main does in C.
+    len += 2;
+    consts += 1;
+
+    prog->code_len = len;
+    prog->code = (int *)xmalloc(sizeof(int) * (size_t)len);
+    prog->reg_count = fn->var_count + consts;
+    prog->init = (int *)xmalloc(sizeof(int) * (size_t)prog->reg_count);
+    memset(prog->init, 0, sizeof(int) * (size_t)prog->reg_count);
+
+    Builder b = { prog, 0, fn->var_count };
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        switch (ins->kind) {
+            case TACKY_INSTR_RETURN:
+                emit(&b, OP_RET);
+                emit_operand(&b, ins->src1);
+                break;
+            case TACKY_INSTR_UNARY:
+                emit(&b, OP_NEG + ins->op);
+                emit(&b, ins->dst);
+                emit_operand(&b, ins->src1);
+                break;
+            case TACKY_INSTR_BINARY:
+                emit(&b, OP_ADD + ins->op);
+                emit(&b, ins->dst);
+                emit_operand(&b, ins->src1);
+                emit_operand(&b, ins->src2);
+                break;
+            case TACKY_INSTR_COPY:
+                emit(&b, OP_MOV);
+                emit(&b, ins->dst);
+                emit_operand(&b, ins->src1);
+                break;
+            case TACKY_INSTR_JUMP:
+                emit(&b, OP_JMP);
+                emit(&b, label_at[ins->label]);
+                break;
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                emit(&b, ins->kind == TACKY_INSTR_JUMP_IF_ZERO ? OP_JZ : OP_JNZ);
+                emit_operand(&b, ins->src1);
+                emit(&b, label_at[ins->label]);
+                break;
+            default:
+                break;
+        }
+    }
+    TackyVal zero = { TACKY_VAL_CONSTANT, 0 };
+    emit(&b, OP_RET);
+    emit_operand(&b, zero);
+    free(label_at);
+}
+
+void interp_free(InterpProgram *prog) {
+    free(prog->code);
+    free(prog->init);
+    prog->code = NULL;
+    prog->init = NULL;
+}
+
+// With GCC and Clang each handler jumps straight to the next one through
+// a table of label addresses (threaded dispatch), which gives every
+// handler its own indirect branch to predict; elsewhere a switch.
+#if defined(__GNUC__)
+#define VM_START() DISPATCH();
+#define VM_CASE(op) L_##op:
+#define VM_END()
+#define DISPATCH() goto *dispatch[*pc]
+#else
+#define VM_START() next: switch (*pc) {
+#define VM_CASE(op) case op:
+#define VM_END() default: abort(); }
+#define DISPATCH() goto next
+#endif
+
+#define R(n) regs[pc[n]]
+#define WRAP(a, op, b) ((int)((unsigned)(a) op (unsigned)(b)))
+
+InterpResult interp_run(const InterpProgram *prog) {
+#if defined(__GNUC__)
+    static void *const dispatch[OP_COUNT] = {
+        &&L_OP_MOV, &&L_OP_NEG, &&L_OP_COMPL, &&L_OP_NOT,
+        &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_REM,
+        &&L_OP_EQ, &&L_OP_NE, &&L_OP_LT, &&L_OP_LE, &&L_OP_GT, &&L_OP_GE,
+        &&L_OP_JMP, &&L_OP_JZ, &&L_OP_JNZ, &&L_OP_RET,
+    };
+#endif
+    int *regs = (int *)xmalloc(sizeof(int) * (size_t)prog->reg_count);
+    memcpy(regs, prog->init, sizeof(int) * (size_t)prog->reg_count);
+    const int *code = prog->code;
+    const int *pc = code;
+    InterpResult result;
+
+    VM_START()
+    VM_CASE(OP_MOV) R(1) = R(2); pc += 3; DISPATCH();
+    VM_CASE(OP_NEG) R(1) = WRAP(0, -, R(2)); pc += 3; DISPATCH();
+    VM_CASE(OP_COMPL) R(1) = ~R(2); pc += 3; DISPATCH();
+    VM_CASE(OP_NOT) R(1) = R(2) == 0; pc += 3; DISPATCH();
+    VM_CASE(OP_ADD) R(1) = WRAP(R(2), +, R(3)); pc += 4; DISPATCH();
+    VM_CASE(OP_SUB) R(1) = WRAP(R(2), -, R(3)); pc += 4; DISPATCH();
+    VM_CASE(OP_MUL) R(1) = WRAP(R(2), *, R(3)); pc += 4; DISPATCH();
+    VM_CASE(OP_DIV)
+        if (R(3) == 0 || (R(2) == INT_MIN && R(3) == -1)) goto trap;
+        R(1) = R(2) / R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_REM)
+        if (R(3) == 0 || (R(2) == INT_MIN && R(3) == -1)) goto trap;
+        R(1) = R(2) % R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_EQ) R(1) = R(2) == R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_NE) R(1) = R(2) != R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_LT) R(1) = R(2) < R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_LE) R(1) = R(2) <= R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_GT) R(1) = R(2) > R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_GE) R(1) = R(2) >= R(3); pc += 4; DISPATCH();
+    VM_CASE(OP_JMP) pc = code + pc[1]; DISPATCH();
+    VM_CASE(OP_JZ) pc = R(1) == 0 ? code + pc[2] : pc + 3; DISPATCH();
+    VM_CASE(OP_JNZ) pc = R(1) != 0 ? code + pc[2] : pc + 3; DISPATCH();
+    VM_CASE(OP_RET)
+        // The process sees the low byte of main's return value.
+        result.status = INTERP_EXITED;
+        result.value = R(1) & 0xff;
+        free(regs);
+        return result;
+    VM_END()
+
+trap:
+    result.status = INTERP_TRAPPED;
+    result.value = SIGFPE;
+    free(regs);
+    return result;
+}
+
+int interp_run_and_print_exit(const TackyFunction *fn) {
+    InterpProgram prog;
+    interp_compile(&prog, fn);
+    InterpResult result = interp_run(&prog);
+    interp_free(&prog);
+    if (result.status == INTERP_TRAPPED) {
+        printf("Program terminated by signal %d\n", result.value);
+        return 128 + result.value;
+    }
+    printf("Program exited with code %d\n", result.value);
+    return result.value;
+}
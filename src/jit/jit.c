@@ -0,0 +1,381 @@
+#include "../../include/jit/jit.h"
+#include "../../include/util/alloc.h"
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_HOST_X86_64 1
+#endif
+
+// A rel32 field at code offset at, to be pointed at a label once every
+// label's offset is known. The displacement counts from the end of the
+// field, which ends every jump instruction.
+typedef struct {
+    int at;
+    int label;
+} Fixup;
+
+typedef struct {
+    unsigned char *bytes;
+    int len;
+    int cap;
+    Fixup *fixups;
+    int fixup_count;
+    int fixup_cap;
+    int *label_at;      // code offset of each label
+} Encoder;
+
+static void put8(Encoder *e, unsigned value) {
+    if (e->len == e->cap) {
+        e->cap = e->cap ? e->cap * 2 : 256;
+        e->bytes = (unsigned char *)xrealloc(e->bytes, (size_t)e->cap);
+    }
+    e->bytes[e->len++] = (unsigned char)value;
+}
+
+static void put32(Encoder *e, int value) {
+    unsigned u = (unsigned)value;
+    for (int i = 0; i < 4; i++) put8(e, (u >> (8 * i)) & 0xff);
+}
+
+static void put_fixup(Encoder *e, int label) {
+    if (e->fixup_count == e->fixup_cap) {
+        e->fixup_cap = e->fixup_cap ? e->fixup_cap * 2 : 32;
+        e->fixups = (Fixup *)xrealloc(e->fixups, sizeof(Fixup) * (size_t)e->fixup_cap);
+    }
+    e->fixups[e->fixup_count].at = e->len;
+    e->fixups[e->fixup_count].label = label;
+    e->fixup_count++;
+    put32(e, 0);
+}
+
+// Hardware numbers of the register ids assembly.c uses: eax, ecx, edx,
+// ebp, r10d, r11d.
+static int hw_reg(int id) {
+    static const unsigned char numbers[] = { 0, 1, 2, 5, 10, 11 };
+    return id >= 0 && id < (int)sizeof(numbers) ? numbers[id] : 0;
+}
+
+static bool fits8(int value) {
+    return value >= -128 && value <= 127;
+}
+
+// Emits opcode with a ModRM byte addressing rm, a register or a slot at
+// an offset from %rbp, and reg (a register number or an opcode
+// extension) in the reg field; a REX prefix comes first if either names
+// r8-r15.
+static void op_rm(Encoder *e, const unsigned char *opcode, int opcode_len, int reg, Operand rm) {
+    int rex = 0;
+    if (reg >= 8) rex |= 0x4;
+    if (rm.type == OPERAND_REGISTER && hw_reg(rm.value) >= 8) rex |= 0x1;
+    if (rex) put8(e, 0x40 | rex);
+    for (int i = 0; i < opcode_len; i++) put8(e, opcode[i]);
+    if (rm.type == OPERAND_REGISTER) {
+        put8(e, 0xc0 | (reg & 7) << 3 | (hw_reg(rm.value) & 7));
+    } else if (fits8(rm.value)) {
+        put8(e, 0x45 | (reg & 7) << 3);
+        put8(e, (unsigned)rm.value & 0xff);
+    } else {
+        put8(e, 0x85 | (reg & 7) << 3);
+        put32(e, rm.value);
+    }
+}
+
+static void op1_rm(Encoder *e, unsigned opcode, int reg, Operand rm) {
+    unsigned char op = (unsigned char)opcode;
+    op_rm(e, &op, 1, reg, rm);
+}
+
+static void put_bytes(Encoder *e, const char *bytes, int n) {
+    for (int i = 0; i < n; i++) put8(e, (unsigned char)bytes[i]);
+}
+
+// Low nibble of the Jcc and SETcc opcodes.
+static unsigned cond_nibble(AssemblyCondCode cond) {
+    switch (cond) {
+        case ASM_COND_E: return 0x4;
+        case ASM_COND_NE: return 0x5;
+        case ASM_COND_L: return 0xc;
+        case ASM_COND_LE: return 0xe;
+        case ASM_COND_G: return 0xf;
+        case ASM_COND_GE: return 0xd;
+        default: return 0x4;
+    }
+}
+
+static bool encode_mov(Encoder *e, Operand src, Operand dst) {
+    if (src.type == OPERAND_IMMEDIATE && dst.type == OPERAND_REGISTER) {
+        if (hw_reg(dst.value) >= 8) put8(e, 0x41);
+        put8(e, 0xb8 + (hw_reg(dst.value) & 7));
+        put32(e, src.value);
+    } else if (src.type == OPERAND_IMMEDIATE) {
+        op1_rm(e, 0xc7, 0, dst);
+        put32(e, src.value);
+    } else if (src.type == OPERAND_REGISTER) {
+        op1_rm(e, 0x89, hw_reg(src.value), dst);
+    } else if (dst.type == OPERAND_REGISTER) {
+        op1_rm(e, 0x8b, hw_reg(dst.value), src);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// cmpl src, dst: sets the flags from dst - src.
+static bool encode_cmp(Encoder *e, Operand src, Operand dst) {
+    if (dst.type == OPERAND_IMMEDIATE) return false;
+    if (src.type == OPERAND_IMMEDIATE) {
+        if (fits8(src.value)) {
+            op1_rm(e, 0x83, 7, dst);
+            put8(e, (unsigned)src.value & 0xff);
+        } else {
+            op1_rm(e, 0x81, 7, dst);
+            put32(e, src.value);
+        }
+    } else if (src.type == OPERAND_REGISTER) {
+        op1_rm(e, 0x39, hw_reg(src.value), dst);
+    } else if (dst.type == OPERAND_REGISTER) {
+        op1_rm(e, 0x3b, hw_reg(dst.value), src);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// addl/subl/andl/xorl src, dst: opcode is the r/m, reg form (01, 29, 21,
+// 31); ext selects the operation in the 81 /ext immediate form; mem-to-reg
+// is opcode + 2.
+static bool encode_alu(Encoder *e, unsigned opcode, int ext, Operand src, Operand dst) {
+    if (dst.type == OPERAND_IMMEDIATE) return false;
+    if (src.type == OPERAND_IMMEDIATE) {
+        op1_rm(e, 0x81, ext, dst);
+        put32(e, src.value);
+    } else if (src.type == OPERAND_REGISTER) {
+        op1_rm(e, opcode, hw_reg(src.value), dst);
+    } else if (dst.type == OPERAND_REGISTER) {
+        op1_rm(e, opcode + 2, hw_reg(dst.value), src);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool encode_imul(Encoder *e, Operand src, Operand dst) {
+    if (dst.type != OPERAND_REGISTER) return false;
+    if (src.type == OPERAND_IMMEDIATE) {
+        op1_rm(e, 0x69, hw_reg(dst.value), dst);
+        put32(e, src.value);
+    } else {
+        static const unsigned char op[2] = { 0x0f, 0xaf };
+        op_rm(e, op, 2, hw_reg(dst.value), src);
+    }
+    return true;
+}
+
+// sarl/shrl/shll $count, dst: C1 /ext ib.
+static bool encode_shift(Encoder *e, int ext, Operand count, Operand dst) {
+    if (count.type != OPERAND_IMMEDIATE || dst.type == OPERAND_IMMEDIATE) return false;
+    op1_rm(e, 0xc1, ext, dst);
+    put8(e, (unsigned)count.value & 31);
+    return true;
+}
+
+static bool encode_instr(Encoder *e, const AssemblyInstruction *ins) {
+    switch (ins->type) {
+        case ASM_MOV: return encode_mov(e, ins->src, ins->dst);
+        case ASM_CMP: return encode_cmp(e, ins->src, ins->dst);
+        case ASM_NEG: put_bytes(e, "\xf7\xd8", 2); return true;          // negl %eax
+        case ASM_NOT: put_bytes(e, "\xf7\xd0", 2); return true;          // notl %eax
+        case ASM_ADD_ECX_EAX: put_bytes(e, "\x01\xc8", 2); return true;  // addl %ecx, %eax
+        case ASM_SUB_EAX_ECX: put_bytes(e, "\x29\xc1\x89\xc8", 4); return true; // subl %eax, %ecx; movl %ecx, %eax
+        case ASM_IMUL_ECX_EAX: put_bytes(e, "\x0f\xaf\xc1", 3); return true;    // imull %ecx, %eax
+        case ASM_XCHG_EAX_ECX: put8(e, 0x91); return true;
+        case ASM_CLTD: put8(e, 0x99); return true;
+        case ASM_IDIV_ECX: put_bytes(e, "\xf7\xf9", 2); return true;     // idivl %ecx
+        case ASM_MOV_EDX_EAX: put_bytes(e, "\x89\xd0", 2); return true;  // movl %edx, %eax
+        case ASM_SETCC: {
+            unsigned char op[2] = { 0x0f, (unsigned char)(0x90 | cond_nibble(ins->cond)) };
+            op_rm(e, op, 2, 0, ins->dst);
+            return true;
+        }
+        case ASM_JMP:
+            put8(e, 0xe9);
+            put_fixup(e, ins->label);
+            return true;
+        case ASM_JCC:
+            put8(e, 0x0f);
+            put8(e, 0x80 | cond_nibble(ins->cond));
+            put_fixup(e, ins->label);
+            return true;
+        case ASM_LABEL:
+            e->label_at[ins->label] = e->len;
+            return true;
+        case ASM_RET: put_bytes(e, "\xc9\xc3", 2); return true;          // leave; ret
+        case ASM_ADD: return encode_alu(e, 0x01, 0, ins->src, ins->dst);
+        case ASM_SUB: return encode_alu(e, 0x29, 5, ins->src, ins->dst);
+        case ASM_IMUL: return encode_imul(e, ins->src, ins->dst);
+        case ASM_IMUL_EDX: put_bytes(e, "\xf7\xea", 2); return true;    // imull %edx
+        case ASM_SAR: return encode_shift(e, 7, ins->src, ins->dst);
+        case ASM_SHR: return encode_shift(e, 5, ins->src, ins->dst);
+        case ASM_SHL: return encode_shift(e, 4, ins->src, ins->dst);
+        case ASM_AND: return encode_alu(e, 0x21, 4, ins->src, ins->dst);
+        case ASM_XOR: return encode_alu(e, 0x31, 6, ins->src, ins->dst);
+        case ASM_DIV_ECX: put_bytes(e, "\xf7\xf1", 2); return true;     // divl %ecx
+    }
+    return false;
+}
+
+// Same frame as write_assembly_to_stream: pushq %rbp; movq %rsp, %rbp;
+// subq $stack_size, %rsp. Code that falls off the end returns 0, as
+// interp_compile's final Ret 0 does, instead of running into whatever
+// follows the buffer.
+static bool encode_function(Encoder *e, const AssemblyFunction *fn) {
+    put_bytes(e, "\x55\x48\x89\xe5", 4);
+    if (fn->stack_size > 0) {
+        put_bytes(e, "\x48\x81\xec", 3);
+        put32(e, fn->stack_size);
+    }
+    for (const AssemblyInstruction *ins = fn->instructions; ins; ins = ins->next) {
+        if (!encode_instr(e, ins)) return false;
+    }
+    put_bytes(e, "\xb8\x00\x00\x00\x00\xc9\xc3", 7);    // movl $0, %eax; leave; ret
+    for (int i = 0; i < e->fixup_count; i++) {
+        int at = e->fixups[i].at;
+        int rel = e->label_at[e->fixups[i].label] - (at + 4);
+        for (int b = 0; b < 4; b++) e->bytes[at + b] = ((unsigned)rel >> (8 * b)) & 0xff;
+    }
+    return true;
+}
+
+static size_t page_size(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Maps the code read-write, copies it in and flips the pages to
+// read-execute.
+static bool map_code(JitCode *jit, const unsigned char *bytes, size_t size) {
+    size_t page = page_size();
+    jit->size = size;
+    jit->mapped = (size + page - 1) / page * page;
+#ifdef _WIN32
+    jit->code = (unsigned char *)VirtualAlloc(NULL, jit->mapped, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!jit->code) return false;
+    memcpy(jit->code, bytes, size);
+    DWORD old;
+    if (!VirtualProtect(jit->code, jit->mapped, PAGE_EXECUTE_READ, &old)) return false;
+    FlushInstructionCache(GetCurrentProcess(), jit->code, jit->mapped);
+#else
+    void *p = mmap(NULL, jit->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        jit->code = NULL;
+        return false;
+    }
+    jit->code = (unsigned char *)p;
+    memcpy(jit->code, bytes, size);
+    if (mprotect(jit->code, jit->mapped, PROT_READ | PROT_EXEC) != 0) return false;
+#endif
+    return true;
+}
+
+bool jit_compile(JitCode *jit, const AssemblyProgram *program) {
+    memset(jit, 0, sizeof(*jit));
+#ifndef JIT_HOST_X86_64
+    fprintf(stderr, "Error: --jit needs an x86-64 host.\n");
+    return false;
+#endif
+    if (!program || !program->function) {
+        fprintf(stderr, "Error: No assembly program to run.\n");
+        return false;
+    }
+    int label_count = 0;
+    for (const AssemblyInstruction *ins = program->function->instructions; ins; ins = ins->next) {
+        if (ins->label >= label_count) label_count = ins->label + 1;
+    }
+    Encoder e = {0};
+    e.label_at = (int *)xrealloc(NULL, sizeof(int) * (size_t)label_count);
+    bool ok = encode_function(&e, program->function);
+    if (!ok) {
+        fprintf(stderr, "Error: Instruction has no x86-64 encoding.\n");
+    } else if (!map_code(jit, e.bytes, (size_t)e.len)) {
+        perror("Error: Could not map memory for machine code");
+        jit_free(jit);
+        ok = false;
+    }
+    free(e.bytes);
+    free(e.fixups);
+    free(e.label_at);
+    return ok;
+}
+
+void jit_free(JitCode *jit) {
+    if (!jit->code) return;
+#ifdef _WIN32
+    VirtualFree(jit->code, 0, MEM_RELEASE);
+#else
+    munmap(jit->code, jit->mapped);
+#endif
+    jit->code = NULL;
+}
+
+#ifndef _WIN32
+static sigjmp_buf trap_env;
+
+static void on_trap(int sig) {
+    siglongjmp(trap_env, sig);
+}
+#endif
+
+int jit_call(const JitCode *jit, int *result) {
+    int (*entry)(void) = (int (*)(void))(void *)jit->code;
+#ifdef _WIN32
+    // Integer division faults are structured exceptions here, not
+    // signals; they end the process as they would the executable.
+    *result = entry();
+    return 0;
+#else
+    // idivl faults in the generated code itself; the handler unwinds
+    // its frame and reports the signal instead of dying of it.
+    struct sigaction sa, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_trap;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGFPE, &sa, &old);
+    int sig = sigsetjmp(trap_env, 1);
+    if (sig == 0) *result = entry();
+    sigaction(SIGFPE, &old, NULL);
+    return sig;
+#endif
+}
+
+int jit_run_and_print_exit(const AssemblyProgram *program) {
+    JitCode jit;
+    if (!jit_compile(&jit, program)) return 127;
+    int value = 0;
+    int sig = jit_call(&jit, &value);
+    jit_free(&jit);
+    if (sig) {
+        printf("Program terminated by signal %d\n", sig);
+        return 128 + sig;
+    }
+#ifndef _WIN32
+    value &= 0xff;      // the low byte is all a process exit status keeps
+#endif
+    printf("Program exited with code %d\n", value);
+    return value;
+}
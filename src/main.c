@@ -7,6 +7,10 @@
 #include "../include/assembly/code_emission.h"
 #include "../include/driver/driver.h"
 #include "../include/tacky/tacky.h"
+#include "../include/tacky/tacky_binary.h"
+#include "../include/optimize/pass_manager.h"
+#include "../include/interp/interp.h"
+#include "../include/jit/jit.h"
 
 #ifdef _WIN32
     #include <io.h>
@@ -46,8 +50,69 @@ char *read_file(const char *filename) {
     return buffer;
 }
 
+static void optimize_tacky(TackyProgram *tacky, const DriverOptions *opts) {
+    if (!tacky || !tacky->fn) return;
+    if (!opts->passes.stats) {
+        pass_manager_run(tacky->fn, &opts->passes, NULL);
+        return;
+    }
+    PassStats stats[PASS_COUNT] = {0};
+    pass_manager_run(tacky->fn, &opts->passes, stats);
+    pass_stats_print(stats, stderr);
+}
+
+// Consumes the usage facts gathered by resolve_variables.
+static TackyProgram *lower_to_tacky(ASTNode *ast, const DriverOptions *opts, VarUsageTable *usage) {
+    TackyProgram *tacky = opts->fuse_frontend ? tacky_from_ast_fused(ast) : tacky_from_ast(ast, usage);
+    var_usage_free(usage);
+    optimize_tacky(tacky, opts);
+    return tacky;
+}
+
+// --load-tacky: binary TACKY stands in for everything up to lowering, so
+// the run starts at optimization.
+static int compile_loaded_tacky(const DriverOptions *opts) {
+    TackyProgram *tacky = tacky_load_binary(opts->input_path);
+    if (!tacky) return 1;
+    optimize_tacky(tacky, opts);
+
+    if (opts->stage == DRIVER_STAGE_FULL && opts->interp) {
+        (void)interp_run_and_print_exit(tacky->fn);
+    } else if (opts->stage != DRIVER_STAGE_TACKY) {
+        AssemblyProgram *assembly = generate_assembly(tacky, opts->passes.enabled[PASS_FOLD_RANGES]);
+        if (opts->stage == DRIVER_STAGE_FULL) {
+            if (!opts->quiet) print_assembly(assembly);
+            if (opts->jit) {
+                (void)jit_run_and_print_exit(assembly);
+            } else if (opts->emit_asm) {
+                write_assembly_to_file(assembly, opts->input_path);
+            } else {
+                int rc = emit_executable_via_cc_pipe(assembly, opts->input_path);
+                if (rc == 0 && opts->run_exec) {
+                    char *bin = get_output_binary_path(opts->input_path);
+                    (void)run_executable_and_print_exit(bin);
+                    free(bin);
+                }
+            }
+        }
+        free_assembly(assembly);
+    }
+
+    if (opts->dump_tacky_format != DUMP_TACKY_NONE &&
+        !dump_tacky_file(tacky, opts->input_path, opts->dump_tacky_format, opts->dump_tacky_path)) {
+        fprintf(stderr, "Error: Failed to dump TACKY.\n");
+        tacky_free(tacky);
+        return 1;
+    }
+    tacky_free(tacky);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     DriverOptions opts = driver_parse_args(argc, argv);
+    if (opts.load_tacky) {
+        return compile_loaded_tacky(&opts);
+    }
 
     char *source_code = read_file(opts.input_path);
     if (!source_code) {
@@ -104,11 +169,11 @@ int main(int argc, char *argv[]) {
 
     ASTNode *ast = parse_program(&parser);
 
-    if (opts.stage == DRIVER_STAGE_VALIDATE ||
-        opts.stage == DRIVER_STAGE_TACKY ||
-        opts.stage == DRIVER_STAGE_CODEGEN ||
-        opts.stage == DRIVER_STAGE_FULL) {
-        resolve_variables(ast);
+    VarUsageTable usage = {0};
+    if (opts.stage == DRIVER_STAGE_VALIDATE) {
+        resolve_variables(ast, NULL);
+    } else if (!opts.fuse_frontend) {
+        resolve_variables(ast, &usage);
     }
 
     if (opts.stage == DRIVER_STAGE_VALIDATE) {
@@ -134,7 +199,7 @@ int main(int argc, char *argv[]) {
     }
 
     if (opts.stage == DRIVER_STAGE_TACKY) {
-        TackyProgram *tacky = tacky_from_ast(ast);
+        TackyProgram *tacky = lower_to_tacky(ast, &opts, &usage);
         if (opts.dump_tokens) {
             if (!dump_tokens_file(opts.input_path, source_code, opts.dump_tokens_path)) {
                 fprintf(stderr, "Error: Failed to dump tokens.\n");
@@ -169,8 +234,8 @@ int main(int argc, char *argv[]) {
     }
 
     if (opts.stage == DRIVER_STAGE_CODEGEN) {
-        TackyProgram *tacky = tacky_from_ast(ast);
-        AssemblyProgram *assembly = generate_assembly(tacky);
+        TackyProgram *tacky = lower_to_tacky(ast, &opts, &usage);
+        AssemblyProgram *assembly = generate_assembly(tacky, opts.passes.enabled[PASS_FOLD_RANGES]);
         if (opts.dump_tokens) {
             if (!dump_tokens_file(opts.input_path, source_code, opts.dump_tokens_path)) {
                 fprintf(stderr, "Error: Failed to dump tokens.\n");
@@ -206,13 +271,32 @@ int main(int argc, char *argv[]) {
         print_ast(ast, 0);
     }
 
-    TackyProgram *tacky = tacky_from_ast(ast);
-    AssemblyProgram *assembly = generate_assembly(tacky);
+    TackyProgram *tacky = lower_to_tacky(ast, &opts, &usage);
+    if (opts.interp) {
+        (void)interp_run_and_print_exit(tacky->fn);
+        if (opts.dump_tokens) {
+            (void)dump_tokens_file(opts.input_path, source_code, opts.dump_tokens_path);
+        }
+        if (opts.dump_ast_format != DUMP_AST_NONE) {
+            (void)dump_ast_file(ast, opts.input_path, opts.dump_ast_format, opts.dump_ast_path);
+        }
+        if (opts.dump_tacky_format != DUMP_TACKY_NONE) {
+            (void)dump_tacky_file(tacky, opts.input_path, opts.dump_tacky_format, opts.dump_tacky_path);
+        }
+        free_ast(ast);
+        tacky_free(tacky);
+        free(source_code);
+        return 0;
+    }
+
+    AssemblyProgram *assembly = generate_assembly(tacky, opts.passes.enabled[PASS_FOLD_RANGES]);
     if (!opts.quiet) {
         print_assembly(assembly);
     }
 
-    if (opts.emit_asm) {
+    if (opts.jit) {
+        (void)jit_run_and_print_exit(assembly);
+    } else if (opts.emit_asm) {
         write_assembly_to_file(assembly, opts.input_path);
     } else {
         int rc = emit_executable_via_cc_pipe(assembly, opts.input_path);
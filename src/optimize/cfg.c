@@ -0,0 +1,188 @@
+#include "../../include/optimize/cfg.h"
+#include "../../include/util/alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void *grow(void *ptr, int *capacity, int needed, size_t elem_size) {
+    if (needed <= *capacity) return ptr;
+    int new_cap = *capacity ? *capacity : 16;
+    while (new_cap < needed) new_cap *= 2;
+    void *resized = xrealloc(ptr, (size_t)new_cap * elem_size);
+    *capacity = new_cap;
+    return resized;
+}
+
+static int is_terminator(unsigned char kind) {
+    return kind == TACKY_INSTR_JUMP || kind == TACKY_INSTR_JUMP_IF_ZERO ||
+           kind == TACKY_INSTR_JUMP_IF_NOT_ZERO || kind == TACKY_INSTR_RETURN;
+}
+
+static int start_block(Cfg *cfg, int at) {
+    if (cfg->block_count > 0) cfg->blocks[cfg->block_count - 1].end = at;
+    cfg->blocks = (BasicBlock *)grow(cfg->blocks, &cfg->block_capacity, cfg->block_count + 1, sizeof(BasicBlock));
+    BasicBlock *b = &cfg->blocks[cfg->block_count];
+    memset(b, 0, sizeof(*b));
+    b->start = at;
+    b->rpo_index = -1;
+    return cfg->block_count++;
+}
+
+static void add_succ(BasicBlock *b, int succ) {
+    if (succ < 0) return;
+    if (b->succ_count == 1 && b->succ[0] == succ) return;
+    b->succ[b->succ_count++] = succ;
+}
+
+static void split_blocks(Cfg *cfg) {
+    TackyFunction *fn = cfg->fn;
+    int cur = -1;
+    int cur_has_real = 0;   // the current block holds something besides NOPs
+    int after_terminator = 0;
+
+    for (int i = 0; i < fn->instr_count; i++) {
+        unsigned char kind = fn->body[i].kind;
+        if (kind == TACKY_INSTR_NOP) {
+            if (cur < 0) cur = start_block(cfg, i);
+            continue;
+        }
+        if (cur < 0 || ((after_terminator || kind == TACKY_INSTR_LABEL) && cur_has_real)) {
+            cur = start_block(cfg, i);
+            cur_has_real = 0;
+        }
+        cur_has_real = 1;
+        after_terminator = is_terminator(kind);
+        if (kind == TACKY_INSTR_LABEL) cfg->label_block[fn->body[i].label] = cur;
+    }
+    if (cur < 0) cur = start_block(cfg, 0);
+    cfg->blocks[cur].end = fn->instr_count;
+}
+
+static void link_blocks(Cfg *cfg) {
+    TackyFunction *fn = cfg->fn;
+    int edges = 0;
+    for (int b = 0; b < cfg->block_count; b++) {
+        BasicBlock *blk = &cfg->blocks[b];
+        int next = b + 1 < cfg->block_count ? b + 1 : -1;
+        int last = cfg_last_instr(cfg, b);
+        unsigned char kind = last >= 0 ? fn->body[last].kind : TACKY_INSTR_NOP;
+        switch (kind) {
+            case TACKY_INSTR_RETURN:
+                break;
+            case TACKY_INSTR_JUMP:
+                add_succ(blk, cfg_block_of_label(cfg, fn->body[last].label));
+                break;
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                add_succ(blk, next);
+                add_succ(blk, cfg_block_of_label(cfg, fn->body[last].label));
+                break;
+            default:
+                add_succ(blk, next);
+                break;
+        }
+        for (int s = 0; s < blk->succ_count; s++) cfg->blocks[blk->succ[s]].pred_count++;
+        edges += blk->succ_count;
+    }
+
+    cfg->preds = (int *)grow(cfg->preds, &cfg->pred_capacity, edges > 0 ? edges : 1, sizeof(int));
+    int offset = 0;
+    for (int b = 0; b < cfg->block_count; b++) {
+        cfg->blocks[b].pred_start = offset;
+        offset += cfg->blocks[b].pred_count;
+        cfg->blocks[b].pred_count = 0;
+    }
+    for (int b = 0; b < cfg->block_count; b++) {
+        BasicBlock *blk = &cfg->blocks[b];
+        for (int s = 0; s < blk->succ_count; s++) {
+            BasicBlock *succ = &cfg->blocks[blk->succ[s]];
+            cfg->preds[succ->pred_start + succ->pred_count++] = b;
+        }
+    }
+}
+
+// Iterative depth-first search from the entry; blocks are written to rpo
+// back to front as they finish.
+static void order_blocks(Cfg *cfg) {
+    int n = cfg->block_count;
+    int *stack = cfg->scratch;      // pairs of (block, next successor)
+    int depth = 0;
+    int pos = n;
+
+    for (int b = 0; b < n; b++) cfg->blocks[b].rpo_index = -1;
+    cfg->blocks[0].rpo_index = 0;   // visited; renumbered below
+    stack[0] = 0;
+    stack[1] = 0;
+    depth = 1;
+    while (depth > 0) {
+        int b = stack[2 * (depth - 1)];
+        int *edge = &stack[2 * (depth - 1) + 1];
+        BasicBlock *blk = &cfg->blocks[b];
+        if (*edge < blk->succ_count) {
+            int s = blk->succ[(*edge)++];
+            if (cfg->blocks[s].rpo_index < 0) {
+                cfg->blocks[s].rpo_index = 0;
+                stack[2 * depth] = s;
+                stack[2 * depth + 1] = 0;
+                depth++;
+            }
+        } else {
+            cfg->rpo[--pos] = b;
+            depth--;
+        }
+    }
+
+    cfg->rpo_count = n - pos;
+    if (pos > 0) memmove(cfg->rpo, cfg->rpo + pos, (size_t)cfg->rpo_count * sizeof(int));
+    for (int b = 0; b < n; b++) cfg->blocks[b].rpo_index = -1;
+    for (int i = 0; i < cfg->rpo_count; i++) cfg->blocks[cfg->rpo[i]].rpo_index = i;
+}
+
+void cfg_build(Cfg *cfg, TackyFunction *fn) {
+    cfg->fn = fn;
+    cfg->block_count = 0;
+    cfg->label_block = (int *)grow(cfg->label_block, &cfg->label_capacity, fn->label_count > 0 ? fn->label_count : 1, sizeof(int));
+    for (int i = 0; i < fn->label_count; i++) cfg->label_block[i] = -1;
+
+    split_blocks(cfg);
+    link_blocks(cfg);
+
+    if (cfg->order_capacity < cfg->block_count) {
+        cfg->order_capacity = cfg->block_capacity;
+        cfg->rpo = (int *)xrealloc(cfg->rpo, (size_t)cfg->order_capacity * sizeof(int));
+        cfg->scratch = (int *)xrealloc(cfg->scratch, (size_t)cfg->order_capacity * 2 * sizeof(int));
+    }
+    order_blocks(cfg);
+}
+
+void cfg_free(Cfg *cfg) {
+    free(cfg->blocks);
+    free(cfg->label_block);
+    free(cfg->preds);
+    free(cfg->rpo);
+    free(cfg->scratch);
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+int cfg_block_of_label(const Cfg *cfg, int label) {
+    if (label < 0 || label >= cfg->fn->label_count) return -1;
+    return cfg->label_block[label];
+}
+
+int cfg_block_of_instr(const Cfg *cfg, int instr) {
+    int lo = 0;
+    int hi = cfg->block_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (cfg->blocks[mid].start <= instr) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+int cfg_last_instr(const Cfg *cfg, int block) {
+    const BasicBlock *b = &cfg->blocks[block];
+    for (int i = b->end - 1; i >= b->start; i--) {
+        if (cfg->fn->body[i].kind != TACKY_INSTR_NOP) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,260 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/bitset.h"
+#include "../../include/optimize/cfg.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// A copy dst = src as it was before the pass rewrote anything. Facts are
+// stated in terms of the original source: a substituted operand is only
+// known to be equal at the copy itself, not wherever the copy reaches.
+typedef struct {
+    int dst;
+    TackyVal src;
+} CopyFact;
+
+// Copies are numbered in instruction order. by_dst and by_src list the
+// copies that a definition of a variable kills, in compressed rows indexed
+// by variable.
+typedef struct {
+    TackyFunction *fn;
+    Cfg cfg;
+    CopyFact *copies;
+    int copy_count;
+    int *copy_of;       // instruction index -> copy number, -1 if none
+    int *dst_start;
+    int *dst_list;
+    int *src_start;
+    int *src_list;
+    int words;
+    BitWord *sets;      // in, out, gen and kill of every block
+    int *current;       // while rewriting: copy known to hold for a variable
+    int *stamp;         //   valid when stamp[var] is the current block tag
+    int tag;
+} CopyState;
+
+static BitWord *set_in(CopyState *st, int b) { return st->sets + (size_t)(4 * b) * st->words; }
+static BitWord *set_out(CopyState *st, int b) { return set_in(st, b) + st->words; }
+static BitWord *set_gen(CopyState *st, int b) { return set_in(st, b) + 2 * st->words; }
+static BitWord *set_kill(CopyState *st, int b) { return set_in(st, b) + 3 * st->words; }
+
+static bool is_self_copy(const TackyInstr *ins) {
+    return ins->src1.kind == TACKY_VAL_VAR && ins->src1.value == ins->dst;
+}
+
+static bool same_val(TackyVal a, TackyVal b) {
+    return a.kind == b.kind && a.value == b.value;
+}
+
+// Variable written by the instruction, or -1.
+static int defined_var(const TackyInstr *ins) {
+    switch ((TackyInstrKind)ins->kind) {
+        case TACKY_INSTR_UNARY:
+        case TACKY_INSTR_BINARY:
+        case TACKY_INSTR_COPY:
+            return ins->dst;
+        default:
+            return -1;
+    }
+}
+
+static void build_index(int **start, int **list, const CopyState *st, bool by_src) {
+    int vars = st->fn->var_count;
+    *start = (int *)xcalloc((size_t)vars + 1, sizeof(int));
+    *list = (int *)xcalloc((size_t)st->copy_count, sizeof(int));
+    for (int c = 0; c < st->copy_count; c++) {
+        const CopyFact *f = &st->copies[c];
+        if (by_src && f->src.kind != TACKY_VAL_VAR) continue;
+        (*start)[(by_src ? f->src.value : f->dst) + 1]++;
+    }
+    for (int v = 0; v < vars; v++) (*start)[v + 1] += (*start)[v];
+    int *fill = (int *)xcalloc((size_t)vars, sizeof(int));
+    for (int c = 0; c < st->copy_count; c++) {
+        const CopyFact *f = &st->copies[c];
+        if (by_src && f->src.kind != TACKY_VAL_VAR) continue;
+        int v = by_src ? f->src.value : f->dst;
+        (*list)[(*start)[v] + fill[v]++] = c;
+    }
+    free(fill);
+}
+
+static void collect_copies(CopyState *st) {
+    TackyFunction *fn = st->fn;
+    st->copies = (CopyFact *)xcalloc((size_t)fn->instr_count, sizeof(CopyFact));
+    st->copy_of = (int *)xcalloc((size_t)fn->instr_count, sizeof(int));
+    st->copy_count = 0;
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        st->copy_of[i] = -1;
+        if (ins->kind != TACKY_INSTR_COPY || is_self_copy(ins)) continue;
+        st->copies[st->copy_count].dst = ins->dst;
+        st->copies[st->copy_count].src = ins->src1;
+        st->copy_of[i] = st->copy_count++;
+    }
+    build_index(&st->dst_start, &st->dst_list, st, false);
+    build_index(&st->src_start, &st->src_list, st, true);
+}
+
+// Removes every copy that a write to var invalidates from gen, adding it
+// to kill.
+static void kill_in_sets(const CopyState *st, int var, BitWord *gen, BitWord *kill) {
+    for (int k = st->dst_start[var]; k < st->dst_start[var + 1]; k++) {
+        bitset_clear(gen, st->dst_list[k]);
+        bitset_set(kill, st->dst_list[k]);
+    }
+    for (int k = st->src_start[var]; k < st->src_start[var + 1]; k++) {
+        bitset_clear(gen, st->src_list[k]);
+        bitset_set(kill, st->src_list[k]);
+    }
+}
+
+static void compute_local_sets(CopyState *st) {
+    const TackyFunction *fn = st->fn;
+    for (int b = 0; b < st->cfg.block_count; b++) {
+        const BasicBlock *blk = &st->cfg.blocks[b];
+        BitWord *gen = set_gen(st, b);
+        BitWord *kill = set_kill(st, b);
+        bitset_fill(gen, st->words, false);
+        bitset_fill(kill, st->words, false);
+        bitset_fill(set_out(st, b), st->words, true);
+        for (int i = blk->start; i < blk->end; i++) {
+            const TackyInstr *ins = &fn->body[i];
+            int var = defined_var(ins);
+            if (var < 0 || (ins->kind == TACKY_INSTR_COPY && is_self_copy(ins))) continue;
+            kill_in_sets(st, var, gen, kill);
+            if (st->copy_of[i] >= 0) bitset_set(gen, st->copy_of[i]);
+        }
+    }
+}
+
+// Forward must-analysis: a copy reaches a block if it reaches the end of
+// every reachable predecessor. Nothing reaches the entry.
+static void solve(CopyState *st) {
+    const Cfg *cfg = &st->cfg;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = 0; r < cfg->rpo_count; r++) {
+            int b = cfg->rpo[r];
+            const BasicBlock *blk = &cfg->blocks[b];
+            BitWord *in = set_in(st, b);
+            bitset_fill(in, st->words, b != 0);
+            if (b != 0) {
+                for (int p = 0; p < blk->pred_count; p++) {
+                    int pred = cfg->preds[blk->pred_start + p];
+                    if (cfg->blocks[pred].rpo_index >= 0) bitset_and(in, set_out(st, pred), st->words);
+                }
+            }
+            changed |= bitset_transfer(set_out(st, b), set_gen(st, b), in, set_kill(st, b), st->words);
+        }
+    }
+}
+
+static int reaching_copy(const CopyState *st, int var) {
+    return st->stamp[var] == st->tag ? st->current[var] : -1;
+}
+
+static void kill_current(CopyState *st, int var) {
+    st->stamp[var] = st->tag;
+    st->current[var] = -1;
+    for (int k = st->src_start[var]; k < st->src_start[var + 1]; k++) {
+        int c = st->src_list[k];
+        int dst = st->copies[c].dst;
+        if (reaching_copy(st, dst) == c) st->current[dst] = -1;
+    }
+}
+
+static bool substitute(const CopyState *st, TackyVal *v) {
+    if (v->kind != TACKY_VAL_VAR) return false;
+    int c = reaching_copy(st, v->value);
+    if (c < 0) return false;
+    *v = st->copies[c].src;
+    return true;
+}
+
+// Rewrites one block given the copies reaching its start. Returns true if
+// it changed anything; sets *removed when it deleted an instruction.
+static bool rewrite_block(CopyState *st, int b, bool *removed) {
+    TackyFunction *fn = st->fn;
+    const BasicBlock *blk = &st->cfg.blocks[b];
+    const BitWord *in = set_in(st, b);
+    bool changed = false;
+
+    st->tag++;
+    for (int w = 0; w < st->words; w++) {
+        for (BitWord bits = in[w]; bits; bits &= bits - 1) {
+            int c = w * 64 + __builtin_ctzll(bits);
+            st->stamp[st->copies[c].dst] = st->tag;
+            st->current[st->copies[c].dst] = c;
+        }
+    }
+
+    for (int i = blk->start; i < blk->end; i++) {
+        TackyInstr *ins = &fn->body[i];
+        switch ((TackyInstrKind)ins->kind) {
+            case TACKY_INSTR_COPY: {
+                changed |= substitute(st, &ins->src1);
+                int held = reaching_copy(st, ins->dst);
+                if (is_self_copy(ins) || (held >= 0 && same_val(st->copies[held].src, ins->src1))) {
+                    ins->kind = TACKY_INSTR_NOP;
+                    *removed = changed = true;
+                    break;
+                }
+                kill_current(st, ins->dst);
+                if (st->copy_of[i] >= 0) st->current[ins->dst] = st->copy_of[i];
+                break;
+            }
+            case TACKY_INSTR_BINARY:
+                changed |= substitute(st, &ins->src2);
+                // fall through
+            case TACKY_INSTR_UNARY:
+                changed |= substitute(st, &ins->src1);
+                kill_current(st, ins->dst);
+                break;
+            case TACKY_INSTR_RETURN:
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                changed |= substitute(st, &ins->src1);
+                break;
+            case TACKY_INSTR_JUMP:
+            case TACKY_INSTR_LABEL:
+            case TACKY_INSTR_NOP:
+                break;
+        }
+    }
+    return changed;
+}
+
+bool propagate_copies(TackyFunction *fn) {
+    if (fn->instr_count == 0) return false;
+    CopyState st = {0};
+    st.fn = fn;
+    cfg_build(&st.cfg, fn);
+    collect_copies(&st);
+    st.words = bitset_words(st.copy_count);
+    st.sets = (BitWord *)xcalloc((size_t)st.cfg.block_count * 4 * (st.words ? st.words : 1), sizeof(BitWord));
+    st.current = (int *)xcalloc((size_t)fn->var_count, sizeof(int));
+    st.stamp = (int *)xcalloc((size_t)fn->var_count, sizeof(int));
+
+    compute_local_sets(&st);
+    solve(&st);
+
+    bool changed = false;
+    bool removed = false;
+    for (int r = 0; r < st.cfg.rpo_count; r++) {
+        changed |= rewrite_block(&st, st.cfg.rpo[r], &removed);
+    }
+    if (removed) tacky_compact(fn);
+
+    cfg_free(&st.cfg);
+    free(st.copies);
+    free(st.copy_of);
+    free(st.dst_start);
+    free(st.dst_list);
+    free(st.src_start);
+    free(st.src_list);
+    free(st.sets);
+    free(st.current);
+    free(st.stamp);
+    return changed;
+}
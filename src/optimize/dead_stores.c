@@ -0,0 +1,38 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+bool eliminate_dead_stores(TackyFunction *fn) {
+    if (fn->instr_count == 0) return false;
+    Cfg cfg = {0};
+    Liveness lv = {0};
+    cfg_build(&cfg, fn);
+    liveness_compute(&lv, &cfg);
+
+    BitWord *live = (BitWord *)xmalloc((size_t)lv.words * sizeof(BitWord));
+
+    bool changed = false;
+    for (int r = 0; r < cfg.rpo_count; r++) {
+        int b = cfg.rpo[r];
+        const BasicBlock *blk = &cfg.blocks[b];
+        bitset_copy(live, liveness_out(&lv, b), lv.words);
+        for (int i = blk->end - 1; i >= blk->start; i--) {
+            TackyInstr *ins = &fn->body[i];
+            int def = tacky_instr_def(ins);
+            if (def >= 0 && !bitset_test(live, def) && !tacky_may_trap(ins)) {
+                ins->kind = TACKY_INSTR_NOP;
+                changed = true;
+                continue;
+            }
+            liveness_step(live, ins);
+        }
+    }
+    if (changed) tacky_compact(fn);
+
+    free(live);
+    liveness_free(&lv);
+    cfg_free(&cfg);
+    return changed;
+}
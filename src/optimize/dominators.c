@@ -0,0 +1,141 @@
+#include "../../include/optimize/dominators.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int *alloc_ints(size_t count) {
+    return (int *)xmalloc(count * sizeof(int));
+}
+
+static int intersect(const Cfg *cfg, const int *idom, int a, int b) {
+    while (a != b) {
+        while (cfg->blocks[a].rpo_index > cfg->blocks[b].rpo_index) a = idom[a];
+        while (cfg->blocks[b].rpo_index > cfg->blocks[a].rpo_index) b = idom[b];
+    }
+    return a;
+}
+
+static void compute_idom(DomTree *dt, const Cfg *cfg) {
+    int *idom = dt->idom;
+    for (int b = 0; b < cfg->block_count; b++) idom[b] = -1;
+    int entry = cfg->rpo[0];
+    idom[entry] = entry;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = 1; r < cfg->rpo_count; r++) {
+            int b = cfg->rpo[r];
+            const BasicBlock *blk = &cfg->blocks[b];
+            int new_idom = -1;
+            for (int p = 0; p < blk->pred_count; p++) {
+                int pred = cfg->preds[blk->pred_start + p];
+                if (idom[pred] < 0) continue;
+                new_idom = new_idom < 0 ? pred : intersect(cfg, idom, pred, new_idom);
+            }
+            if (new_idom != idom[b]) {
+                idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+// Children are listed in reverse postorder of the CFG.
+static void build_tree(DomTree *dt, const Cfg *cfg) {
+    int n = cfg->block_count;
+    memset(dt->child_start, 0, (size_t)(n + 1) * sizeof(int));
+    for (int r = 1; r < cfg->rpo_count; r++) dt->child_start[dt->idom[cfg->rpo[r]] + 1]++;
+    for (int b = 0; b < n; b++) dt->child_start[b + 1] += dt->child_start[b];
+    int *fill = alloc_ints((size_t)n);
+    memcpy(fill, dt->child_start, (size_t)n * sizeof(int));
+    for (int r = 1; r < cfg->rpo_count; r++) {
+        int b = cfg->rpo[r];
+        dt->children[fill[dt->idom[b]]++] = b;
+    }
+
+    // Iterative DFS numbering; fill doubles as each block's next child.
+    int *stack = alloc_ints((size_t)n);
+    int depth = 0, pre = 0, post = 0;
+    for (int b = 0; b < n; b++) dt->pre[b] = dt->post[b] = -1;
+    memcpy(fill, dt->child_start, (size_t)n * sizeof(int));
+    stack[depth++] = cfg->rpo[0];
+    dt->pre[cfg->rpo[0]] = pre++;
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        if (fill[b] < dt->child_start[b + 1]) {
+            int c = dt->children[fill[b]++];
+            dt->pre[c] = pre++;
+            stack[depth++] = c;
+        } else {
+            dt->post[b] = post++;
+            depth--;
+        }
+    }
+    free(stack);
+    free(fill);
+}
+
+// A join block b is in the frontier of every block on the dominator-tree
+// path from each predecessor up to, but excluding, idom(b). Runs twice:
+// once to count, once to fill. last[] drops repeats of the same b.
+static void walk_frontiers(DomTree *dt, const Cfg *cfg, int *last, bool fill) {
+    int *pos = fill ? alloc_ints((size_t)cfg->block_count) : NULL;
+    if (fill) memcpy(pos, dt->df_start, (size_t)cfg->block_count * sizeof(int));
+    for (int b = 0; b < cfg->block_count; b++) last[b] = -1;
+    for (int r = 0; r < cfg->rpo_count; r++) {
+        int b = cfg->rpo[r];
+        const BasicBlock *blk = &cfg->blocks[b];
+        if (blk->pred_count < 2) continue;
+        for (int p = 0; p < blk->pred_count; p++) {
+            int runner = cfg->preds[blk->pred_start + p];
+            if (dt->idom[runner] < 0) continue;
+            while (runner != dt->idom[b] && last[runner] != b) {
+                last[runner] = b;
+                if (fill) dt->frontier[pos[runner]++] = b;
+                else dt->df_start[runner + 1]++;
+                if (runner == dt->idom[runner]) break;
+                runner = dt->idom[runner];
+            }
+        }
+    }
+    free(pos);
+}
+
+static void compute_frontiers(DomTree *dt, const Cfg *cfg) {
+    int n = cfg->block_count;
+    int *last = alloc_ints((size_t)n);
+    memset(dt->df_start, 0, (size_t)(n + 1) * sizeof(int));
+    walk_frontiers(dt, cfg, last, false);
+    for (int b = 0; b < n; b++) dt->df_start[b + 1] += dt->df_start[b];
+    dt->frontier = alloc_ints((size_t)dt->df_start[n]);
+    walk_frontiers(dt, cfg, last, true);
+    free(last);
+}
+
+void dom_compute(DomTree *dt, const Cfg *cfg) {
+    dom_free(dt);
+    size_t n = (size_t)cfg->block_count;
+    dt->block_count = cfg->block_count;
+    dt->idom = alloc_ints(n);
+    dt->child_start = alloc_ints(n + 1);
+    dt->children = alloc_ints(n);
+    dt->pre = alloc_ints(n);
+    dt->post = alloc_ints(n);
+    dt->df_start = alloc_ints(n + 1);
+    compute_idom(dt, cfg);
+    build_tree(dt, cfg);
+    compute_frontiers(dt, cfg);
+}
+
+void dom_free(DomTree *dt) {
+    free(dt->idom);
+    free(dt->child_start);
+    free(dt->children);
+    free(dt->pre);
+    free(dt->post);
+    free(dt->df_start);
+    free(dt->frontier);
+    memset(dt, 0, sizeof(*dt));
+}
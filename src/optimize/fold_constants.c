@@ -0,0 +1,284 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/util/alloc.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Facts about a variable hold only inside the block that recorded them:
+// they are valid while stamp[var] equals the current block number.
+typedef struct {
+    TackyFunction *fn;
+    int block;
+    int *stamp;
+    int *def_at;            // index of the variable's last definition
+    unsigned char *known;   // the last definition stored a constant
+    int *value;
+} FoldState;
+
+bool tacky_is_relational(TackyBinaryOp op) {
+    switch (op) {
+        case TACKY_BIN_EQUAL:
+        case TACKY_BIN_NOT_EQUAL:
+        case TACKY_BIN_LESS:
+        case TACKY_BIN_LESS_EQUAL:
+        case TACKY_BIN_GREATER:
+        case TACKY_BIN_GREATER_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool tacky_eval_unary(TackyUnaryOp op, int src, int *out) {
+    switch (op) {
+        case TACKY_UN_NEGATE: *out = (int)(0u - (unsigned)src); return true;
+        case TACKY_UN_COMPLEMENT: *out = ~src; return true;
+        case TACKY_UN_NOT: *out = src == 0; return true;
+        default: return false;
+    }
+}
+
+bool tacky_eval_binary(TackyBinaryOp op, int a, int b, int *out) {
+    switch (op) {
+        case TACKY_BIN_ADD: *out = (int)((unsigned)a + (unsigned)b); return true;
+        case TACKY_BIN_SUB: *out = (int)((unsigned)a - (unsigned)b); return true;
+        case TACKY_BIN_MUL: *out = (int)((unsigned)a * (unsigned)b); return true;
+        case TACKY_BIN_DIV:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            *out = a / b;
+            return true;
+        case TACKY_BIN_REM:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            *out = a % b;
+            return true;
+        case TACKY_BIN_EQUAL: *out = a == b; return true;
+        case TACKY_BIN_NOT_EQUAL: *out = a != b; return true;
+        case TACKY_BIN_LESS: *out = a < b; return true;
+        case TACKY_BIN_LESS_EQUAL: *out = a <= b; return true;
+        case TACKY_BIN_GREATER: *out = a > b; return true;
+        case TACKY_BIN_GREATER_EQUAL: *out = a >= b; return true;
+        default: return false;
+    }
+}
+
+// Division and remainder trap on a zero divisor and on INT_MIN / -1, so
+// they can only be dropped or moved when the operands rule both out.
+bool tacky_may_trap(const TackyInstr *ins) {
+    if (ins->kind != TACKY_INSTR_BINARY) return false;
+    if (ins->op != TACKY_BIN_DIV && ins->op != TACKY_BIN_REM) return false;
+    if (ins->src2.kind != TACKY_VAL_CONSTANT || ins->src2.value == 0) return true;
+    if (ins->src2.value != -1) return false;
+    return ins->src1.kind != TACKY_VAL_CONSTANT || ins->src1.value == INT_MIN;
+}
+
+TackyVal tacky_constant(int v) {
+    TackyVal t; t.kind = TACKY_VAL_CONSTANT; t.value = v; return t;
+}
+
+void tacky_make_copy(TackyInstr *ins, TackyVal src) {
+    ins->kind = TACKY_INSTR_COPY;
+    ins->op = 0;
+    ins->src1 = src;
+    ins->src2 = tacky_constant(0);
+}
+
+static TackyBinaryOp invert_relational(TackyBinaryOp op) {
+    switch (op) {
+        case TACKY_BIN_EQUAL: return TACKY_BIN_NOT_EQUAL;
+        case TACKY_BIN_NOT_EQUAL: return TACKY_BIN_EQUAL;
+        case TACKY_BIN_LESS: return TACKY_BIN_GREATER_EQUAL;
+        case TACKY_BIN_LESS_EQUAL: return TACKY_BIN_GREATER;
+        case TACKY_BIN_GREATER: return TACKY_BIN_LESS_EQUAL;
+        case TACKY_BIN_GREATER_EQUAL: return TACKY_BIN_LESS;
+        default: return op;
+    }
+}
+
+static bool is_const(TackyVal v, int c) {
+    return v.kind == TACKY_VAL_CONSTANT && v.value == c;
+}
+
+static bool same_var(TackyVal a, TackyVal b) {
+    return a.kind == TACKY_VAL_VAR && b.kind == TACKY_VAL_VAR && a.value == b.value;
+}
+
+static bool has_fact(const FoldState *st, int var) {
+    return st->stamp[var] == st->block;
+}
+
+static bool substitute(FoldState *st, TackyVal *v) {
+    if (v->kind != TACKY_VAL_VAR || !has_fact(st, v->value) || !st->known[v->value]) return false;
+    *v = tacky_constant(st->value[v->value]);
+    return true;
+}
+
+// The instruction that defined var earlier in this block, if no operand of
+// it has been redefined since.
+static const TackyInstr *local_def(const FoldState *st, TackyVal v) {
+    if (v.kind != TACKY_VAL_VAR || !has_fact(st, v.value)) return NULL;
+    int at = st->def_at[v.value];
+    const TackyInstr *def = &st->fn->body[at];
+    const TackyVal *ops[2] = { &def->src1, &def->src2 };
+    for (int k = 0; k < 2; k++) {
+        const TackyVal *op = ops[k];
+        if (op->kind == TACKY_VAL_VAR && has_fact(st, op->value) && st->def_at[op->value] > at) return NULL;
+    }
+    return def;
+}
+
+static void record_def(FoldState *st, const TackyInstr *ins, int at) {
+    int var = ins->dst;
+    st->stamp[var] = st->block;
+    st->def_at[var] = at;
+    st->known[var] = ins->kind == TACKY_INSTR_COPY && ins->src1.kind == TACKY_VAL_CONSTANT;
+    st->value[var] = ins->src1.value;
+}
+
+// Rewrites a binary instruction whose operands are not both constant using
+// algebraic identities. Returns true if it did.
+static bool simplify_binary(TackyInstr *ins) {
+    TackyVal a = ins->src1, b = ins->src2;
+    switch ((TackyBinaryOp)ins->op) {
+        case TACKY_BIN_ADD:
+            if (is_const(b, 0)) { tacky_make_copy(ins, a); return true; }
+            if (is_const(a, 0)) { tacky_make_copy(ins, b); return true; }
+            return false;
+        case TACKY_BIN_SUB:
+            if (is_const(b, 0)) { tacky_make_copy(ins, a); return true; }
+            if (same_var(a, b)) { tacky_make_copy(ins, tacky_constant(0)); return true; }
+            return false;
+        case TACKY_BIN_MUL:
+            if (is_const(b, 1)) { tacky_make_copy(ins, a); return true; }
+            if (is_const(a, 1)) { tacky_make_copy(ins, b); return true; }
+            if (is_const(a, 0) || is_const(b, 0)) { tacky_make_copy(ins, tacky_constant(0)); return true; }
+            return false;
+        case TACKY_BIN_DIV:
+            if (is_const(b, 1)) { tacky_make_copy(ins, a); return true; }
+            return false;
+        case TACKY_BIN_REM:
+            if (is_const(b, 1)) { tacky_make_copy(ins, tacky_constant(0)); return true; }
+            return false;
+        case TACKY_BIN_EQUAL:
+        case TACKY_BIN_LESS_EQUAL:
+        case TACKY_BIN_GREATER_EQUAL:
+            if (same_var(a, b)) { tacky_make_copy(ins, tacky_constant(1)); return true; }
+            return false;
+        case TACKY_BIN_NOT_EQUAL:
+        case TACKY_BIN_LESS:
+        case TACKY_BIN_GREATER:
+            if (same_var(a, b)) { tacky_make_copy(ins, tacky_constant(0)); return true; }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// !cmp becomes the inverted comparison, which also turns !!cmp back into
+// cmp once the inner Not has been rewritten.
+static bool simplify_not(FoldState *st, TackyInstr *ins) {
+    const TackyInstr *def = local_def(st, ins->src1);
+    if (!def || def->kind != TACKY_INSTR_BINARY || !tacky_is_relational((TackyBinaryOp)def->op)) return false;
+    TackyVal a = def->src1, b = def->src2;
+    ins->kind = TACKY_INSTR_BINARY;
+    ins->op = (unsigned char)invert_relational((TackyBinaryOp)def->op);
+    ins->src1 = a;
+    ins->src2 = b;
+    return true;
+}
+
+static int next_real(const TackyFunction *fn, int i) {
+    for (i++; i < fn->instr_count; i++) {
+        if (fn->body[i].kind != TACKY_INSTR_NOP) return i;
+    }
+    return -1;
+}
+
+static bool jumps_to_next(const TackyFunction *fn, int i) {
+    int next = next_real(fn, i);
+    return next >= 0 && fn->body[next].kind == TACKY_INSTR_LABEL && fn->body[next].label == fn->body[i].label;
+}
+
+bool fold_constants(TackyFunction *fn) {
+    if (fn->var_count == 0 && fn->instr_count == 0) return false;
+    FoldState st;
+    st.fn = fn;
+    st.block = 1;
+    size_t n = (size_t)fn->var_count + 1;
+    st.stamp = (int *)xcalloc(n, sizeof(int));
+    st.def_at = (int *)xmalloc(n * sizeof(int));
+    st.known = (unsigned char *)xmalloc(n);
+    st.value = (int *)xmalloc(n * sizeof(int));
+
+    bool changed = false;
+    bool removed = false;
+    for (int i = 0; i < fn->instr_count; i++) {
+        TackyInstr *ins = &fn->body[i];
+        int result;
+        switch ((TackyInstrKind)ins->kind) {
+            case TACKY_INSTR_LABEL:
+                st.block++;
+                break;
+            case TACKY_INSTR_UNARY:
+                changed |= substitute(&st, &ins->src1);
+                if (ins->src1.kind == TACKY_VAL_CONSTANT &&
+                    tacky_eval_unary((TackyUnaryOp)ins->op, ins->src1.value, &result)) {
+                    tacky_make_copy(ins, tacky_constant(result));
+                    changed = true;
+                } else if (ins->op == TACKY_UN_NOT && simplify_not(&st, ins)) {
+                    changed = true;
+                }
+                record_def(&st, ins, i);
+                break;
+            case TACKY_INSTR_BINARY:
+                changed |= substitute(&st, &ins->src1);
+                changed |= substitute(&st, &ins->src2);
+                if (ins->src1.kind == TACKY_VAL_CONSTANT && ins->src2.kind == TACKY_VAL_CONSTANT) {
+                    if (tacky_eval_binary((TackyBinaryOp)ins->op, ins->src1.value, ins->src2.value, &result)) {
+                        tacky_make_copy(ins, tacky_constant(result));
+                        changed = true;
+                    }
+                } else if (simplify_binary(ins)) {
+                    changed = true;
+                }
+                record_def(&st, ins, i);
+                break;
+            case TACKY_INSTR_COPY:
+                changed |= substitute(&st, &ins->src1);
+                record_def(&st, ins, i);
+                break;
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                changed |= substitute(&st, &ins->src1);
+                if (ins->src1.kind == TACKY_VAL_CONSTANT) {
+                    bool taken = (ins->src1.value == 0) == (ins->kind == TACKY_INSTR_JUMP_IF_ZERO);
+                    ins->kind = taken ? TACKY_INSTR_JUMP : TACKY_INSTR_NOP;
+                    ins->src1 = tacky_constant(0);
+                    changed = true;
+                }
+                if (ins->kind != TACKY_INSTR_NOP && jumps_to_next(fn, i)) ins->kind = TACKY_INSTR_NOP;
+                if (ins->kind == TACKY_INSTR_NOP) removed = changed = true;
+                st.block++;
+                break;
+            case TACKY_INSTR_JUMP:
+                if (jumps_to_next(fn, i)) {
+                    ins->kind = TACKY_INSTR_NOP;
+                    removed = changed = true;
+                }
+                st.block++;
+                break;
+            case TACKY_INSTR_RETURN:
+                changed |= substitute(&st, &ins->src1);
+                st.block++;
+                break;
+            case TACKY_INSTR_NOP:
+                break;
+        }
+    }
+
+    if (removed) tacky_compact(fn);
+    free(st.stamp);
+    free(st.def_at);
+    free(st.known);
+    free(st.value);
+    return changed;
+}
@@ -0,0 +1,260 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/optimize/loops.h"
+#include "../../include/util/alloc.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    TackyFunction *fn;
+    Cfg cfg;
+    DomTree dom;
+    LoopForest loops;
+    Liveness live;
+    TackyInsertions inserts;
+    int *def_count;     // definitions of each variable inside the loop
+    int *def_at;        // index of the last of them
+    int var_capacity;   // entries in the two arrays above
+    int *family;        // scratch: the multiplications being replaced
+} Induction;
+
+static bool is_var(TackyVal v, int var) {
+    return v.kind == TACKY_VAL_VAR && v.value == var;
+}
+
+static bool is_invariant(const Induction *iv, TackyVal v) {
+    return v.kind == TACKY_VAL_CONSTANT || iv->def_count[v.value] == 0;
+}
+
+// Multiplication of a basic induction variable by a loop-invariant value,
+// other than the trivial constants 0 and 1.
+static bool scaled_iv(const Induction *iv, const TackyInstr *ins, InductionVar *base, TackyVal *scale) {
+    if (ins->kind != TACKY_INSTR_BINARY || ins->op != TACKY_BIN_MUL) return false;
+    for (int side = 0; side < 2; side++) {
+        TackyVal v = side ? ins->src2 : ins->src1;
+        TackyVal k = side ? ins->src1 : ins->src2;
+        if (v.kind != TACKY_VAL_VAR || !is_invariant(iv, k)) continue;
+        if (k.kind == TACKY_VAL_CONSTANT && (k.value == 0 || k.value == 1)) continue;
+        if (!loop_induction_var(&iv->cfg, iv->def_count, iv->def_at, v.value, base)) continue;
+        *scale = k;
+        return true;
+    }
+    return false;
+}
+
+static bool same_val(TackyVal a, TackyVal b) {
+    return a.kind == b.kind && a.value == b.value;
+}
+
+static bool fits_int(long long v) {
+    return v >= INT_MIN && v <= INT_MAX;
+}
+
+// Linear function test replacement. The header's exit test i < n (or
+// i <= n) on a constant n becomes j < n * k, with j = i * k, when no value
+// i takes in the loop makes i * k, n * k or i + step overflow. That holds
+// if i starts at a constant, counts up by step once per iteration and the
+// test leaves the loop as soon as it fails.
+static bool replace_exit_test(Induction *iv, int loop, const InductionVar *base, int scale, int *at_test) {
+    const TackyFunction *fn = iv->fn;
+    const Loop *l = &iv->loops.loops[loop];
+    const BasicBlock *hb = &iv->cfg.blocks[l->header];
+    int init;
+    if (base->step <= 0 || !loop_runs_once(&iv->cfg, &iv->loops, loop, base->update)) return false;
+    if (!loop_entry_constant(&iv->cfg, &iv->loops, loop, base->var, &init)) return false;
+    int exit = cfg_last_instr(&iv->cfg, l->header);
+    if (exit < 0 || fn->body[exit].kind != TACKY_INSTR_JUMP_IF_ZERO || fn->body[exit].src1.kind != TACKY_VAL_VAR) {
+        return false;
+    }
+    if (loop_contains(&iv->loops, loop, cfg_block_of_label(&iv->cfg, fn->body[exit].label))) return false;
+    int cond = fn->body[exit].src1.value;
+    for (int i = hb->start; i < exit; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (ins->kind != TACKY_INSTR_BINARY || ins->dst != cond) continue;
+        if (ins->op != TACKY_BIN_LESS && ins->op != TACKY_BIN_LESS_EQUAL) continue;
+        if (!is_var(ins->src1, base->var) || ins->src2.kind != TACKY_VAL_CONSTANT) continue;
+        if (iv->def_count[cond] != 1 || iv->def_at[cond] != i) return false;
+        long long n = ins->src2.value;
+        long long last = ins->op == TACKY_BIN_LESS ? n - 1 : n;
+        long long hi = (init > last ? init : last) + base->step;
+        if (hi > INT_MAX) return false;
+        if (!fits_int((long long)init * scale) || !fits_int(hi * scale) || !fits_int(n * scale)) return false;
+        *at_test = i;
+        return true;
+    }
+    return false;
+}
+
+static bool in_family(const Induction *iv, const TackyInstr *ins, const InductionVar *base, TackyVal scale) {
+    InductionVar other;
+    TackyVal k;
+    return scaled_iv(iv, ins, &other, &k) && other.var == base->var && same_val(k, scale);
+}
+
+// Apart from the exit test and the multiplications being replaced, the
+// variable is read in the loop only to step itself and nowhere after it,
+// so once its multiples are maintained directly it can go.
+static bool only_steps_itself(const Induction *iv, int loop, const InductionVar *base, TackyVal scale, int test) {
+    const TackyFunction *fn = iv->fn;
+    const Loop *l = &iv->loops.loops[loop];
+    int t = fn->body[base->add].dst;
+    for (int k = 0; k < l->block_count; k++) {
+        int b = iv->loops.blocks[l->block_start + k];
+        const BasicBlock *blk = &iv->cfg.blocks[b];
+        for (int s = 0; s < blk->succ_count; s++) {
+            if (loop_contains(&iv->loops, loop, blk->succ[s])) continue;
+            const BitWord *live = liveness_in(&iv->live, blk->succ[s]);
+            if (bitset_test(live, base->var) || bitset_test(live, t)) return false;
+        }
+        for (int i = blk->start; i < blk->end; i++) {
+            if (i == test || i == base->add || in_family(iv, &fn->body[i], base, scale)) continue;
+            int uses[2];
+            int n = tacky_instr_uses(&fn->body[i], uses);
+            for (int u = 0; u < n; u++) {
+                if (uses[u] == base->var) return false;
+                if (uses[u] == t && i != base->update) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Replaces every i * k of one loop by a new variable j = i * k, set in the
+// preheader and stepped by step * k right where i steps. The new code is
+// queued, so every index stays valid. Returns false, changing nothing, if
+// the loop has no preheader.
+static bool reduce(Induction *iv, int loop, const InductionVar *base, TackyVal scale) {
+    TackyFunction *fn = iv->fn;
+    const Loop *l = &iv->loops.loops[loop];
+    int test = -1;
+    bool lftr = scale.kind == TACKY_VAL_CONSTANT && replace_exit_test(iv, loop, base, scale.value, &test);
+    bool drop_base = lftr && only_steps_itself(iv, loop, base, scale, test);
+    int count = scale.kind == TACKY_VAL_VAR ? 2 : 1;
+    int members = 0;
+    for (int k = 0; k < l->block_count; k++) {
+        const BasicBlock *blk = &iv->cfg.blocks[iv->loops.blocks[l->block_start + k]];
+        for (int i = blk->start; i < blk->end; i++) {
+            if (in_family(iv, &fn->body[i], base, scale)) iv->family[members++] = i;
+        }
+    }
+
+    TackyInstr *pre = loop_queue_preheader(fn, &iv->inserts, &iv->cfg, &iv->loops, loop, count);
+    if (!pre) return false;
+    int j = tacky_new_temp(fn);
+    int step_var = count == 2 ? tacky_new_temp(fn) : -1;
+    pre[0].kind = TACKY_INSTR_BINARY;
+    pre[0].op = TACKY_BIN_MUL;
+    pre[0].src1.kind = TACKY_VAL_VAR;
+    pre[0].src1.value = base->var;
+    pre[0].src2 = scale;
+    pre[0].dst = j;
+    if (step_var >= 0) {
+        pre[1].kind = TACKY_INSTR_BINARY;
+        pre[1].op = TACKY_BIN_MUL;
+        pre[1].src1 = scale;
+        pre[1].src2.kind = TACKY_VAL_CONSTANT;
+        pre[1].src2.value = base->step;
+        pre[1].dst = step_var;
+    }
+
+    // j steps just before i's update, with nothing in between that reads
+    // either, so it always equals i * k where i is read.
+    TackyInstr *step = tacky_queue_insert(&iv->inserts, base->update, 1);
+    step->kind = TACKY_INSTR_BINARY;
+    step->op = TACKY_BIN_ADD;
+    step->src1.kind = TACKY_VAL_VAR;
+    step->src1.value = j;
+    if (step_var >= 0) {
+        step->src2.kind = TACKY_VAL_VAR;
+        step->src2.value = step_var;
+    } else {
+        step->src2.kind = TACKY_VAL_CONSTANT;
+        step->src2.value = (int)((unsigned)base->step * (unsigned)scale.value);
+    }
+    step->dst = j;
+
+    for (int m = 0; m < members; m++) {
+        TackyInstr *ins = &fn->body[iv->family[m]];
+        ins->kind = TACKY_INSTR_COPY;
+        ins->src1.kind = TACKY_VAL_VAR;
+        ins->src1.value = j;
+    }
+    if (lftr) {
+        TackyInstr *ins = &fn->body[test];
+        bool less = ins->op == TACKY_BIN_LESS;
+        ins->op = scale.value > 0 ? (less ? TACKY_BIN_LESS : TACKY_BIN_LESS_EQUAL)
+                                  : (less ? TACKY_BIN_GREATER : TACKY_BIN_GREATER_EQUAL);
+        ins->src1.value = j;
+        ins->src2.value = (int)((long long)ins->src2.value * scale.value);
+        if (drop_base) {
+            fn->body[base->add].kind = TACKY_INSTR_NOP;
+            fn->body[base->update].kind = TACKY_INSTR_NOP;
+        }
+    }
+    return true;
+}
+
+// Definitions inside the loop, counted again after each rewrite, since it
+// can remove i's update and adds variables the arrays must cover.
+static void count_defs(Induction *iv, int loop) {
+    int vars = iv->fn->var_count;
+    if (vars > iv->var_capacity) {
+        iv->var_capacity = vars * 2;
+        iv->def_count = (int *)xrealloc(iv->def_count, (size_t)iv->var_capacity * sizeof(int));
+        iv->def_at = (int *)xrealloc(iv->def_at, (size_t)iv->var_capacity * sizeof(int));
+    }
+    loop_count_defs(&iv->cfg, &iv->loops, loop, iv->def_count, iv->def_at);
+}
+
+static bool reduce_loop(Induction *iv, int loop) {
+    const TackyFunction *fn = iv->fn;
+    const Loop *l = &iv->loops.loops[loop];
+    bool changed = false;
+    count_defs(iv, loop);
+    for (int k = 0; k < l->block_count; k++) {
+        const BasicBlock *blk = &iv->cfg.blocks[iv->loops.blocks[l->block_start + k]];
+        for (int i = blk->start; i < blk->end; i++) {
+            InductionVar base;
+            TackyVal scale;
+            if (!scaled_iv(iv, &fn->body[i], &base, &scale) || !reduce(iv, loop, &base, scale)) continue;
+            changed = true;
+            count_defs(iv, loop);
+        }
+    }
+    return changed;
+}
+
+bool reduce_induction_variables(TackyFunction *fn) {
+    if (fn->instr_count == 0) return false;
+    Induction iv = {0};
+    iv.fn = fn;
+    cfg_build(&iv.cfg, fn);
+    dom_compute(&iv.dom, &iv.cfg);
+    loops_find(&iv.loops, &iv.cfg, &iv.dom);
+    bool changed = false;
+
+    // Every family of every loop, from this one analysis. A rewrite only
+    // changes instructions in place and queues new ones, so the blocks stay
+    // as they were; the variables it adds are defined only by queued code,
+    // which no multiplication reads.
+    if (iv.loops.loop_count > 0) {
+        liveness_compute(&iv.live, &iv.cfg);
+        iv.family = (int *)xmalloc((size_t)fn->instr_count * sizeof(int));
+        for (int l = 0; l < iv.loops.loop_count; l++) {
+            if (reduce_loop(&iv, l)) changed = true;
+        }
+        tacky_apply_insertions(fn, &iv.inserts);
+        free(iv.def_count);
+        free(iv.def_at);
+        free(iv.family);
+    }
+    if (changed) tacky_compact(fn);
+
+    tacky_insertions_free(&iv.inserts);
+    liveness_free(&iv.live);
+    loops_free(&iv.loops);
+    dom_free(&iv.dom);
+    cfg_free(&iv.cfg);
+    return changed;
+}
@@ -0,0 +1,173 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/optimize/loops.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    TackyFunction *fn;
+    Cfg cfg;
+    DomTree dom;
+    LoopForest loops;
+    Liveness live;
+    TackyInsertions preheaders;
+    int current;        // loop being worked on, plus one
+    int *stamp;         // the two arrays below hold for this loop only when
+    int *def_count;     //   stamp[v] == current: definitions of v inside it,
+    unsigned char *invariant;   //   and whether v keeps one value throughout
+    int *exits;         // the loop's exit edges, as (from, to) pairs
+    int exit_count;
+    int *hoisted;       // indices of the instructions chosen, in order
+} Licm;
+
+static int defs_in_loop(const Licm *lc, int v) {
+    return lc->stamp[v] == lc->current ? lc->def_count[v] : 0;
+}
+
+static bool operand_invariant(const Licm *lc, TackyVal v) {
+    return v.kind == TACKY_VAL_CONSTANT || lc->stamp[v.value] != lc->current || lc->invariant[v.value];
+}
+
+// Every way out of the loop leaves from a block b dominates, so b runs on
+// every trip through the loop that ends. A loop with no way out never
+// ends, so nothing in it is known to run.
+static bool runs_before_exit(const Licm *lc, int b) {
+    for (int e = 0; e < lc->exit_count; e++) {
+        if (!dom_dominates(&lc->dom, b, lc->exits[2 * e])) return false;
+    }
+    return lc->exit_count > 0;
+}
+
+// The value x gets in b is the only one read after leaving the loop: an
+// exit where x is live leaves from a block b dominates.
+static bool exits_see_def(const Licm *lc, int b, int x) {
+    for (int e = 0; e < lc->exit_count; e++) {
+        int from = lc->exits[2 * e], to = lc->exits[2 * e + 1];
+        if (bitset_test(liveness_in(&lc->live, to), x) && !dom_dominates(&lc->dom, b, from)) return false;
+    }
+    return true;
+}
+
+// An instruction can move to the preheader if its operands hold the same
+// value on every iteration, it is the loop's only definition of its
+// destination, no read inside the loop can see an older value (the
+// destination is not live into the header) and reads after the loop see
+// the same value as before. Division and remainder that may trap move only
+// if they would have run anyway.
+static bool can_hoist(const Licm *lc, int loop, int b, const TackyInstr *ins) {
+    if (ins->kind != TACKY_INSTR_COPY && ins->kind != TACKY_INSTR_UNARY && ins->kind != TACKY_INSTR_BINARY) {
+        return false;
+    }
+    int x = ins->dst;
+    if (defs_in_loop(lc, x) != 1 || lc->invariant[x]) return false;
+    if (!operand_invariant(lc, ins->src1)) return false;
+    if (ins->kind == TACKY_INSTR_BINARY && !operand_invariant(lc, ins->src2)) return false;
+    int header = lc->loops.loops[loop].header;
+    if (bitset_test(liveness_in(&lc->live, header), x)) return false;
+    if (!exits_see_def(lc, b, x)) return false;
+    return !tacky_may_trap(ins) || runs_before_exit(lc, b);
+}
+
+// Chooses the invariant instructions of one loop; an instruction whose
+// operands come from instructions already chosen is chosen after them.
+static int find_invariants(Licm *lc, int loop) {
+    const TackyFunction *fn = lc->fn;
+    const Loop *l = &lc->loops.loops[loop];
+    lc->current = loop + 1;
+    lc->exit_count = 0;
+    for (int k = 0; k < l->block_count; k++) {
+        int b = lc->loops.blocks[l->block_start + k];
+        const BasicBlock *blk = &lc->cfg.blocks[b];
+        for (int s = 0; s < blk->succ_count; s++) {
+            if (loop_contains(&lc->loops, loop, blk->succ[s])) continue;
+            lc->exits[2 * lc->exit_count] = b;
+            lc->exits[2 * lc->exit_count + 1] = blk->succ[s];
+            lc->exit_count++;
+        }
+        for (int i = blk->start; i < blk->end; i++) {
+            int def = tacky_instr_def(&fn->body[i]);
+            if (def < 0) continue;
+            if (lc->stamp[def] != lc->current) {
+                lc->stamp[def] = lc->current;
+                lc->def_count[def] = 0;
+            }
+            lc->def_count[def]++;
+            lc->invariant[def] = 0;
+        }
+    }
+
+    int count = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < l->block_count; k++) {
+            int b = lc->loops.blocks[l->block_start + k];
+            const BasicBlock *blk = &lc->cfg.blocks[b];
+            for (int i = blk->start; i < blk->end; i++) {
+                const TackyInstr *ins = &fn->body[i];
+                if (!can_hoist(lc, loop, b, ins)) continue;
+                lc->invariant[ins->dst] = 1;
+                lc->hoisted[count++] = i;
+                changed = true;
+            }
+        }
+    }
+    return count;
+}
+
+// Queues the chosen instructions of one loop for its preheader and leaves
+// NOPs in their place. Returns false, changing nothing, if the loop cannot
+// have a preheader.
+static bool hoist(Licm *lc, int loop, int count) {
+    TackyFunction *fn = lc->fn;
+    TackyInstr *slots = loop_queue_preheader(fn, &lc->preheaders, &lc->cfg, &lc->loops, loop, count);
+    if (!slots) return false;
+    for (int k = 0; k < count; k++) {
+        slots[k] = fn->body[lc->hoisted[k]];
+        fn->body[lc->hoisted[k]].kind = TACKY_INSTR_NOP;
+    }
+    return true;
+}
+
+bool hoist_loop_invariants(TackyFunction *fn) {
+    if (fn->instr_count == 0) return false;
+    Licm lc = {0};
+    lc.fn = fn;
+    cfg_build(&lc.cfg, fn);
+    dom_compute(&lc.dom, &lc.cfg);
+    loops_find(&lc.loops, &lc.cfg, &lc.dom);
+    bool changed = false;
+    if (lc.loops.loop_count > 0) {
+        liveness_compute(&lc.live, &lc.cfg);
+        lc.stamp = (int *)xcalloc((size_t)fn->var_count, sizeof(int));
+        lc.def_count = (int *)xmalloc((size_t)fn->var_count * sizeof(int));
+        lc.invariant = (unsigned char *)xmalloc((size_t)fn->var_count);
+        lc.exits = (int *)xmalloc((size_t)lc.cfg.block_count * 4 * sizeof(int));
+        lc.hoisted = (int *)xmalloc((size_t)fn->instr_count * sizeof(int));
+
+        // Outermost loops first, all from this one analysis: the moves only
+        // turn instructions into NOPs and queue them, so the blocks stay as
+        // they were. Code hoisted out of a loop is then no longer defined in
+        // the loops inside it, which treat it as invariant; code that can
+        // only leave an inner loop goes to that loop's preheader.
+        for (int l = lc.loops.loop_count - 1; l >= 0; l--) {
+            int count = find_invariants(&lc, l);
+            if (count > 0 && hoist(&lc, l, count)) changed = true;
+        }
+        tacky_apply_insertions(fn, &lc.preheaders);
+        free(lc.stamp);
+        free(lc.def_count);
+        free(lc.invariant);
+        free(lc.exits);
+        free(lc.hoisted);
+    }
+    if (changed) tacky_compact(fn);
+
+    tacky_insertions_free(&lc.preheaders);
+    liveness_free(&lc.live);
+    loops_free(&lc.loops);
+    dom_free(&lc.dom);
+    cfg_free(&lc.cfg);
+    return changed;
+}
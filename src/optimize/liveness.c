@@ -0,0 +1,95 @@
+#include "../../include/optimize/liveness.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int tacky_instr_def(const TackyInstr *ins) {
+    switch ((TackyInstrKind)ins->kind) {
+        case TACKY_INSTR_UNARY:
+        case TACKY_INSTR_BINARY:
+        case TACKY_INSTR_COPY:
+            return ins->dst;
+        default:
+            return -1;
+    }
+}
+
+int tacky_instr_uses(const TackyInstr *ins, int uses[2]) {
+    int n = 0;
+    switch ((TackyInstrKind)ins->kind) {
+        case TACKY_INSTR_BINARY:
+            if (ins->src2.kind == TACKY_VAL_VAR) uses[n++] = ins->src2.value;
+            // fall through
+        case TACKY_INSTR_UNARY:
+        case TACKY_INSTR_COPY:
+        case TACKY_INSTR_RETURN:
+        case TACKY_INSTR_JUMP_IF_ZERO:
+        case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+            if (ins->src1.kind == TACKY_VAL_VAR) uses[n++] = ins->src1.value;
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+void liveness_step(BitWord *live, const TackyInstr *ins) {
+    int uses[2];
+    int def = tacky_instr_def(ins);
+    if (def >= 0) bitset_clear(live, def);
+    int n = tacky_instr_uses(ins, uses);
+    for (int k = 0; k < n; k++) bitset_set(live, uses[k]);
+}
+
+static BitWord *block_use(const Liveness *lv, int b) { return liveness_in(lv, b) + 2 * lv->words; }
+static BitWord *block_def(const Liveness *lv, int b) { return liveness_in(lv, b) + 3 * lv->words; }
+
+static void local_sets(Liveness *lv, const Cfg *cfg, int b) {
+    const TackyFunction *fn = cfg->fn;
+    const BasicBlock *blk = &cfg->blocks[b];
+    BitWord *use = block_use(lv, b);
+    BitWord *def = block_def(lv, b);
+    for (int i = blk->start; i < blk->end; i++) {
+        int uses[2];
+        int n = tacky_instr_uses(&fn->body[i], uses);
+        for (int k = 0; k < n; k++) {
+            if (!bitset_test(def, uses[k])) bitset_set(use, uses[k]);
+        }
+        int d = tacky_instr_def(&fn->body[i]);
+        if (d >= 0) bitset_set(def, d);
+    }
+}
+
+// Backward may-analysis, solved over the blocks in postorder so most
+// successors are final before their predecessors are visited.
+void liveness_compute(Liveness *lv, const Cfg *cfg) {
+    lv->words = bitset_words(cfg->fn->var_count);
+    if (lv->words == 0) lv->words = 1;
+    lv->block_count = cfg->block_count;
+    size_t needed = (size_t)cfg->block_count * 4 * lv->words;
+    if (needed > lv->set_capacity) {
+        free(lv->sets);
+        lv->sets = (BitWord *)xmalloc(needed * sizeof(BitWord));
+        lv->set_capacity = needed;
+    }
+    bitset_fill(lv->sets, (int)needed, false);
+    for (int r = 0; r < cfg->rpo_count; r++) local_sets(lv, cfg, cfg->rpo[r]);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = cfg->rpo_count - 1; r >= 0; r--) {
+            int b = cfg->rpo[r];
+            const BasicBlock *blk = &cfg->blocks[b];
+            BitWord *out = liveness_out(lv, b);
+            for (int s = 0; s < blk->succ_count; s++) bitset_or(out, liveness_in(lv, blk->succ[s]), lv->words);
+            changed |= bitset_transfer(liveness_in(lv, b), block_use(lv, b), out, block_def(lv, b), lv->words);
+        }
+    }
+}
+
+void liveness_free(Liveness *lv) {
+    free(lv->sets);
+    lv->sets = NULL;
+    lv->set_capacity = 0;
+}
@@ -0,0 +1,253 @@
+#include "../../include/optimize/loops.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Walks predecessors backwards from the sources of h's back edges, stopping
+// at h, and records the blocks reached in set and in body, h first.
+// Returns how many there are.
+static int collect_body(const Cfg *cfg, const DomTree *dt, int h, BitWord *set, int *body) {
+    const BasicBlock *hb = &cfg->blocks[h];
+    int count = 0;
+    bitset_set(set, h);
+    body[count++] = h;
+    for (int p = 0; p < hb->pred_count; p++) {
+        int latch = cfg->preds[hb->pred_start + p];
+        if (dt->idom[latch] < 0 || !dom_dominates(dt, h, latch) || bitset_test(set, latch)) continue;
+        bitset_set(set, latch);
+        body[count++] = latch;
+    }
+    for (int next = 1; next < count; next++) {
+        const BasicBlock *blk = &cfg->blocks[body[next]];
+        for (int p = 0; p < blk->pred_count; p++) {
+            int pred = cfg->preds[blk->pred_start + p];
+            if (dt->idom[pred] < 0 || bitset_test(set, pred)) continue;
+            bitset_set(set, pred);
+            body[count++] = pred;
+        }
+    }
+    return count;
+}
+
+static bool has_back_edge(const Cfg *cfg, const DomTree *dt, int h) {
+    const BasicBlock *hb = &cfg->blocks[h];
+    for (int p = 0; p < hb->pred_count; p++) {
+        int pred = cfg->preds[hb->pred_start + p];
+        if (dt->idom[pred] >= 0 && dom_dominates(dt, h, pred)) return true;
+    }
+    return false;
+}
+
+static const LoopForest *sort_forest;
+
+static int compare_size(const void *a, const void *b) {
+    const Loop *x = &sort_forest->loops[*(const int *)a];
+    const Loop *y = &sort_forest->loops[*(const int *)b];
+    if (x->block_count != y->block_count) return x->block_count < y->block_count ? -1 : 1;
+    return x->header < y->header ? -1 : x->header > y->header;
+}
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return x < y ? -1 : x > y;
+}
+
+void loops_find(LoopForest *lf, const Cfg *cfg, const DomTree *dt) {
+    loops_free(lf);
+    int n = cfg->block_count;
+    lf->words = bitset_words(n > 0 ? n : 1);
+    int capacity = 0;
+    int total = 0;
+    int block_capacity = 0;
+    for (int r = 0; r < cfg->rpo_count; r++) {
+        int h = cfg->rpo[r];
+        if (!has_back_edge(cfg, dt, h)) continue;
+        if (lf->loop_count == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            lf->loops = (Loop *)xrealloc(lf->loops, (size_t)capacity * sizeof(Loop));
+            lf->members = (BitWord *)xrealloc(lf->members, (size_t)capacity * lf->words * sizeof(BitWord));
+        }
+        if (total + n > block_capacity) {
+            block_capacity = block_capacity ? block_capacity * 2 : n;
+            if (block_capacity < total + n) block_capacity = total + n;
+            lf->blocks = (int *)xrealloc(lf->blocks, (size_t)block_capacity * sizeof(int));
+        }
+        BitWord *set = lf->members + (size_t)lf->loop_count * lf->words;
+        bitset_fill(set, lf->words, false);
+        Loop *l = &lf->loops[lf->loop_count++];
+        l->header = h;
+        l->block_start = total;
+        l->block_count = collect_body(cfg, dt, h, set, lf->blocks + total);
+        qsort(lf->blocks + total, (size_t)l->block_count, sizeof(int), compare_int);
+        total += l->block_count;
+    }
+
+    // Nested natural loops with different headers are strictly smaller
+    // than the loops around them, so ordering by size puts inner first.
+    int count = lf->loop_count;
+    int *order = (int *)xmalloc((size_t)count * sizeof(int));
+    for (int k = 0; k < count; k++) order[k] = k;
+    sort_forest = lf;
+    qsort(order, (size_t)count, sizeof(int), compare_size);
+    sort_forest = NULL;
+    Loop *loops = (Loop *)xmalloc((size_t)count * sizeof(Loop));
+    BitWord *members = (BitWord *)xmalloc((size_t)count * lf->words * sizeof(BitWord));
+    for (int k = 0; k < count; k++) {
+        loops[k] = lf->loops[order[k]];
+        bitset_copy(members + (size_t)k * lf->words, lf->members + (size_t)order[k] * lf->words, lf->words);
+    }
+    free(order);
+    free(lf->loops);
+    free(lf->members);
+    lf->loops = loops;
+    lf->members = members;
+
+    // Outermost first, owner[b] ends up as the innermost loop seen so far
+    // holding b; loops either nest or are disjoint, so when a loop comes up
+    // that is the one right around its header.
+    int *owner = (int *)xmalloc((size_t)(n > 0 ? n : 1) * sizeof(int));
+    for (int b = 0; b < n; b++) owner[b] = -1;
+    for (int k = count - 1; k >= 0; k--) {
+        Loop *l = &loops[k];
+        l->parent = owner[l->header];
+        l->depth = l->parent < 0 ? 1 : loops[l->parent].depth + 1;
+        for (int m = 0; m < l->block_count; m++) owner[lf->blocks[l->block_start + m]] = k;
+    }
+    free(owner);
+}
+
+void loops_free(LoopForest *lf) {
+    free(lf->loops);
+    free(lf->blocks);
+    free(lf->members);
+    lf->loops = NULL;
+    lf->blocks = NULL;
+    lf->members = NULL;
+    lf->loop_count = 0;
+}
+
+void loop_count_defs(const Cfg *cfg, const LoopForest *lf, int loop, int *def_count, int *def_at) {
+    const Loop *l = &lf->loops[loop];
+    for (int v = 0; v < cfg->fn->var_count; v++) def_count[v] = 0;
+    for (int k = 0; k < l->block_count; k++) {
+        const BasicBlock *blk = &cfg->blocks[lf->blocks[l->block_start + k]];
+        for (int i = blk->start; i < blk->end; i++) {
+            int def = tacky_instr_def(&cfg->fn->body[i]);
+            if (def < 0) continue;
+            def_count[def]++;
+            def_at[def] = i;
+        }
+    }
+}
+
+static bool is_var(TackyVal v, int var) {
+    return v.kind == TACKY_VAL_VAR && v.value == var;
+}
+
+// Recognizes new = var + c, c + var or var - c with a constant c.
+static bool step_of(const TackyInstr *ins, int var, int *step) {
+    if (ins->kind != TACKY_INSTR_BINARY) return false;
+    if (ins->op == TACKY_BIN_ADD && is_var(ins->src1, var) && ins->src2.kind == TACKY_VAL_CONSTANT) {
+        *step = ins->src2.value;
+        return true;
+    }
+    if (ins->op == TACKY_BIN_ADD && is_var(ins->src2, var) && ins->src1.kind == TACKY_VAL_CONSTANT) {
+        *step = ins->src1.value;
+        return true;
+    }
+    if (ins->op == TACKY_BIN_SUB && is_var(ins->src1, var) && ins->src2.kind == TACKY_VAL_CONSTANT) {
+        *step = (int)(0u - (unsigned)ins->src2.value);
+        return true;
+    }
+    return false;
+}
+
+bool loop_induction_var(const Cfg *cfg, const int *def_count, const int *def_at, int var, InductionVar *out) {
+    if (def_count[var] != 1) return false;
+    const TackyFunction *fn = cfg->fn;
+    int update = def_at[var];
+    const TackyInstr *ins = &fn->body[update];
+    out->var = var;
+    out->update = update;
+    if (step_of(ins, var, &out->step)) {
+        out->add = update;
+        return true;
+    }
+    if (ins->kind != TACKY_INSTR_COPY || ins->src1.kind != TACKY_VAL_VAR) return false;
+    int t = ins->src1.value;
+    if (def_count[t] != 1 || def_at[t] >= update) return false;
+    if (def_at[t] < cfg->blocks[cfg_block_of_instr(cfg, update)].start) return false;
+    out->add = def_at[t];
+    return step_of(&fn->body[out->add], var, &out->step);
+}
+
+bool loop_entry_constant(const Cfg *cfg, const LoopForest *lf, int loop, int var, int *value) {
+    const BasicBlock *hb = &cfg->blocks[lf->loops[loop].header];
+    int from = -1;
+    for (int p = 0; p < hb->pred_count; p++) {
+        int pred = cfg->preds[hb->pred_start + p];
+        if (loop_contains(lf, loop, pred)) continue;
+        if (from >= 0) return false;
+        from = pred;
+    }
+    if (from < 0) return false;
+    const BasicBlock *blk = &cfg->blocks[from];
+    for (int i = blk->end - 1; i >= blk->start; i--) {
+        const TackyInstr *ins = &cfg->fn->body[i];
+        if (tacky_instr_def(ins) != var) continue;
+        if (ins->kind != TACKY_INSTR_COPY || ins->src1.kind != TACKY_VAL_CONSTANT) return false;
+        *value = ins->src1.value;
+        return true;
+    }
+    return false;
+}
+
+bool loop_runs_once(const Cfg *cfg, const LoopForest *lf, int loop, int instr) {
+    int b = cfg_block_of_instr(cfg, instr);
+    for (int l = 0; l < loop; l++) {
+        if (loop_contains(lf, l, b) && loop_contains(lf, loop, lf->loops[l].header)) return false;
+    }
+    return true;
+}
+
+static bool is_jump(unsigned char kind) {
+    return kind == TACKY_INSTR_JUMP || kind == TACKY_INSTR_JUMP_IF_ZERO || kind == TACKY_INSTR_JUMP_IF_NOT_ZERO;
+}
+
+static bool falls_through(const Cfg *cfg, int b) {
+    int last = cfg_last_instr(cfg, b);
+    if (last < 0) return true;
+    unsigned char kind = cfg->fn->body[last].kind;
+    return kind != TACKY_INSTR_JUMP && kind != TACKY_INSTR_RETURN;
+}
+
+TackyInstr *loop_queue_preheader(TackyFunction *fn, TackyInsertions *q, const Cfg *cfg, const LoopForest *lf, int loop,
+                                 int count) {
+    int h = lf->loops[loop].header;
+    int at = cfg->blocks[h].start;
+    if (fn->body[at].kind != TACKY_INSTR_LABEL) return NULL;
+    if (h > 0 && loop_contains(lf, loop, h - 1) && falls_through(cfg, h - 1)) return NULL;
+
+    // Jumps entering the header from outside the loop go to a new label in
+    // front of the room; a second call finds them redirected already.
+    int header_label = fn->body[at].label;
+    int entry_label = -1;
+    const BasicBlock *hb = &cfg->blocks[h];
+    for (int p = 0; p < hb->pred_count; p++) {
+        int b = cfg->preds[hb->pred_start + p];
+        if (loop_contains(lf, loop, b)) continue;
+        int last = cfg_last_instr(cfg, b);
+        if (last < 0 || !is_jump(fn->body[last].kind) || fn->body[last].label != header_label) continue;
+        if (entry_label < 0) entry_label = tacky_new_label(fn, TACKY_LABEL_PREHEADER);
+        fn->body[last].label = entry_label;
+    }
+    if (entry_label >= 0) {
+        TackyInstr *label = tacky_queue_insert(q, at, 1);
+        label->kind = TACKY_INSTR_LABEL;
+        label->label = entry_label;
+    }
+    return tacky_queue_insert(q, at, count);
+}
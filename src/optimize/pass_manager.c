@@ -0,0 +1,174 @@
+#include "../../include/optimize/pass_manager.h"
+#include "../../include/optimize/optimize.h"
+#include <string.h>
+#include <time.h>
+
+typedef bool (*FunctionPass)(TackyFunction *fn);
+typedef bool (*SsaPass)(SsaForm *ssa);
+
+static const PassInfo passes[PASS_COUNT] = {
+    [PASS_SSA] = { "ssa", "Convert TACKY to SSA form and back before the other passes", PASS_GROUP_SSA, 0 },
+    [PASS_SCCP] = { "sccp", "Propagate constants through branches they decide (on SSA form)", PASS_GROUP_SSA, 2 },
+    [PASS_GVN] = { "gvn", "Reuse values already computed on every path (on SSA form)", PASS_GROUP_SSA, 2 },
+    [PASS_FOLD_CONSTANTS] = { "fold-constants", "Fold constant expressions and branches in TACKY", PASS_GROUP_CLEANUP, 1 },
+    [PASS_PROPAGATE_COPIES] = { "propagate-copies", "Replace uses of copied variables with their sources", PASS_GROUP_CLEANUP, 1 },
+    [PASS_ELIMINATE_DEAD_STORES] = { "eliminate-dead-stores", "Remove computations whose results are never read", PASS_GROUP_CLEANUP, 1 },
+    [PASS_SIMPLIFY_CFG] = { "simplify-cfg", "Remove unreachable code, redundant jumps and unused labels", PASS_GROUP_CLEANUP, 1 },
+    [PASS_FOLD_RANGES] = { "fold-ranges", "Fold comparisons and branches that value ranges decide", PASS_GROUP_CLEANUP, 2 },
+    [PASS_LICM] = { "licm", "Move computations that do not change in a loop in front of it", PASS_GROUP_LOOP, 2 },
+    [PASS_STRENGTH_REDUCE] = { "strength-reduce", "Replace multiples of loop counters with running sums", PASS_GROUP_LOOP, 2 },
+    [PASS_UNROLL] = { "unroll", "Unroll loops whose number of iterations is known", PASS_GROUP_LOOP, 2 },
+};
+
+static const FunctionPass function_passes[PASS_COUNT] = {
+    [PASS_FOLD_CONSTANTS] = fold_constants,
+    [PASS_PROPAGATE_COPIES] = propagate_copies,
+    [PASS_ELIMINATE_DEAD_STORES] = eliminate_dead_stores,
+    [PASS_SIMPLIFY_CFG] = simplify_cfg,
+    [PASS_FOLD_RANGES] = fold_ranges,
+    [PASS_LICM] = hoist_loop_invariants,
+    [PASS_STRENGTH_REDUCE] = reduce_induction_variables,
+    [PASS_UNROLL] = unroll_loops,
+};
+
+static const SsaPass ssa_passes[PASS_COUNT] = {
+    [PASS_SCCP] = propagate_constants,
+    [PASS_GVN] = number_values,
+};
+
+const PassInfo *pass_info(PassId id) {
+    return &passes[id];
+}
+
+PassId pass_lookup(const char *name) {
+    for (int id = 0; id < PASS_COUNT; id++) {
+        if (strcmp(passes[id].name, name) == 0) return (PassId)id;
+    }
+    return PASS_COUNT;
+}
+
+void pass_config_init(PassConfig *config, int level) {
+    memset(config, 0, sizeof(*config));
+    for (int id = 0; id < PASS_COUNT; id++) {
+        config->enabled[id] = passes[id].level > 0 && passes[id].level <= level;
+    }
+}
+
+static double now_seconds(void) {
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int count_instrs(const TackyFunction *fn) {
+    int n = 0;
+    for (int i = 0; i < fn->instr_count; i++) {
+        if (fn->body[i].kind != TACKY_INSTR_NOP) n++;
+    }
+    return n;
+}
+
+// Timing and counts around one run of a pass.
+typedef struct {
+    PassStats *stats;
+    double started;
+} PassTimer;
+
+static PassTimer timer_start(PassStats *stats, PassId id, const TackyFunction *fn) {
+    PassTimer t = { NULL, 0 };
+    if (!stats) return t;
+    t.stats = &stats[id];
+    if (t.stats->runs == 0) t.stats->instrs_before = count_instrs(fn);
+    t.started = now_seconds();
+    return t;
+}
+
+static void timer_stop(PassTimer *t, const TackyFunction *fn, bool changed) {
+    if (!t->stats) return;
+    t->stats->seconds += now_seconds() - t->started;
+    t->stats->runs++;
+    if (changed) t->stats->changes++;
+    t->stats->instrs_after = count_instrs(fn);
+}
+
+static bool run_pass(TackyFunction *fn, PassId id, PassStats *stats) {
+    PassTimer t = timer_start(stats, id, fn);
+    bool changed = function_passes[id](fn);
+    timer_stop(&t, fn, changed);
+    return changed;
+}
+
+static void run_ssa_group(TackyFunction *fn, const PassConfig *config, PassStats *stats) {
+    bool any = config->enabled[PASS_SSA];
+    for (int id = 0; id < PASS_COUNT; id++) {
+        if (ssa_passes[id] && config->enabled[id]) any = true;
+    }
+    if (!any) return;
+
+    // Building and leaving SSA form count as the ssa pass.
+    SsaForm ssa;
+    PassTimer t = timer_start(stats, PASS_SSA, fn);
+    ssa_build(&ssa, fn);
+    timer_stop(&t, fn, false);
+    for (int id = 0; id < PASS_COUNT; id++) {
+        if (!ssa_passes[id] || !config->enabled[id]) continue;
+        PassTimer pt = timer_start(stats, (PassId)id, fn);
+        bool changed = ssa_passes[id](&ssa);
+        timer_stop(&pt, fn, changed);
+    }
+    double started = now_seconds();
+    ssa_destroy(&ssa);
+    if (stats) {
+        stats[PASS_SSA].seconds += now_seconds() - started;
+        stats[PASS_SSA].instrs_after = count_instrs(fn);
+    }
+}
+
+// Each cleanup pass exposes work for the others (a folded constant
+// becomes a copy to propagate, a propagated constant becomes an operand
+// to fold), so they repeat until none changes anything.
+static bool run_cleanup_group(TackyFunction *fn, const PassConfig *config, PassStats *stats) {
+    bool any = false;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int id = 0; id < PASS_COUNT; id++) {
+            if (passes[id].group != PASS_GROUP_CLEANUP || !config->enabled[id]) continue;
+            changed |= run_pass(fn, (PassId)id, stats);
+        }
+        any |= changed;
+    }
+    return any;
+}
+
+void pass_manager_run(TackyFunction *fn, const PassConfig *config, PassStats *stats) {
+    if (!fn) return;
+    run_ssa_group(fn, config, stats);
+    run_cleanup_group(fn, config, stats);
+    for (int round = 0; round < PASS_MAX_ROUNDS; round++) {
+        bool changed = false;
+        for (int id = 0; id < PASS_COUNT; id++) {
+            if (passes[id].group != PASS_GROUP_LOOP || !config->enabled[id]) continue;
+            changed |= run_pass(fn, (PassId)id, stats);
+        }
+        if (!changed) break;
+        run_cleanup_group(fn, config, stats);
+    }
+}
+
+void pass_stats_print(const PassStats *stats, FILE *out) {
+    double total = 0;
+    fprintf(out, "%-22s %6s %8s %12s %8s %8s\n", "pass", "runs", "changed", "time (us)", "before", "after");
+    for (int id = 0; id < PASS_COUNT; id++) {
+        const PassStats *s = &stats[id];
+        if (s->runs == 0) continue;
+        total += s->seconds;
+        fprintf(out, "%-22s %6d %8d %12.1f %8d %8d\n", passes[id].name, s->runs, s->changes,
+                s->seconds * 1e6, s->instrs_before, s->instrs_after);
+    }
+    fprintf(out, "%-22s %6s %8s %12.1f\n", "total", "", "", total * 1e6);
+}
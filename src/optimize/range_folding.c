@@ -0,0 +1,101 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/ranges.h"
+#include <stdlib.h>
+
+// A variable that can hold only one value here is replaced by it.
+static bool pin(TackyVal *v, const ValueRange *r) {
+    if (v->kind != TACKY_VAL_VAR || !range_is_const(r)) return false;
+    *v = tacky_constant(r->lo);
+    return true;
+}
+
+// x == 1 and x != 0 are x itself when x is 0 or 1; x == 0 and x != 1 are !x.
+static bool simplify_bool_compare(TackyInstr *ins, const ValueRange *a, const ValueRange *b) {
+    if (ins->op != TACKY_BIN_EQUAL && ins->op != TACKY_BIN_NOT_EQUAL) return false;
+    TackyVal x = ins->src1, c = ins->src2;
+    const ValueRange *xr = a;
+    if (x.kind != TACKY_VAL_VAR) {
+        x = ins->src2;
+        c = ins->src1;
+        xr = b;
+    }
+    if (x.kind != TACKY_VAL_VAR || !range_is_bool(xr)) return false;
+    if (c.kind != TACKY_VAL_CONSTANT || (c.value != 0 && c.value != 1)) return false;
+    if ((ins->op == TACKY_BIN_EQUAL) == (c.value == 1)) {
+        tacky_make_copy(ins, x);
+    } else {
+        ins->kind = TACKY_INSTR_UNARY;
+        ins->op = TACKY_UN_NOT;
+        ins->src1 = x;
+        ins->src2 = tacky_constant(0);
+    }
+    return true;
+}
+
+// a / d is 0 and a % d is a when |a| < |d|. Neither can trap then.
+static bool simplify_division(TackyInstr *ins, const ValueRange *a) {
+    if (ins->op != TACKY_BIN_DIV && ins->op != TACKY_BIN_REM) return false;
+    if (ins->src2.kind != TACKY_VAL_CONSTANT || ins->src2.value == 0) return false;
+    long long d = ins->src2.value < 0 ? -(long long)ins->src2.value : ins->src2.value;
+    if (a->lo <= -d || a->hi >= d) return false;
+    tacky_make_copy(ins, ins->op == TACKY_BIN_DIV ? tacky_constant(0) : ins->src1);
+    return true;
+}
+
+bool fold_ranges(TackyFunction *fn) {
+    if (fn->instr_count == 0) return false;
+    Cfg cfg = {0};
+    RangeAnalysis ra = {0};
+    cfg_build(&cfg, fn);
+    ranges_compute(&ra, &cfg);
+
+    const ValueRange zero = range_const(0);
+    bool changed = false;
+    bool removed = false;
+    for (int i = 0; i < fn->instr_count; i++) {
+        TackyInstr *ins = &fn->body[i];
+        const ValueRange *a = ranges_src1(&ra, i), *b = ranges_src2(&ra, i);
+        int result;
+        switch ((TackyInstrKind)ins->kind) {
+            case TACKY_INSTR_UNARY:
+                changed |= pin(&ins->src1, a);
+                if (ins->op == TACKY_UN_NOT && range_compare(TACKY_BIN_EQUAL, a, &zero, &result)) {
+                    tacky_make_copy(ins, tacky_constant(result));
+                    changed = true;
+                }
+                break;
+            case TACKY_INSTR_BINARY:
+                changed |= pin(&ins->src1, a);
+                changed |= pin(&ins->src2, b);
+                if (tacky_is_relational((TackyBinaryOp)ins->op) &&
+                    range_compare((TackyBinaryOp)ins->op, a, b, &result)) {
+                    tacky_make_copy(ins, tacky_constant(result));
+                    changed = true;
+                } else if (simplify_bool_compare(ins, a, b) || simplify_division(ins, a)) {
+                    changed = true;
+                }
+                break;
+            case TACKY_INSTR_COPY:
+            case TACKY_INSTR_RETURN:
+                changed |= pin(&ins->src1, a);
+                break;
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                if (range_compare(TACKY_BIN_EQUAL, a, &zero, &result)) {
+                    bool taken = result == (ins->kind == TACKY_INSTR_JUMP_IF_ZERO);
+                    ins->kind = taken ? TACKY_INSTR_JUMP : TACKY_INSTR_NOP;
+                    ins->src1 = tacky_constant(0);
+                    removed |= !taken;
+                    changed = true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    if (removed) tacky_compact(fn);
+
+    ranges_free(&ra);
+    cfg_free(&cfg);
+    return changed;
+}
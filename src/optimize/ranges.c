@@ -0,0 +1,716 @@
+#include "../../include/optimize/ranges.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/optimize/optimize.h"
+#include "../../include/util/alloc.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIGN_BIT 0x80000000u
+
+// A block's entry state is widened once it has changed this many times:
+// a bound still moving jumps to 0 or -1 if it stays on that side of zero,
+// and to the end of int otherwise.
+#define RANGE_WIDEN_AFTER 3
+// Rounds of narrowing after the widened fixed point is reached: plain
+// propagation from a sound state stays sound, and recovers bounds that
+// loop tests imply.
+#define RANGE_NARROW_ROUNDS 2
+
+ValueRange range_full(void) {
+    ValueRange r = { INT_MIN, INT_MAX, 0, 0 };
+    return r;
+}
+
+ValueRange range_const(int value) {
+    ValueRange r = { value, value, ~(unsigned)value, (unsigned)value };
+    return r;
+}
+
+static ValueRange range_empty(void) {
+    ValueRange r = { 1, 0, 0, 0 };
+    return r;
+}
+
+static bool is_empty(const ValueRange *r) {
+    return r->lo > r->hi || (r->zeros & r->ones) != 0;
+}
+
+static bool same_range(const ValueRange *a, const ValueRange *b) {
+    return a->lo == b->lo && a->hi == b->hi && a->zeros == b->zeros && a->ones == b->ones;
+}
+
+// A known sign bit orders the values like unsigned ones, so the known bits
+// bound the interval.
+static void bound_by_bits(ValueRange *r) {
+    if (!((r->zeros | r->ones) & SIGN_BIT)) return;
+    int min = (int)r->ones, max = (int)~r->zeros;
+    if (min > r->lo) r->lo = min;
+    if (max < r->hi) r->hi = max;
+}
+
+// Tightens each view with the other. An interval on one side of zero fixes
+// the bits its ends share above the highest bit in which they differ.
+static void normalize(ValueRange *r) {
+    bound_by_bits(r);
+    if (is_empty(r)) return;
+    if ((r->lo < 0) == (r->hi < 0)) {
+        unsigned fixed = ~0u;
+        for (unsigned diff = (unsigned)r->lo ^ (unsigned)r->hi; diff; diff >>= 1) fixed <<= 1;
+        r->zeros |= ~(unsigned)r->lo & fixed;
+        r->ones |= (unsigned)r->lo & fixed;
+    }
+    bound_by_bits(r);
+}
+
+// Every value b allows, a allows too.
+static bool contains(const ValueRange *a, const ValueRange *b) {
+    return is_empty(b) || (b->lo >= a->lo && b->hi <= a->hi &&
+                           (b->zeros & a->zeros) == a->zeros && (b->ones & a->ones) == a->ones);
+}
+
+static ValueRange join(const ValueRange *a, const ValueRange *b) {
+    if (is_empty(a)) return *b;
+    if (is_empty(b)) return *a;
+    ValueRange r = { a->lo < b->lo ? a->lo : b->lo, a->hi > b->hi ? a->hi : b->hi,
+                     a->zeros & b->zeros, a->ones & b->ones };
+    normalize(&r);
+    return r;
+}
+
+static ValueRange intersect(const ValueRange *a, const ValueRange *b) {
+    ValueRange r = { a->lo > b->lo ? a->lo : b->lo, a->hi < b->hi ? a->hi : b->hi,
+                     a->zeros | b->zeros, a->ones | b->ones };
+    normalize(&r);
+    return r;
+}
+
+// The range of every value in [lo, hi], or the full range if that does
+// not fit in an int (the operation may wrap).
+static ValueRange from_bounds(int64_t lo, int64_t hi) {
+    if (lo < INT_MIN || hi > INT_MAX) return range_full();
+    ValueRange r = { (int)lo, (int)hi, 0, 0 };
+    normalize(&r);
+    return r;
+}
+
+static ValueRange with_bits(ValueRange r, unsigned zeros, unsigned ones) {
+    r.zeros |= zeros;
+    r.ones |= ones;
+    normalize(&r);
+    return r;
+}
+
+static ValueRange widen(const ValueRange *old, ValueRange r) {
+    if (r.lo < old->lo) r.lo = r.lo >= 0 ? 0 : r.lo >= -1 ? -1 : INT_MIN;
+    if (r.hi > old->hi) r.hi = r.hi <= -1 ? -1 : r.hi <= 0 ? 0 : INT_MAX;
+    normalize(&r);
+    return r;
+}
+
+// Known bits of a + b + carry, carry 0 or 1: a bit of the sum is known
+// where the bits of both operands and the carry into it are. The carry
+// is known where the smallest and largest possible sums agree on it.
+static void add_bits(const ValueRange *a, unsigned b_zeros, unsigned b_ones, unsigned carry,
+                     unsigned *zeros, unsigned *ones) {
+    unsigned sum_max = ~a->zeros + ~b_zeros + carry;
+    unsigned sum_min = a->ones + b_ones + carry;
+    unsigned carry_zero = ~(sum_max ^ a->zeros ^ b_zeros);
+    unsigned carry_one = sum_min ^ a->ones ^ b_ones;
+    unsigned known = (a->zeros | a->ones) & (b_zeros | b_ones) & (carry_zero | carry_one);
+    *zeros = ~sum_max & known;
+    *ones = sum_min & known;
+}
+
+static int trailing_ones(unsigned x) {
+    int n = 0;
+    while (n < 32 && ((x >> n) & 1)) n++;
+    return n;
+}
+
+static unsigned low_mask(int bits) {
+    return bits >= 32 ? ~0u : (1u << bits) - 1;
+}
+
+static ValueRange add_range(const ValueRange *a, const ValueRange *b) {
+    unsigned zeros, ones;
+    add_bits(a, b->zeros, b->ones, 0, &zeros, &ones);
+    ValueRange r = from_bounds((int64_t)a->lo + b->lo, (int64_t)a->hi + b->hi);
+    return with_bits(r, zeros, ones);
+}
+
+// a - b is a + ~b + 1.
+static ValueRange sub_range(const ValueRange *a, const ValueRange *b) {
+    unsigned zeros, ones;
+    add_bits(a, b->ones, b->zeros, 1, &zeros, &ones);
+    ValueRange r = from_bounds((int64_t)a->lo - b->hi, (int64_t)a->hi - b->lo);
+    return with_bits(r, zeros, ones);
+}
+
+// The low bits known in both operands give the low bits of the product,
+// and trailing zeros add up.
+static ValueRange mul_range(const ValueRange *a, const ValueRange *b) {
+    int64_t c[4] = { (int64_t)a->lo * b->lo, (int64_t)a->lo * b->hi, (int64_t)a->hi * b->lo, (int64_t)a->hi * b->hi };
+    int64_t lo = c[0], hi = c[0];
+    for (int k = 1; k < 4; k++) {
+        if (c[k] < lo) lo = c[k];
+        if (c[k] > hi) hi = c[k];
+    }
+    ValueRange r = from_bounds(lo, hi);
+
+    int ka = trailing_ones(a->zeros | a->ones), kb = trailing_ones(b->zeros | b->ones);
+    unsigned mask = low_mask(ka < kb ? ka : kb);
+    unsigned low = (a->ones * b->ones) & mask;
+    int tz = trailing_ones(a->zeros) + trailing_ones(b->zeros);
+    return with_bits(r, (~low & mask) | low_mask(tz), low);
+}
+
+// Truncating division is monotonic in each operand while the divisor keeps
+// its sign, so the corners bound the quotients. INT_MIN / -1 traps; the
+// quotient nearest to it is INT_MAX.
+static void div_corners(const ValueRange *a, int blo, int bhi, int64_t *lo, int64_t *hi) {
+    int as[2] = { a->lo, a->hi }, bs[2] = { blo, bhi };
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            int64_t q = (int64_t)as[i] / bs[j];
+            if (q > INT_MAX) q = INT_MAX;
+            if (q < *lo) *lo = q;
+            if (q > *hi) *hi = q;
+        }
+    }
+}
+
+static ValueRange div_range(const ValueRange *a, const ValueRange *b) {
+    int64_t lo = INT64_MAX, hi = INT64_MIN;
+    if (b->lo <= -1) div_corners(a, b->lo, b->hi < -1 ? b->hi : -1, &lo, &hi);
+    if (b->hi >= 1) div_corners(a, b->lo > 1 ? b->lo : 1, b->hi, &lo, &hi);
+    if (lo > hi) return range_full();   // always divides by zero
+    return from_bounds(lo, hi);
+}
+
+// |a % b| < |b| and a % b has the sign of a; a dividend smaller than every
+// divisor is its own remainder. A non-negative dividend keeps its low k
+// bits modulo 2^k.
+static ValueRange rem_range(const ValueRange *a, const ValueRange *b) {
+    if (b->lo == 0 && b->hi == 0) return range_full();
+    int64_t max_abs = -(int64_t)b->lo > b->hi ? -(int64_t)b->lo : b->hi;
+    int64_t min_abs = b->lo > 0 ? b->lo : b->hi < 0 ? -(int64_t)b->hi : 1;
+    int64_t lo = a->lo > -(max_abs - 1) ? a->lo : -(max_abs - 1);
+    int64_t hi = a->hi < max_abs - 1 ? a->hi : max_abs - 1;
+    if (a->lo >= 0 && a->hi >= min_abs) lo = 0;
+    if (a->hi <= 0 && a->lo <= -min_abs) hi = 0;
+    ValueRange r = from_bounds(lo, hi);
+    if (a->lo >= 0 && range_is_const(b)) {
+        int64_t d = b->lo < 0 ? -(int64_t)b->lo : b->lo;
+        if ((d & (d - 1)) == 0) {
+            unsigned mask = (unsigned)(d - 1);
+            r = with_bits(r, a->zeros & mask, a->ones & mask);
+        }
+    }
+    return r;
+}
+
+static TackyBinaryOp negate_relation(TackyBinaryOp op) {
+    switch (op) {
+        case TACKY_BIN_EQUAL: return TACKY_BIN_NOT_EQUAL;
+        case TACKY_BIN_NOT_EQUAL: return TACKY_BIN_EQUAL;
+        case TACKY_BIN_LESS: return TACKY_BIN_GREATER_EQUAL;
+        case TACKY_BIN_LESS_EQUAL: return TACKY_BIN_GREATER;
+        case TACKY_BIN_GREATER: return TACKY_BIN_LESS_EQUAL;
+        case TACKY_BIN_GREATER_EQUAL: return TACKY_BIN_LESS;
+        default: return op;
+    }
+}
+
+bool range_compare(TackyBinaryOp op, const ValueRange *a, const ValueRange *b, int *out) {
+    switch (op) {
+        case TACKY_BIN_EQUAL:
+        case TACKY_BIN_NOT_EQUAL: {
+            bool eq = op == TACKY_BIN_EQUAL;
+            if (range_is_const(a) && range_is_const(b) && a->lo == b->lo) {
+                *out = eq;
+                return true;
+            }
+            if (a->hi < b->lo || b->hi < a->lo || (a->ones & b->zeros) || (a->zeros & b->ones)) {
+                *out = !eq;
+                return true;
+            }
+            return false;
+        }
+        case TACKY_BIN_LESS:
+            if (a->hi < b->lo) { *out = 1; return true; }
+            if (a->lo >= b->hi) { *out = 0; return true; }
+            return false;
+        case TACKY_BIN_LESS_EQUAL:
+            if (a->hi <= b->lo) { *out = 1; return true; }
+            if (a->lo > b->hi) { *out = 0; return true; }
+            return false;
+        case TACKY_BIN_GREATER:
+            return range_compare(TACKY_BIN_LESS, b, a, out);
+        case TACKY_BIN_GREATER_EQUAL:
+            return range_compare(TACKY_BIN_LESS_EQUAL, b, a, out);
+        default:
+            return false;
+    }
+}
+
+static ValueRange compare_range(TackyBinaryOp op, const ValueRange *a, const ValueRange *b) {
+    int result;
+    if (range_compare(op, a, b, &result)) return range_const(result);
+    ValueRange r = { 0, 1, ~1u, 0 };
+    return r;
+}
+
+static ValueRange unary_range(TackyUnaryOp op, const ValueRange *a) {
+    switch (op) {
+        case TACKY_UN_NEGATE: {
+            // -a is ~a + 1; -INT_MIN wraps to itself.
+            unsigned zeros, ones;
+            ValueRange not_a = { ~a->hi, ~a->lo, a->ones, a->zeros };
+            add_bits(&not_a, ~0u, 0, 1, &zeros, &ones);
+            ValueRange r = a->lo == INT_MIN ? (a->hi == INT_MIN ? range_const(INT_MIN) : range_full())
+                                            : from_bounds(-(int64_t)a->hi, -(int64_t)a->lo);
+            return with_bits(r, zeros, ones);
+        }
+        case TACKY_UN_COMPLEMENT: {
+            ValueRange r = { ~a->hi, ~a->lo, a->ones, a->zeros };
+            return r;
+        }
+        case TACKY_UN_NOT: {
+            ValueRange zero = range_const(0);
+            return compare_range(TACKY_BIN_EQUAL, a, &zero);
+        }
+        default:
+            return range_full();
+    }
+}
+
+static ValueRange binary_range(TackyBinaryOp op, const ValueRange *a, const ValueRange *b) {
+    switch (op) {
+        case TACKY_BIN_ADD: return add_range(a, b);
+        case TACKY_BIN_SUB: return sub_range(a, b);
+        case TACKY_BIN_MUL: return mul_range(a, b);
+        case TACKY_BIN_DIV: return div_range(a, b);
+        case TACKY_BIN_REM: return rem_range(a, b);
+        default:
+            if (tacky_is_relational(op)) return compare_range(op, a, b);
+            return range_full();
+    }
+}
+
+static void exclude(ValueRange *r, int value) {
+    if (r->lo == value && r->hi == value) *r = range_empty();
+    else if (r->lo == value) r->lo++;
+    else if (r->hi == value) r->hi--;
+}
+
+// Narrows a and b to the values for which a op b holds. False if there
+// are none.
+static bool assume(TackyBinaryOp op, ValueRange *a, ValueRange *b) {
+    ValueRange na = *a, nb = *b;
+    switch (op) {
+        case TACKY_BIN_EQUAL:
+            na = nb = intersect(a, b);
+            break;
+        case TACKY_BIN_NOT_EQUAL:
+            // Only a constant on the other side cuts an end off the interval.
+            if (range_is_const(b)) exclude(&na, b->lo);
+            if (range_is_const(a)) exclude(&nb, a->lo);
+            break;
+        case TACKY_BIN_LESS:
+            if (b->hi == INT_MIN || a->lo == INT_MAX) return false;
+            if (b->hi - 1 < na.hi) na.hi = b->hi - 1;
+            if (a->lo + 1 > nb.lo) nb.lo = a->lo + 1;
+            break;
+        case TACKY_BIN_LESS_EQUAL:
+            if (b->hi < na.hi) na.hi = b->hi;
+            if (a->lo > nb.lo) nb.lo = a->lo;
+            break;
+        case TACKY_BIN_GREATER:
+            return assume(TACKY_BIN_LESS, b, a);
+        case TACKY_BIN_GREATER_EQUAL:
+            return assume(TACKY_BIN_LESS_EQUAL, b, a);
+        default:
+            return true;
+    }
+    normalize(&na);
+    normalize(&nb);
+    if (is_empty(&na) || is_empty(&nb)) return false;
+    *a = na;
+    *b = nb;
+    return true;
+}
+
+// Working state. A block's entry state holds ranges only for the variables
+// live into it, listed in block_vars; any other is written there before it
+// is read. While a block runs, cur holds the range of every variable it has
+// loaded or written, valid while stamp equals epoch.
+typedef struct {
+    const Cfg *cfg;
+    const TackyFunction *fn;
+    int *var_start;         // block b's live-in variables are
+    int *block_vars;        //   block_vars[var_start[b] .. var_start[b + 1])
+    ValueRange *in;         // their ranges at entry, parallel to block_vars
+    bool *reached;
+    ValueRange *next;       // in and reached of the next narrowing round
+    bool *next_reached;
+    int *updates;           // times each block's entry state has changed
+    bool *dirty;            // entry state changed since the block last ran
+    ValueRange *cur;
+    int *stamp;
+    int epoch;
+    ValueRange *refined;    // ranges a branch narrows along one edge, valid
+    int *refined_stamp;     //   while refined_stamp equals edge_epoch
+    int edge_epoch;
+    ValueRange *edge;       // entry state of the successor along one edge
+} RangeState;
+
+static ValueRange *block_state(const RangeState *st, ValueRange *states, int block) {
+    return states + st->var_start[block];
+}
+
+static int block_var_count(const RangeState *st, int block) {
+    return st->var_start[block + 1] - st->var_start[block];
+}
+
+static ValueRange read_var(const RangeState *st, int var) {
+    if (st->stamp[var] == st->epoch) return st->cur[var];
+    return range_full();
+}
+
+static ValueRange read_val(const RangeState *st, TackyVal v) {
+    if (v.kind == TACKY_VAL_CONSTANT) return range_const(v.value);
+    return read_var(st, v.value);
+}
+
+// Ranges of the operands ins reads; full for the ones it does not.
+static void read_operands(const RangeState *st, const TackyInstr *ins, ValueRange *a, ValueRange *b) {
+    *a = *b = range_full();
+    switch ((TackyInstrKind)ins->kind) {
+        case TACKY_INSTR_BINARY:
+            *b = read_val(st, ins->src2);
+            // fall through
+        case TACKY_INSTR_UNARY:
+        case TACKY_INSTR_COPY:
+        case TACKY_INSTR_RETURN:
+        case TACKY_INSTR_JUMP_IF_ZERO:
+        case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+            *a = read_val(st, ins->src1);
+            break;
+        default:
+            break;
+    }
+}
+
+static void write_var(RangeState *st, int var, ValueRange r) {
+    st->cur[var] = r;
+    st->stamp[var] = st->epoch;
+}
+
+// Runs block b from entry state in, leaving its exit state in cur.
+// operands, if not NULL, receives the ranges each instruction reads.
+static void walk_block(RangeState *st, int b, const ValueRange *in, ValueRange *operands) {
+    const BasicBlock *blk = &st->cfg->blocks[b];
+    const int *vars = st->block_vars + st->var_start[b];
+    st->epoch++;
+    for (int k = 0; k < block_var_count(st, b); k++) write_var(st, vars[k], in[k]);
+    for (int i = blk->start; i < blk->end; i++) {
+        const TackyInstr *ins = &st->fn->body[i];
+        ValueRange a, c;
+        read_operands(st, ins, &a, &c);
+        if (operands) {
+            operands[2 * i] = a;
+            operands[2 * i + 1] = c;
+        }
+        switch ((TackyInstrKind)ins->kind) {
+            case TACKY_INSTR_UNARY: write_var(st, ins->dst, unary_range((TackyUnaryOp)ins->op, &a)); break;
+            case TACKY_INSTR_BINARY: write_var(st, ins->dst, binary_range((TackyBinaryOp)ins->op, &a, &c)); break;
+            case TACKY_INSTR_COPY: write_var(st, ins->dst, a); break;
+            default: break;
+        }
+    }
+}
+
+static bool reads_var(const TackyInstr *ins, int var) {
+    int uses[2];
+    int n = tacky_instr_uses(ins, uses);
+    for (int k = 0; k < n; k++) {
+        if (uses[k] == var) return true;
+    }
+    return false;
+}
+
+// The instruction in [start, end) that last writes var, if none of its
+// operands is var or is written after it: they still hold at end what
+// it read.
+static const TackyInstr *last_def(const TackyFunction *fn, int start, int end, int var) {
+    int at = end - 1;
+    while (at >= start && tacky_instr_def(&fn->body[at]) != var) at--;
+    if (at < start) return NULL;
+    const TackyInstr *def = &fn->body[at];
+    if (reads_var(def, var)) return NULL;
+    for (int i = at + 1; i < end; i++) {
+        int d = tacky_instr_def(&fn->body[i]);
+        if (d >= 0 && reads_var(def, d)) return NULL;
+    }
+    return def;
+}
+
+static void refine_edge(RangeState *st, TackyVal v, const ValueRange *r) {
+    if (v.kind != TACKY_VAL_VAR) return;
+    st->refined[v.value] = *r;
+    st->refined_stamp[v.value] = st->edge_epoch;
+}
+
+// Narrows the ranges along the edge of block b's conditional jump where
+// its condition is zero (or not). False if the edge cannot be taken. A
+// condition computed in the block by a comparison or ! also narrows the
+// compared values.
+static bool assume_branch(RangeState *st, int b, int last, bool zero) {
+    const TackyInstr *jump = &st->fn->body[last];
+    ValueRange c = read_val(st, jump->src1);
+    ValueRange zero_range = range_const(0);
+    if (zero) {
+        c = intersect(&c, &zero_range);
+    } else if (!assume(TACKY_BIN_NOT_EQUAL, &c, &zero_range)) {
+        return false;
+    }
+    if (is_empty(&c)) return false;
+    refine_edge(st, jump->src1, &c);
+    if (jump->src1.kind != TACKY_VAL_VAR) return true;
+
+    const TackyInstr *def = last_def(st->fn, st->cfg->blocks[b].start, last, jump->src1.value);
+    if (!def) return true;
+    ValueRange x, y;
+    read_operands(st, def, &x, &y);
+    if (def->kind == TACKY_INSTR_BINARY && tacky_is_relational((TackyBinaryOp)def->op)) {
+        TackyBinaryOp op = zero ? negate_relation((TackyBinaryOp)def->op) : (TackyBinaryOp)def->op;
+        if (!assume(op, &x, &y)) return false;
+        if (def->src1.kind == TACKY_VAL_VAR && def->src2.kind == TACKY_VAL_VAR && def->src1.value == def->src2.value) {
+            x = intersect(&x, &y);
+            if (is_empty(&x)) return false;
+        }
+        refine_edge(st, def->src2, &y);
+        refine_edge(st, def->src1, &x);
+    } else if (def->kind == TACKY_INSTR_UNARY && def->op == TACKY_UN_NOT) {
+        // !x is zero exactly when x is not.
+        if (!zero) x = intersect(&x, &zero_range);
+        else if (!assume(TACKY_BIN_NOT_EQUAL, &x, &zero_range)) return false;
+        if (is_empty(&x)) return false;
+        refine_edge(st, def->src1, &x);
+    }
+    return true;
+}
+
+// Joins edge into the entry state of block b in states; widens once the
+// block has changed often enough. True if the state changed.
+static bool merge(RangeState *st, int b, ValueRange *states, bool *reached, bool widening) {
+    ValueRange *dst = block_state(st, states, b);
+    int count = block_var_count(st, b);
+    if (!reached[b]) {
+        memcpy(dst, st->edge, (size_t)count * sizeof(ValueRange));
+        reached[b] = true;
+        st->dirty[b] = true;
+        return true;
+    }
+    bool changed = false;
+    bool wide = widening && st->updates[b] >= RANGE_WIDEN_AFTER;
+    for (int k = 0; k < count; k++) {
+        if (contains(&dst[k], &st->edge[k])) continue;
+        ValueRange r = join(&dst[k], &st->edge[k]);
+        if (wide) r = widen(&dst[k], r);
+        if (!same_range(&r, &dst[k])) {
+            dst[k] = r;
+            changed = true;
+        }
+    }
+    if (changed) {
+        st->dirty[b] = true;
+        if (widening) st->updates[b]++;
+    }
+    return changed;
+}
+
+static bool ends_in_branch(const RangeState *st, int b, int last) {
+    return st->cfg->blocks[b].succ_count == 2 && last >= 0 &&
+           (st->fn->body[last].kind == TACKY_INSTR_JUMP_IF_ZERO ||
+            st->fn->body[last].kind == TACKY_INSTR_JUMP_IF_NOT_ZERO);
+}
+
+// Fills st->edge with the entry state block b's edge to succ[s] gives,
+// after walk_block has run b. False if the edge cannot be taken.
+static bool edge_state(RangeState *st, int b, int s) {
+    st->edge_epoch++;
+    int last = cfg_last_instr(st->cfg, b);
+    if (ends_in_branch(st, b, last)) {
+        // succ[1] is the jump target.
+        bool zero = (s == 1) == (st->fn->body[last].kind == TACKY_INSTR_JUMP_IF_ZERO);
+        if (!assume_branch(st, b, last, zero)) return false;
+    }
+    int succ = st->cfg->blocks[b].succ[s];
+    const int *vars = st->block_vars + st->var_start[succ];
+    for (int k = 0; k < block_var_count(st, succ); k++) {
+        int v = vars[k];
+        st->edge[k] = st->refined_stamp[v] == st->edge_epoch ? st->refined[v] : read_var(st, v);
+    }
+    return true;
+}
+
+// Runs block b from its entry state and merges what leaves it along each
+// executable edge into its successors. True if any of them changed.
+static bool propagate_block(RangeState *st, int b) {
+    const BasicBlock *blk = &st->cfg->blocks[b];
+    walk_block(st, b, block_state(st, st->in, b), NULL);
+    bool changed = false;
+    for (int s = 0; s < blk->succ_count; s++) {
+        if (edge_state(st, b, s)) changed |= merge(st, blk->succ[s], st->in, st->reached, true);
+    }
+    return changed;
+}
+
+static void entry_state(RangeState *st, ValueRange *states, bool *reached) {
+    ValueRange *entry = block_state(st, states, 0);
+    for (int k = 0; k < block_var_count(st, 0); k++) entry[k] = range_full();
+    reached[0] = true;
+}
+
+// One narrowing round: recomputes every entry state from the edges into
+// the block, in reverse postorder, so predecessors already visited give
+// their new state and back edges the previous one.
+static void narrow(RangeState *st) {
+    const Cfg *cfg = st->cfg;
+    memset(st->next_reached, 0, (size_t)cfg->block_count * sizeof(bool));
+    entry_state(st, st->next, st->next_reached);
+    for (int r = 0; r < cfg->rpo_count; r++) {
+        int b = cfg->rpo[r];
+        const BasicBlock *blk = &cfg->blocks[b];
+        for (int k = 0; k < blk->pred_count; k++) {
+            int p = cfg->preds[blk->pred_start + k];
+            int pr = cfg->blocks[p].rpo_index;
+            const ValueRange *in;
+            if (pr < 0) continue;
+            if (pr < r) {
+                if (!st->next_reached[p]) continue;
+                in = block_state(st, st->next, p);
+            } else {
+                if (!st->reached[p]) continue;
+                in = block_state(st, st->in, p);
+            }
+            walk_block(st, p, in, NULL);
+            const BasicBlock *pb = &cfg->blocks[p];
+            for (int s = 0; s < pb->succ_count; s++) {
+                if (pb->succ[s] == b && edge_state(st, p, s)) merge(st, b, st->next, st->next_reached, false);
+            }
+        }
+    }
+    ValueRange *t = st->in; st->in = st->next; st->next = t;
+    bool *tr = st->reached; st->reached = st->next_reached; st->next_reached = tr;
+}
+
+// Lists the variables live into each block. Returns the longest list.
+static int find_block_vars(RangeState *st, const Liveness *live) {
+    int blocks = st->cfg->block_count;
+    int longest = 0;
+    st->var_start = (int *)xmalloc((size_t)(blocks + 1) * sizeof(int));
+    st->var_start[0] = 0;
+    for (int b = 0; b < blocks; b++) {
+        const BitWord *set = liveness_in(live, b);
+        int count = 0;
+        for (int w = 0; w < live->words; w++) count += __builtin_popcountll(set[w]);
+        if (count > longest) longest = count;
+        st->var_start[b + 1] = st->var_start[b] + count;
+    }
+    st->block_vars = (int *)xmalloc((size_t)st->var_start[blocks] * sizeof(int));
+    for (int b = 0; b < blocks; b++) {
+        const BitWord *set = liveness_in(live, b);
+        int *out = st->block_vars + st->var_start[b];
+        for (int w = 0; w < live->words; w++) {
+            for (BitWord bits = set[w]; bits; bits &= bits - 1) *out++ = w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return longest;
+}
+
+void ranges_compute(RangeAnalysis *ra, const Cfg *cfg) {
+    const TackyFunction *fn = cfg->fn;
+    size_t operand_count = 2 * (size_t)fn->instr_count;
+    if (operand_count > ra->operand_capacity) {
+        free(ra->operands);
+        ra->operands = (ValueRange *)xcalloc(operand_count, sizeof(ValueRange));
+        ra->operand_capacity = operand_count;
+    }
+    if (cfg->block_count > ra->block_capacity) {
+        free(ra->reached);
+        ra->reached = (bool *)xcalloc((size_t)cfg->block_count, sizeof(bool));
+        ra->block_capacity = cfg->block_count;
+    }
+    ra->instr_count = fn->instr_count;
+
+    RangeState st;
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+    st.fn = fn;
+    size_t vars = (size_t)fn->var_count;
+    size_t blocks = (size_t)cfg->block_count;
+    Liveness live = {0};
+    liveness_compute(&live, cfg);
+    int longest = find_block_vars(&st, &live);
+    liveness_free(&live);
+    size_t states = (size_t)st.var_start[blocks];
+    st.in = (ValueRange *)xcalloc(states, sizeof(ValueRange));
+    st.next = (ValueRange *)xcalloc(states, sizeof(ValueRange));
+    st.reached = (bool *)xcalloc(blocks, sizeof(bool));
+    st.next_reached = (bool *)xcalloc(blocks, sizeof(bool));
+    st.updates = (int *)xcalloc(blocks, sizeof(int));
+    st.dirty = (bool *)xcalloc(blocks, sizeof(bool));
+    st.cur = (ValueRange *)xcalloc(vars, sizeof(ValueRange));
+    st.stamp = (int *)xcalloc(vars, sizeof(int));
+    st.refined = (ValueRange *)xcalloc(vars, sizeof(ValueRange));
+    st.refined_stamp = (int *)xcalloc(vars, sizeof(int));
+    st.edge = (ValueRange *)xcalloc((size_t)longest, sizeof(ValueRange));
+
+    entry_state(&st, st.in, st.reached);
+    st.dirty[0] = true;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = 0; r < cfg->rpo_count; r++) {
+            int b = cfg->rpo[r];
+            if (!st.dirty[b]) continue;
+            st.dirty[b] = false;
+            changed |= propagate_block(&st, b);
+        }
+    }
+    for (int round = 0; round < RANGE_NARROW_ROUNDS; round++) narrow(&st);
+
+    for (int i = 0; i < 2 * fn->instr_count; i++) ra->operands[i] = range_full();
+    for (int b = 0; b < cfg->block_count; b++) {
+        ra->reached[b] = st.reached[b];
+        if (st.reached[b]) walk_block(&st, b, block_state(&st, st.in, b), ra->operands);
+    }
+
+    free(st.var_start);
+    free(st.block_vars);
+    free(st.in);
+    free(st.next);
+    free(st.reached);
+    free(st.next_reached);
+    free(st.updates);
+    free(st.dirty);
+    free(st.cur);
+    free(st.stamp);
+    free(st.refined);
+    free(st.refined_stamp);
+    free(st.edge);
+}
+
+void ranges_free(RangeAnalysis *ra) {
+    free(ra->operands);
+    free(ra->reached);
+    ra->operands = NULL;
+    ra->reached = NULL;
+    ra->operand_capacity = 0;
+    ra->block_capacity = 0;
+}
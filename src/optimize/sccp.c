@@ -0,0 +1,340 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lattice of a variable's value: not yet known to be computed, one
+// constant, or varying.
+enum { LAT_TOP, LAT_CONST, LAT_BOTTOM };
+
+typedef struct {
+    unsigned char state;
+    int value;
+} Lattice;
+
+// Sparse conditional constant propagation (Wegman and Zadeck). Values flow
+// along def-use chains and only through CFG edges already shown to be
+// executable, so a constant condition keeps the branch it rules out from
+// contributing to phis below it.
+typedef struct {
+    SsaForm *ssa;
+    int var_count;
+    Lattice *lat;
+    int *use_start;     // uses of v: uses[use_start[v] .. use_start[v + 1])
+    int *uses;          //   instruction index, or -(phi + 1) for a phi
+    int *instr_block;
+    unsigned char *block_seen;
+    unsigned char *edge_seen;   // two per block: fall-through/first, jump
+    int *edge_work;     // pairs (from, to)
+    int edge_top;
+    int edge_capacity;
+    int *var_work;
+    int var_top;
+    unsigned char *var_queued;
+} Sccp;
+
+static void add_use(Sccp *sc, int var, int site, bool fill, int *pos) {
+    if (var < 0 || var >= sc->var_count) return;
+    if (fill) sc->uses[pos[var]++] = site;
+    else sc->use_start[var + 1]++;
+}
+
+// Def-use chains in compressed rows; variables nothing defines (values on
+// entry) start out varying.
+static void build_uses(Sccp *sc) {
+    SsaForm *ssa = sc->ssa;
+    const TackyFunction *fn = ssa->fn;
+    int *pos = NULL;
+    sc->use_start = (int *)xcalloc((size_t)sc->var_count + 1, sizeof(int));
+    unsigned char *defined = (unsigned char *)xcalloc((size_t)sc->var_count, 1);
+    for (int pass = 0; pass < 2; pass++) {
+        bool fill = pass == 1;
+        if (fill) {
+            for (int v = 0; v < sc->var_count; v++) sc->use_start[v + 1] += sc->use_start[v];
+            sc->uses = (int *)xmalloc((size_t)sc->use_start[sc->var_count] * sizeof(int));
+            pos = (int *)xmalloc((size_t)sc->var_count * sizeof(int));
+            memcpy(pos, sc->use_start, (size_t)sc->var_count * sizeof(int));
+        }
+        for (int i = 0; i < fn->instr_count; i++) {
+            int used[2];
+            int n = tacky_instr_uses(&fn->body[i], used);
+            for (int k = 0; k < n; k++) add_use(sc, used[k], i, fill, pos);
+            int def = tacky_instr_def(&fn->body[i]);
+            if (def >= 0) defined[def] = 1;
+        }
+        for (int p = 0; p < ssa->phi_count; p++) {
+            const SsaPhi *phi = &ssa->phis[p];
+            if (phi->dst < 0) continue;
+            defined[phi->dst] = 1;
+            for (int k = 0; k < phi->arg_count; k++) {
+                const TackyVal *v = &ssa->args[phi->arg_start + k].value;
+                if (v->kind == TACKY_VAL_VAR) add_use(sc, v->value, -(p + 1), fill, pos);
+            }
+        }
+    }
+    for (int v = 0; v < sc->var_count; v++) {
+        if (!defined[v]) sc->lat[v].state = LAT_BOTTOM;
+    }
+    free(defined);
+    free(pos);
+}
+
+static Lattice value_of(const Sccp *sc, TackyVal v) {
+    Lattice l;
+    if (v.kind == TACKY_VAL_CONSTANT) {
+        l.state = LAT_CONST;
+        l.value = v.value;
+        return l;
+    }
+    if (v.value < 0 || v.value >= sc->var_count) {
+        l.state = LAT_BOTTOM;
+        l.value = 0;
+        return l;
+    }
+    return sc->lat[v.value];
+}
+
+static Lattice meet(Lattice a, Lattice b) {
+    if (a.state == LAT_TOP) return b;
+    if (b.state == LAT_TOP) return a;
+    if (a.state == LAT_CONST && b.state == LAT_CONST && a.value == b.value) return a;
+    a.state = LAT_BOTTOM;
+    return a;
+}
+
+static void lower_to(Sccp *sc, int var, Lattice l) {
+    if (var < 0 || var >= sc->var_count) return;
+    Lattice *cur = &sc->lat[var];
+    Lattice m = meet(*cur, l);
+    if (m.state == cur->state && (m.state != LAT_CONST || m.value == cur->value)) return;
+    *cur = m;
+    if (!sc->var_queued[var]) {
+        sc->var_queued[var] = 1;
+        sc->var_work[sc->var_top++] = var;
+    }
+}
+
+static void mark_edge(Sccp *sc, int from, int to) {
+    const BasicBlock *blk = &sc->ssa->cfg.blocks[from];
+    for (int s = 0; s < blk->succ_count; s++) {
+        if (blk->succ[s] != to || sc->edge_seen[2 * from + s]) continue;
+        sc->edge_seen[2 * from + s] = 1;
+        if (sc->edge_top + 2 > sc->edge_capacity) {
+            sc->edge_capacity = sc->edge_capacity ? sc->edge_capacity * 2 : 64;
+            sc->edge_work = (int *)xrealloc(sc->edge_work, (size_t)sc->edge_capacity * sizeof(int));
+        }
+        sc->edge_work[sc->edge_top++] = from;
+        sc->edge_work[sc->edge_top++] = to;
+    }
+}
+
+static bool edge_executable(const Sccp *sc, int from, int to) {
+    const BasicBlock *blk = &sc->ssa->cfg.blocks[from];
+    for (int s = 0; s < blk->succ_count; s++) {
+        if (blk->succ[s] == to && sc->edge_seen[2 * from + s]) return true;
+    }
+    return false;
+}
+
+static void visit_phi(Sccp *sc, int p) {
+    const SsaPhi *phi = &sc->ssa->phis[p];
+    if (phi->dst < 0) return;
+    Lattice l = { LAT_TOP, 0 };
+    for (int k = 0; k < phi->arg_count; k++) {
+        const SsaPhiArg *arg = &sc->ssa->args[phi->arg_start + k];
+        if (edge_executable(sc, arg->pred, phi->block)) l = meet(l, value_of(sc, arg->value));
+    }
+    lower_to(sc, phi->dst, l);
+}
+
+static Lattice eval_binary(const TackyInstr *ins, Lattice a, Lattice b) {
+    Lattice r = { LAT_BOTTOM, 0 };
+    bool zero_a = a.state == LAT_CONST && a.value == 0;
+    bool zero_b = b.state == LAT_CONST && b.value == 0;
+    if (ins->op == TACKY_BIN_MUL && (zero_a || zero_b)) {
+        r.state = LAT_CONST;
+        return r;
+    }
+    if (a.state == LAT_BOTTOM || b.state == LAT_BOTTOM) return r;
+    if (a.state == LAT_TOP || b.state == LAT_TOP) {
+        r.state = LAT_TOP;
+        return r;
+    }
+    if (tacky_eval_binary((TackyBinaryOp)ins->op, a.value, b.value, &r.value)) r.state = LAT_CONST;
+    return r;
+}
+
+// Block control leaves b for when it does not jump.
+static int fallthrough_block(const Sccp *sc, int b) {
+    return b + 1 < sc->ssa->cfg.block_count ? b + 1 : -1;
+}
+
+static void visit_instr(Sccp *sc, int i) {
+    const TackyFunction *fn = sc->ssa->fn;
+    const Cfg *cfg = &sc->ssa->cfg;
+    const TackyInstr *ins = &fn->body[i];
+    int b = sc->instr_block[i];
+    Lattice r;
+    switch ((TackyInstrKind)ins->kind) {
+        case TACKY_INSTR_COPY:
+            lower_to(sc, ins->dst, value_of(sc, ins->src1));
+            break;
+        case TACKY_INSTR_UNARY:
+            r = value_of(sc, ins->src1);
+            if (r.state == LAT_CONST && !tacky_eval_unary((TackyUnaryOp)ins->op, r.value, &r.value)) {
+                r.state = LAT_BOTTOM;
+            }
+            lower_to(sc, ins->dst, r);
+            break;
+        case TACKY_INSTR_BINARY:
+            lower_to(sc, ins->dst, eval_binary(ins, value_of(sc, ins->src1), value_of(sc, ins->src2)));
+            break;
+        case TACKY_INSTR_JUMP:
+            mark_edge(sc, b, cfg_block_of_label(cfg, ins->label));
+            break;
+        case TACKY_INSTR_JUMP_IF_ZERO:
+        case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+            r = value_of(sc, ins->src1);
+            if (r.state == LAT_TOP) break;
+            if (r.state == LAT_CONST) {
+                bool taken = (r.value == 0) == (ins->kind == TACKY_INSTR_JUMP_IF_ZERO);
+                mark_edge(sc, b, taken ? cfg_block_of_label(cfg, ins->label) : fallthrough_block(sc, b));
+            } else {
+                mark_edge(sc, b, cfg_block_of_label(cfg, ins->label));
+                mark_edge(sc, b, fallthrough_block(sc, b));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void visit_block(Sccp *sc, int b) {
+    const BasicBlock *blk = &sc->ssa->cfg.blocks[b];
+    for (int p = sc->ssa->phi_start[b]; p < sc->ssa->phi_start[b + 1]; p++) visit_phi(sc, p);
+    for (int i = blk->start; i < blk->end; i++) visit_instr(sc, i);
+    int last = cfg_last_instr(&sc->ssa->cfg, b);
+    unsigned char kind = last >= 0 ? sc->ssa->fn->body[last].kind : TACKY_INSTR_NOP;
+    if (kind != TACKY_INSTR_JUMP && kind != TACKY_INSTR_RETURN &&
+        kind != TACKY_INSTR_JUMP_IF_ZERO && kind != TACKY_INSTR_JUMP_IF_NOT_ZERO) {
+        mark_edge(sc, b, fallthrough_block(sc, b));
+    }
+}
+
+static void propagate(Sccp *sc) {
+    int entry = sc->ssa->cfg.rpo[0];
+    sc->block_seen[entry] = 1;
+    visit_block(sc, entry);
+    while (sc->edge_top > 0 || sc->var_top > 0) {
+        if (sc->edge_top > 0) {
+            int to = sc->edge_work[--sc->edge_top];
+            sc->edge_top--;
+            if (!sc->block_seen[to]) {
+                sc->block_seen[to] = 1;
+                visit_block(sc, to);
+            } else {
+                for (int p = sc->ssa->phi_start[to]; p < sc->ssa->phi_start[to + 1]; p++) visit_phi(sc, p);
+            }
+            continue;
+        }
+        int var = sc->var_work[--sc->var_top];
+        sc->var_queued[var] = 0;
+        for (int k = sc->use_start[var]; k < sc->use_start[var + 1]; k++) {
+            int site = sc->uses[k];
+            if (site < 0) {
+                int p = -site - 1;
+                if (sc->block_seen[sc->ssa->phis[p].block]) visit_phi(sc, p);
+            } else if (sc->block_seen[sc->instr_block[site]]) {
+                visit_instr(sc, site);
+            }
+        }
+    }
+}
+
+static bool substitute(const Sccp *sc, TackyVal *v) {
+    if (v->kind != TACKY_VAL_VAR || v->value >= sc->var_count) return false;
+    const Lattice *l = &sc->lat[v->value];
+    if (l->state != LAT_CONST) return false;
+    v->kind = TACKY_VAL_CONSTANT;
+    v->value = l->value;
+    return true;
+}
+
+static bool is_constant_var(const Sccp *sc, int var) {
+    return var >= 0 && var < sc->var_count && sc->lat[var].state == LAT_CONST;
+}
+
+// Replaces constant variables by their values, deletes their definitions,
+// resolves branches on constants and empties blocks never reached.
+static bool rewrite(Sccp *sc) {
+    SsaForm *ssa = sc->ssa;
+    TackyFunction *fn = ssa->fn;
+    const Cfg *cfg = &ssa->cfg;
+    bool changed = false;
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *blk = &cfg->blocks[b];
+        bool live = sc->block_seen[b];
+        for (int i = blk->start; i < blk->end; i++) {
+            TackyInstr *ins = &fn->body[i];
+            if (ins->kind == TACKY_INSTR_NOP) continue;
+            if (!live || is_constant_var(sc, tacky_instr_def(ins))) {
+                ins->kind = TACKY_INSTR_NOP;
+                changed = true;
+                continue;
+            }
+            changed |= substitute(sc, &ins->src1);
+            if (ins->kind == TACKY_INSTR_BINARY) changed |= substitute(sc, &ins->src2);
+            if ((ins->kind == TACKY_INSTR_JUMP_IF_ZERO || ins->kind == TACKY_INSTR_JUMP_IF_NOT_ZERO) &&
+                ins->src1.kind == TACKY_VAL_CONSTANT) {
+                bool taken = (ins->src1.value == 0) == (ins->kind == TACKY_INSTR_JUMP_IF_ZERO);
+                ins->kind = taken ? TACKY_INSTR_JUMP : TACKY_INSTR_NOP;
+                ins->src1.value = 0;
+                changed = true;
+            }
+        }
+        for (int p = ssa->phi_start[b]; p < ssa->phi_start[b + 1]; p++) {
+            SsaPhi *phi = &ssa->phis[p];
+            if (phi->dst < 0) continue;
+            if (!live || is_constant_var(sc, phi->dst)) {
+                phi->dst = -1;
+                changed = true;
+                continue;
+            }
+            for (int k = 0; k < phi->arg_count; k++) changed |= substitute(sc, &ssa->args[phi->arg_start + k].value);
+        }
+    }
+    return changed;
+}
+
+bool propagate_constants(SsaForm *ssa) {
+    const Cfg *cfg = &ssa->cfg;
+    Sccp sc = {0};
+    sc.ssa = ssa;
+    sc.var_count = ssa->fn->var_count;
+    sc.lat = (Lattice *)xcalloc((size_t)sc.var_count, sizeof(Lattice));
+    sc.var_work = (int *)xmalloc((size_t)sc.var_count * sizeof(int));
+    sc.var_queued = (unsigned char *)xcalloc((size_t)sc.var_count, 1);
+    sc.block_seen = (unsigned char *)xcalloc((size_t)cfg->block_count, 1);
+    sc.edge_seen = (unsigned char *)xcalloc((size_t)cfg->block_count * 2, 1);
+    sc.instr_block = (int *)xmalloc((size_t)ssa->fn->instr_count * sizeof(int));
+    for (int b = 0; b < cfg->block_count; b++) {
+        for (int i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) sc.instr_block[i] = b;
+    }
+    build_uses(&sc);
+    propagate(&sc);
+    bool changed = rewrite(&sc);
+
+    free(sc.lat);
+    free(sc.use_start);
+    free(sc.uses);
+    free(sc.instr_block);
+    free(sc.block_seen);
+    free(sc.edge_seen);
+    free(sc.edge_work);
+    free(sc.var_work);
+    free(sc.var_queued);
+    return changed;
+}
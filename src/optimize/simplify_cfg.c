@@ -0,0 +1,175 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/cfg.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static bool is_cond_jump(unsigned char kind) {
+    return kind == TACKY_INSTR_JUMP_IF_ZERO || kind == TACKY_INSTR_JUMP_IF_NOT_ZERO;
+}
+
+static bool same_val(TackyVal a, TackyVal b) {
+    return a.kind == b.kind && a.value == b.value;
+}
+
+// First instruction of the block that is neither a label nor a NOP, or -1.
+static int first_body_instr(const Cfg *cfg, int block) {
+    const BasicBlock *b = &cfg->blocks[block];
+    for (int i = b->start; i < b->end; i++) {
+        unsigned char kind = cfg->fn->body[i].kind;
+        if (kind != TACKY_INSTR_NOP && kind != TACKY_INSTR_LABEL) return i;
+    }
+    return -1;
+}
+
+// Label a block falling out of `block` arrives at, or -1 when the next
+// block does not start with one.
+static int fallthrough_label(const Cfg *cfg, int block) {
+    if (block + 1 >= cfg->block_count) return -1;
+    const BasicBlock *next = &cfg->blocks[block + 1];
+    for (int i = next->start; i < next->end; i++) {
+        const TackyInstr *ins = &cfg->fn->body[i];
+        if (ins->kind == TACKY_INSTR_LABEL) return ins->label;
+        if (ins->kind != TACKY_INSTR_NOP) return -1;
+    }
+    return -1;
+}
+
+// Follows the chain of blocks a jump lands in for as long as they only
+// pass control on: empty blocks, unconditional jumps, and conditional
+// jumps on the same value, whose outcome is then already known.
+static int thread_target(const Cfg *cfg, const TackyInstr *jump, int label) {
+    for (int steps = 0; steps < cfg->block_count; steps++) {
+        int b = cfg_block_of_label(cfg, label);
+        if (b < 0) return label;
+        int i = first_body_instr(cfg, b);
+        int next = -1;
+        if (i < 0) {
+            next = fallthrough_label(cfg, b);
+        } else {
+            const TackyInstr *ins = &cfg->fn->body[i];
+            if (ins->kind == TACKY_INSTR_JUMP) {
+                next = ins->label;
+            } else if (is_cond_jump(jump->kind) && is_cond_jump(ins->kind) && same_val(ins->src1, jump->src1)) {
+                next = ins->kind == jump->kind ? ins->label : fallthrough_label(cfg, b);
+            }
+        }
+        if (next < 0 || next == label) return label;
+        label = next;
+    }
+    return label;
+}
+
+// True if control falling out of instruction `at` reaches `label` without
+// executing anything: only NOPs and labels lie in between.
+static bool falls_into(const TackyFunction *fn, int at, int label) {
+    for (int i = at + 1; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (ins->kind == TACKY_INSTR_NOP) continue;
+        if (ins->kind != TACKY_INSTR_LABEL) return false;
+        if (ins->label == label) return true;
+    }
+    return false;
+}
+
+// "JumpIfZero v -> L; Jump M; Label L" becomes "JumpIfNotZero v -> M" when
+// nothing else enters the block holding the unconditional jump.
+static bool invert_over_jump(const Cfg *cfg, int block, TackyInstr *ins) {
+    if (block + 1 >= cfg->block_count) return false;
+    const BasicBlock *next = &cfg->blocks[block + 1];
+    int jump = cfg_last_instr(cfg, block + 1);
+    if (jump < 0 || cfg->fn->body[jump].kind != TACKY_INSTR_JUMP) return false;
+    for (int i = next->start; i < jump; i++) {
+        if (cfg->fn->body[i].kind != TACKY_INSTR_NOP) return false;
+    }
+    if (!falls_into(cfg->fn, jump, ins->label)) return false;
+    ins->kind = ins->kind == TACKY_INSTR_JUMP_IF_ZERO ? TACKY_INSTR_JUMP_IF_NOT_ZERO : TACKY_INSTR_JUMP_IF_ZERO;
+    ins->label = cfg->fn->body[jump].label;
+    cfg->fn->body[jump].kind = TACKY_INSTR_NOP;
+    return true;
+}
+
+static bool remove_unreachable(const Cfg *cfg) {
+    bool changed = false;
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *blk = &cfg->blocks[b];
+        if (blk->rpo_index >= 0) continue;
+        for (int i = blk->start; i < blk->end; i++) {
+            if (cfg->fn->body[i].kind == TACKY_INSTR_NOP) continue;
+            cfg->fn->body[i].kind = TACKY_INSTR_NOP;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool thread_jumps(const Cfg *cfg) {
+    TackyFunction *fn = cfg->fn;
+    bool changed = false;
+    for (int r = 0; r < cfg->rpo_count; r++) {
+        int last = cfg_last_instr(cfg, cfg->rpo[r]);
+        if (last < 0) continue;
+        TackyInstr *ins = &fn->body[last];
+        if (ins->kind != TACKY_INSTR_JUMP && !is_cond_jump(ins->kind)) continue;
+
+        int target = thread_target(cfg, ins, ins->label);
+        if (target != ins->label) {
+            ins->label = target;
+            changed = true;
+        }
+        if (falls_into(fn, last, ins->label)) {
+            ins->kind = TACKY_INSTR_NOP;
+            changed = true;
+            continue;
+        }
+        if (is_cond_jump(ins->kind) && invert_over_jump(cfg, cfg->rpo[r], ins)) {
+            changed = true;
+            continue;
+        }
+        // A jump to a lone return becomes the return itself.
+        int b = cfg_block_of_label(cfg, ins->label);
+        int first = b >= 0 ? first_body_instr(cfg, b) : -1;
+        if (ins->kind == TACKY_INSTR_JUMP && first >= 0 && fn->body[first].kind == TACKY_INSTR_RETURN) {
+            *ins = fn->body[first];
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool remove_unused_labels(TackyFunction *fn) {
+    unsigned char *used = (unsigned char *)xcalloc((size_t)fn->label_count + 1, 1);
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (ins->kind == TACKY_INSTR_JUMP || is_cond_jump(ins->kind)) used[ins->label] = 1;
+    }
+    bool changed = false;
+    for (int i = 0; i < fn->instr_count; i++) {
+        TackyInstr *ins = &fn->body[i];
+        if (ins->kind == TACKY_INSTR_LABEL && !used[ins->label]) {
+            ins->kind = TACKY_INSTR_NOP;
+            changed = true;
+        }
+    }
+    free(used);
+    return changed;
+}
+
+// Each round can expose more work for the next: a removed label merges
+// two blocks, a threaded jump can leave a block unreachable.
+bool simplify_cfg(TackyFunction *fn) {
+    if (fn->instr_count == 0) return false;
+    Cfg cfg = {0};
+    bool changed = false;
+    bool round = true;
+    while (round) {
+        cfg_build(&cfg, fn);
+        round = remove_unreachable(&cfg);
+        round |= thread_jumps(&cfg);
+        round |= remove_unused_labels(fn);
+        if (round) tacky_compact(fn);
+        changed |= round;
+    }
+    cfg_free(&cfg);
+    return changed;
+}
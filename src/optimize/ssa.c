@@ -0,0 +1,547 @@
+#include "../../include/optimize/ssa.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static TackyVal var_val(int var) {
+    TackyVal v; v.kind = TACKY_VAL_VAR; v.value = var; return v;
+}
+
+static bool is_cond_jump(unsigned char kind) {
+    return kind == TACKY_INSTR_JUMP_IF_ZERO || kind == TACKY_INSTR_JUMP_IF_NOT_ZERO;
+}
+
+// Gives the entry block no predecessors and drops code that cannot run,
+// then builds the CFG the SSA form is stated over.
+static void prepare_cfg(SsaForm *ssa) {
+    TackyFunction *fn = ssa->fn;
+    cfg_build(&ssa->cfg, fn);
+    ssa->entry_label = -1;
+    if (ssa->cfg.blocks[0].pred_count > 0) {
+        ssa->entry_label = tacky_new_label(fn, TACKY_LABEL_BLOCK);
+        TackyInstr *ins = tacky_insert(fn, 0, 1);
+        ins->kind = TACKY_INSTR_LABEL;
+        ins->label = ssa->entry_label;
+        cfg_build(&ssa->cfg, fn);
+    }
+    bool removed = false;
+    for (int b = 0; b < ssa->cfg.block_count; b++) {
+        const BasicBlock *blk = &ssa->cfg.blocks[b];
+        if (blk->rpo_index >= 0) continue;
+        for (int i = blk->start; i < blk->end; i++) fn->body[i].kind = TACKY_INSTR_NOP;
+        removed = true;
+    }
+    if (removed) cfg_build(&ssa->cfg, fn);
+}
+
+// Blocks defining each variable, in compressed rows; a block appears once
+// per variable however many times it assigns it. def_count counts the
+// defining instructions.
+typedef struct {
+    int *start;
+    int *blocks;
+    int *def_count;
+} DefSites;
+
+static void collect_def_sites(DefSites *ds, const SsaForm *ssa, int vars) {
+    const Cfg *cfg = &ssa->cfg;
+    int *last = (int *)xmalloc((size_t)vars * sizeof(int));
+    ds->start = (int *)xcalloc((size_t)vars + 1, sizeof(int));
+    ds->def_count = (int *)xcalloc((size_t)vars + 1, sizeof(int));
+    for (int pass = 0; pass < 2; pass++) {
+        int *fill = NULL;
+        if (pass == 1) {
+            for (int v = 0; v < vars; v++) ds->start[v + 1] += ds->start[v];
+            ds->blocks = (int *)xmalloc((size_t)ds->start[vars] * sizeof(int));
+            fill = (int *)xmalloc((size_t)vars * sizeof(int));
+            memcpy(fill, ds->start, (size_t)vars * sizeof(int));
+        }
+        for (int v = 0; v < vars; v++) last[v] = -1;
+        for (int b = 0; b < cfg->block_count; b++) {
+            const BasicBlock *blk = &cfg->blocks[b];
+            for (int i = blk->start; i < blk->end; i++) {
+                int v = tacky_instr_def(&ssa->fn->body[i]);
+                if (v < 0) continue;
+                if (pass == 0) ds->def_count[v]++;
+                if (last[v] == b) continue;
+                last[v] = b;
+                if (pass == 0) ds->start[v + 1]++;
+                else ds->blocks[fill[v]++] = b;
+            }
+        }
+        free(fill);
+    }
+    free(last);
+}
+
+typedef struct {
+    int block;
+    int var;
+} PhiSite;
+
+// Iterated dominance frontier of each variable's definitions, keeping only
+// the blocks where the variable is live on entry (pruned SSA).
+static void place_phis(SsaForm *ssa, const DefSites *ds, const Liveness *lv, int vars) {
+    const Cfg *cfg = &ssa->cfg;
+    const DomTree *dt = &ssa->dom;
+    int n = cfg->block_count;
+    int *has_phi = (int *)xmalloc((size_t)n * sizeof(int));
+    int *queued = (int *)xmalloc((size_t)n * sizeof(int));
+    int *work = (int *)xmalloc((size_t)n * sizeof(int));
+    for (int b = 0; b < n; b++) has_phi[b] = queued[b] = -1;
+
+    PhiSite *sites = NULL;
+    int site_count = 0, site_capacity = 0;
+    for (int v = 0; v < vars; v++) {
+        int top = 0;
+        for (int k = ds->start[v]; k < ds->start[v + 1]; k++) {
+            work[top++] = ds->blocks[k];
+            queued[ds->blocks[k]] = v;
+        }
+        while (top > 0) {
+            int b = work[--top];
+            for (int k = dt->df_start[b]; k < dt->df_start[b + 1]; k++) {
+                int y = dt->frontier[k];
+                if (has_phi[y] == v || !bitset_test(liveness_in(lv, y), v)) continue;
+                has_phi[y] = v;
+                if (site_count == site_capacity) {
+                    site_capacity = site_capacity ? site_capacity * 2 : 64;
+                    sites = (PhiSite *)xrealloc(sites, (size_t)site_capacity * sizeof(PhiSite));
+                }
+                sites[site_count].block = y;
+                sites[site_count].var = v;
+                site_count++;
+                if (queued[y] != v) {
+                    queued[y] = v;
+                    work[top++] = y;
+                }
+            }
+        }
+    }
+
+    // Group by block, then give each phi one argument slot per predecessor.
+    ssa->phi_start = (int *)xcalloc((size_t)n + 1, sizeof(int));
+    for (int k = 0; k < site_count; k++) ssa->phi_start[sites[k].block + 1]++;
+    for (int b = 0; b < n; b++) ssa->phi_start[b + 1] += ssa->phi_start[b];
+    ssa->phis = (SsaPhi *)xmalloc((size_t)site_count * sizeof(SsaPhi));
+    ssa->phi_count = site_count;
+    int *fill = has_phi;
+    memcpy(fill, ssa->phi_start, (size_t)n * sizeof(int));
+    int args = 0;
+    for (int k = 0; k < site_count; k++) {
+        SsaPhi *phi = &ssa->phis[fill[sites[k].block]++];
+        phi->dst = sites[k].var;
+        phi->var = sites[k].var;
+        phi->block = sites[k].block;
+        phi->arg_count = cfg->blocks[sites[k].block].pred_count;
+        args += phi->arg_count;
+    }
+    ssa->args = (SsaPhiArg *)xmalloc((size_t)args * sizeof(SsaPhiArg));
+    ssa->arg_count = 0;
+    for (int p = 0; p < site_count; p++) {
+        SsaPhi *phi = &ssa->phis[p];
+        const BasicBlock *blk = &cfg->blocks[phi->block];
+        phi->arg_start = ssa->arg_count;
+        for (int k = 0; k < phi->arg_count; k++) {
+            SsaPhiArg *arg = &ssa->args[ssa->arg_count++];
+            arg->pred = cfg->preds[blk->pred_start + k];
+            arg->value = var_val(phi->var);
+        }
+    }
+
+    free(sites);
+    free(has_phi);
+    free(queued);
+    free(work);
+}
+
+typedef struct {
+    SsaForm *ssa;
+    int *current;       // original variable -> SSA name in scope
+    int *version;       // versions handed out per original variable
+    bool *keep;         // the single definition keeps the original index
+    int *undo_var;      // log of (variable, previous current) pairs
+    int *undo_prev;
+    int undo_count;
+    int undo_capacity;
+} Renamer;
+
+static void record_origin(SsaForm *ssa, int ssa_var, int var) {
+    if (ssa_var >= ssa->origin_count) {
+        int new_count = ssa->origin_count * 2 > ssa_var + 1 ? ssa->origin_count * 2 : ssa_var + 1;
+        ssa->origin = (int *)xrealloc(ssa->origin, (size_t)new_count * sizeof(int));
+        for (int v = ssa->origin_count; v < new_count; v++) ssa->origin[v] = v;
+        ssa->origin_count = new_count;
+    }
+    ssa->origin[ssa_var] = var;
+}
+
+static int new_version(Renamer *rn, int var) {
+    TackyFunction *fn = rn->ssa->fn;
+    int ssa_var = var;
+    if (!rn->keep[var]) {
+        char buf[TACKY_NAME_MAX + 16];
+        const char *name = NULL;
+        if (fn->var_names[var]) {
+            snprintf(buf, sizeof(buf), "%s.%d", fn->var_names[var], ++rn->version[var]);
+            name = buf;
+        }
+        ssa_var = tacky_new_var(fn, name);
+    }
+    record_origin(rn->ssa, ssa_var, var);
+    if (rn->undo_count == rn->undo_capacity) {
+        rn->undo_capacity = rn->undo_capacity ? rn->undo_capacity * 2 : 64;
+        rn->undo_var = (int *)xrealloc(rn->undo_var, (size_t)rn->undo_capacity * sizeof(int));
+        rn->undo_prev = (int *)xrealloc(rn->undo_prev, (size_t)rn->undo_capacity * sizeof(int));
+    }
+    rn->undo_var[rn->undo_count] = var;
+    rn->undo_prev[rn->undo_count] = rn->current[var];
+    rn->undo_count++;
+    rn->current[var] = ssa_var;
+    return ssa_var;
+}
+
+static void rename_use(const Renamer *rn, TackyVal *v) {
+    if (v->kind == TACKY_VAL_VAR) v->value = rn->current[v->value];
+}
+
+static void rename_block(Renamer *rn, int b) {
+    SsaForm *ssa = rn->ssa;
+    const Cfg *cfg = &ssa->cfg;
+    const BasicBlock *blk = &cfg->blocks[b];
+
+    for (int p = ssa->phi_start[b]; p < ssa->phi_start[b + 1]; p++) {
+        ssa->phis[p].dst = new_version(rn, ssa->phis[p].var);
+    }
+    for (int i = blk->start; i < blk->end; i++) {
+        TackyInstr *ins = &ssa->fn->body[i];
+        switch ((TackyInstrKind)ins->kind) {
+            case TACKY_INSTR_BINARY:
+                rename_use(rn, &ins->src2);
+                // fall through
+            case TACKY_INSTR_UNARY:
+            case TACKY_INSTR_COPY:
+                rename_use(rn, &ins->src1);
+                ins->dst = new_version(rn, ins->dst);
+                break;
+            case TACKY_INSTR_RETURN:
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                rename_use(rn, &ins->src1);
+                break;
+            default:
+                break;
+        }
+    }
+    for (int s = 0; s < blk->succ_count; s++) {
+        int succ = blk->succ[s];
+        for (int p = ssa->phi_start[succ]; p < ssa->phi_start[succ + 1]; p++) {
+            const SsaPhi *phi = &ssa->phis[p];
+            for (int k = 0; k < phi->arg_count; k++) {
+                SsaPhiArg *arg = &ssa->args[phi->arg_start + k];
+                if (arg->pred == b) arg->value = var_val(rn->current[phi->var]);
+            }
+        }
+    }
+}
+
+// Walks the dominator tree depth first; names defined in a block go out of
+// scope when the walk leaves its subtree.
+static void rename_all(Renamer *rn) {
+    const DomTree *dt = &rn->ssa->dom;
+    int n = rn->ssa->cfg.block_count;
+    int *stack = (int *)xmalloc((size_t)n * sizeof(int));
+    int *next_child = (int *)xmalloc((size_t)n * sizeof(int));
+    int *mark = (int *)xmalloc((size_t)n * sizeof(int));
+    int depth = 0;
+    int entry = rn->ssa->cfg.rpo[0];
+
+    mark[entry] = rn->undo_count;
+    rename_block(rn, entry);
+    next_child[entry] = dt->child_start[entry];
+    stack[depth++] = entry;
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        if (next_child[b] < dt->child_start[b + 1]) {
+            int c = dt->children[next_child[b]++];
+            mark[c] = rn->undo_count;
+            rename_block(rn, c);
+            next_child[c] = dt->child_start[c];
+            stack[depth++] = c;
+        } else {
+            while (rn->undo_count > mark[b]) {
+                rn->undo_count--;
+                rn->current[rn->undo_var[rn->undo_count]] = rn->undo_prev[rn->undo_count];
+            }
+            depth--;
+        }
+    }
+    free(stack);
+    free(next_child);
+    free(mark);
+}
+
+void ssa_build(SsaForm *ssa, TackyFunction *fn) {
+    memset(ssa, 0, sizeof(*ssa));
+    ssa->fn = fn;
+    prepare_cfg(ssa);
+    dom_compute(&ssa->dom, &ssa->cfg);
+
+    int vars = fn->var_count;
+    Liveness lv = {0};
+    liveness_compute(&lv, &ssa->cfg);
+    DefSites ds = {0};
+    collect_def_sites(&ds, ssa, vars);
+    place_phis(ssa, &ds, &lv, vars);
+
+    Renamer rn = {0};
+    rn.ssa = ssa;
+    rn.current = (int *)xmalloc((size_t)vars * sizeof(int));
+    rn.version = (int *)xcalloc((size_t)vars + 1, sizeof(int));
+    rn.keep = (bool *)xmalloc((size_t)vars * sizeof(bool));
+    // A variable assigned exactly once whose value on entry is never read
+    // has no phis and already is in SSA form; it keeps its index and name.
+    const BitWord *entry_live = liveness_in(&lv, ssa->cfg.rpo[0]);
+    for (int v = 0; v < vars; v++) {
+        rn.current[v] = v;
+        rn.keep[v] = ds.def_count[v] == 1 && !bitset_test(entry_live, v);
+    }
+    record_origin(ssa, vars > 0 ? vars - 1 : 0, vars > 0 ? vars - 1 : 0);
+    rename_all(&rn);
+
+    free(rn.current);
+    free(rn.version);
+    free(rn.keep);
+    free(rn.undo_var);
+    free(rn.undo_prev);
+    free(ds.start);
+    free(ds.blocks);
+    free(ds.def_count);
+    liveness_free(&lv);
+}
+
+// How control leaves a block, read from its current last instruction
+// (passes on SSA form may have folded its jump since the CFG was built).
+// Taken once for every block before any edge is lowered, since lowering
+// retargets jumps to labels the CFG does not know.
+typedef struct {
+    int last;           // last instruction, -1 if none
+    unsigned char kind; // its kind, NOP if none
+    int target;         // block a jump goes to, -1 if none
+    int succ[2];
+    int succ_count;
+} BlockExit;
+
+static void read_exit(const SsaForm *ssa, int p, BlockExit *ex) {
+    const Cfg *cfg = &ssa->cfg;
+    int next = p + 1 < cfg->block_count ? p + 1 : -1;
+    ex->last = cfg_last_instr(cfg, p);
+    ex->kind = ex->last >= 0 ? ssa->fn->body[ex->last].kind : TACKY_INSTR_NOP;
+    ex->target = -1;
+    ex->succ_count = 0;
+    if (ex->kind == TACKY_INSTR_RETURN) return;
+    if (ex->kind == TACKY_INSTR_JUMP || is_cond_jump(ex->kind)) {
+        ex->target = cfg_block_of_label(cfg, ssa->fn->body[ex->last].label);
+    }
+    if (ex->kind != TACKY_INSTR_JUMP && next >= 0) ex->succ[ex->succ_count++] = next;
+    if (ex->target >= 0 && (ex->succ_count == 0 || ex->succ[0] != ex->target)) {
+        ex->succ[ex->succ_count++] = ex->target;
+    }
+}
+
+typedef struct {
+    int at;             // instruction index to insert before, or -1 to
+    int first;          //   append as a new block
+    int count;          // copies pool[first .. first + count)
+    int target_label;   // for appended blocks: where they jump afterwards
+    int block_label;    //   and the label they start with
+} EdgeCopies;
+
+typedef struct {
+    SsaForm *ssa;
+    TackyInstr *pool;
+    int pool_count;
+    int pool_capacity;
+    EdgeCopies *edges;
+    int edge_count;
+    int edge_capacity;
+    BlockExit *exits;
+    int *dst;           // scratch for one parallel copy
+    TackyVal *src;
+} Lowering;
+
+static void emit_copy(Lowering *lw, int dst, TackyVal src) {
+    if (lw->pool_count == lw->pool_capacity) {
+        lw->pool_capacity = lw->pool_capacity ? lw->pool_capacity * 2 : 64;
+        lw->pool = (TackyInstr *)xrealloc(lw->pool, (size_t)lw->pool_capacity * sizeof(TackyInstr));
+    }
+    TackyInstr *ins = &lw->pool[lw->pool_count++];
+    memset(ins, 0, sizeof(*ins));
+    ins->kind = TACKY_INSTR_COPY;
+    ins->dst = dst;
+    ins->src1 = src;
+}
+
+// Orders the parallel assignment dst[k] = src[k] (k < n, distinct dst)
+// into copies. A copy is emitted once no pending copy still reads its
+// destination; when only cycles remain (a swap), one destination is saved
+// in a fresh temporary first.
+static void sequentialize(Lowering *lw, int n) {
+    int *dst = lw->dst;
+    TackyVal *src = lw->src;
+    for (int k = 0; k < n;) {
+        if (src[k].kind == TACKY_VAL_VAR && src[k].value == dst[k]) {
+            dst[k] = dst[n - 1];
+            src[k] = src[n - 1];
+            n--;
+        } else {
+            k++;
+        }
+    }
+    while (n > 0) {
+        int ready = -1;
+        for (int k = 0; k < n && ready < 0; k++) {
+            bool read = false;
+            for (int j = 0; j < n && !read; j++) {
+                read = j != k && src[j].kind == TACKY_VAL_VAR && src[j].value == dst[k];
+            }
+            if (!read) ready = k;
+        }
+        if (ready < 0) {
+            int saved = tacky_new_temp(lw->ssa->fn);
+            emit_copy(lw, saved, var_val(dst[0]));
+            for (int j = 0; j < n; j++) {
+                if (src[j].kind == TACKY_VAL_VAR && src[j].value == dst[0]) src[j] = var_val(saved);
+            }
+            continue;
+        }
+        emit_copy(lw, dst[ready], src[ready]);
+        dst[ready] = dst[n - 1];
+        src[ready] = src[n - 1];
+        n--;
+    }
+}
+
+static void add_edge(Lowering *lw, int at, int first, int target_label, int label) {
+    if (lw->pool_count == first) return;
+    if (lw->edge_count == lw->edge_capacity) {
+        lw->edge_capacity = lw->edge_capacity ? lw->edge_capacity * 2 : 16;
+        lw->edges = (EdgeCopies *)xrealloc(lw->edges, (size_t)lw->edge_capacity * sizeof(EdgeCopies));
+    }
+    EdgeCopies *e = &lw->edges[lw->edge_count++];
+    e->at = at;
+    e->first = first;
+    e->count = lw->pool_count - first;
+    e->target_label = target_label;
+    e->block_label = label;
+}
+
+// Emits the copies for edge pred -> b and decides where they go: before
+// pred's jump, at the fall-through point, or in a new block when the edge
+// is critical.
+static void lower_edge(Lowering *lw, int pred, int b) {
+    SsaForm *ssa = lw->ssa;
+    TackyFunction *fn = ssa->fn;
+    BlockExit *ex = &lw->exits[pred];
+    bool is_edge = false;
+    for (int s = 0; s < ex->succ_count; s++) is_edge |= ex->succ[s] == b;
+    if (!is_edge) return;
+
+    int n = 0;
+    for (int p = ssa->phi_start[b]; p < ssa->phi_start[b + 1]; p++) {
+        const SsaPhi *phi = &ssa->phis[p];
+        if (phi->dst < 0) continue;
+        for (int k = 0; k < phi->arg_count; k++) {
+            const SsaPhiArg *arg = &ssa->args[phi->arg_start + k];
+            if (arg->pred != pred) continue;
+            lw->dst[n] = phi->dst;
+            lw->src[n] = arg->value;
+            n++;
+            break;
+        }
+    }
+    int first = lw->pool_count;
+    sequentialize(lw, n);
+
+    TackyInstr *last = ex->last >= 0 ? &fn->body[ex->last] : NULL;
+    if (is_cond_jump(ex->kind) && ex->succ_count == 1) {
+        // Both ways lead to b: the condition does not matter.
+        last->kind = ex->kind = TACKY_INSTR_JUMP;
+        last->src1.kind = TACKY_VAL_CONSTANT;
+        last->src1.value = 0;
+    }
+    if (ex->kind == TACKY_INSTR_JUMP) {
+        add_edge(lw, ex->last, first, -1, -1);
+    } else if (!is_cond_jump(ex->kind) || ex->target != b) {
+        add_edge(lw, ssa->cfg.blocks[pred].end, first, -1, -1);
+    } else if (lw->pool_count > first) {
+        int label = tacky_new_label(fn, TACKY_LABEL_BLOCK);
+        add_edge(lw, -1, first, last->label, label);
+        last->label = label;
+    }
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const EdgeCopies *x = (const EdgeCopies *)a, *y = (const EdgeCopies *)b;
+    return (y->at > x->at) - (y->at < x->at);
+}
+
+static void insert_copies(Lowering *lw) {
+    TackyFunction *fn = lw->ssa->fn;
+    if (lw->edge_count == 0) return;
+    qsort(lw->edges, (size_t)lw->edge_count, sizeof(EdgeCopies), compare_edges);
+    for (int e = 0; e < lw->edge_count; e++) {
+        const EdgeCopies *edge = &lw->edges[e];
+        if (edge->at < 0) {
+            TackyInstr *label = tacky_append(fn, TACKY_INSTR_LABEL);
+            label->label = edge->block_label;
+            for (int k = 0; k < edge->count; k++) *tacky_append(fn, TACKY_INSTR_COPY) = lw->pool[edge->first + k];
+            TackyInstr *jump = tacky_append(fn, TACKY_INSTR_JUMP);
+            jump->label = edge->target_label;
+        } else {
+            TackyInstr *gap = tacky_insert(fn, edge->at, edge->count);
+            memcpy(gap, &lw->pool[edge->first], (size_t)edge->count * sizeof(TackyInstr));
+        }
+    }
+}
+
+void ssa_destroy(SsaForm *ssa) {
+    const Cfg *cfg = &ssa->cfg;
+    Lowering lw = {0};
+    lw.ssa = ssa;
+    int widest = 0;
+    for (int b = 0; b < cfg->block_count; b++) {
+        int count = ssa->phi_start[b + 1] - ssa->phi_start[b];
+        if (count > widest) widest = count;
+    }
+    lw.dst = (int *)xmalloc((size_t)widest * sizeof(int));
+    lw.src = (TackyVal *)xmalloc((size_t)widest * sizeof(TackyVal));
+    lw.exits = (BlockExit *)xmalloc((size_t)cfg->block_count * sizeof(BlockExit));
+    for (int b = 0; b < cfg->block_count; b++) read_exit(ssa, b, &lw.exits[b]);
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        if (ssa->phi_start[b] == ssa->phi_start[b + 1]) continue;
+        const BasicBlock *blk = &cfg->blocks[b];
+        for (int p = 0; p < blk->pred_count; p++) lower_edge(&lw, cfg->preds[blk->pred_start + p], b);
+    }
+    // Appended blocks sort last; the inserts run from the back of the
+    // function forwards so earlier indices stay valid.
+    insert_copies(&lw);
+    if (ssa->entry_label >= 0) ssa->fn->body[0].kind = TACKY_INSTR_NOP;
+    tacky_compact(ssa->fn);
+
+    free(lw.pool);
+    free(lw.edges);
+    free(lw.exits);
+    free(lw.dst);
+    free(lw.src);
+    cfg_free(&ssa->cfg);
+    dom_free(&ssa->dom);
+    free(ssa->phis);
+    free(ssa->phi_start);
+    free(ssa->args);
+    free(ssa->origin);
+    memset(ssa, 0, sizeof(*ssa));
+}
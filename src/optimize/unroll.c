@@ -0,0 +1,337 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/optimize/liveness.h"
+#include "../../include/optimize/loops.h"
+#include "../../include/util/alloc.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Instructions an unrolled loop may grow to, and the largest number of
+// iterations one trip through a partially unrolled loop may cover.
+#define UNROLL_BUDGET 256
+#define UNROLL_MAX_FACTOR 8
+
+// A loop laid out as one run of instructions (which may also hold the
+// blocks break jumps through on the way out), entered at its header label,
+// leaving through a JumpIfZero at the end of the header and closed by a
+// Jump back to the header, whose test compares an induction variable with
+// a constant, so the number of iterations is known.
+typedef struct {
+    int start;          // the header label
+    int end;            // one past the closing Jump
+    int header_label;
+    int test;           // the header's JumpIfZero
+    int exit_label;
+    long long trips;
+    int size;           // instructions in the loop, NOPs aside
+} CountedLoop;
+
+typedef struct {
+    TackyFunction *fn;
+    Cfg cfg;
+    DomTree dom;
+    LoopForest loops;
+    int *def_count;
+    int *def_at;
+    int *jump_first;    // label -> lowest and highest index of a jump to it,
+    int *jump_last;     //   (INT_MAX, -1) if there is none
+    int label_limit;    // labels the two arrays above cover
+    bool *taken;        // blocks of a run unrolled in this call
+    TackyInsertions copies;
+    int *label_map;     // label inside the loop -> its label in the copy being made
+    int label_map_count;
+    TackyInstr *out;
+    int out_count;
+    int out_capacity;
+} Unroller;
+
+static bool is_jump(unsigned char kind) {
+    return kind == TACKY_INSTR_JUMP || kind == TACKY_INSTR_JUMP_IF_ZERO || kind == TACKY_INSTR_JUMP_IF_NOT_ZERO;
+}
+
+// Iterations of a loop testing i op n before each one, where i starts at
+// init and steps by step. False if the loop may not end or i would wrap.
+static bool trip_count(TackyBinaryOp op, long long init, long long n, long long step, long long *trips) {
+    long long t;
+    switch (op) {
+        case TACKY_BIN_LESS:
+            if (step <= 0) return false;
+            t = init < n ? (n - init + step - 1) / step : 0;
+            break;
+        case TACKY_BIN_LESS_EQUAL:
+            if (step <= 0) return false;
+            t = init <= n ? (n - init) / step + 1 : 0;
+            break;
+        case TACKY_BIN_GREATER:
+            if (step >= 0) return false;
+            t = init > n ? (init - n - step - 1) / -step : 0;
+            break;
+        case TACKY_BIN_GREATER_EQUAL:
+            if (step >= 0) return false;
+            t = init >= n ? (init - n) / -step + 1 : 0;
+            break;
+        case TACKY_BIN_NOT_EQUAL:
+            if (step == 0 || (n - init) % step != 0 || (n - init) / step < 0) return false;
+            t = (n - init) / step;
+            break;
+        default:
+            return false;
+    }
+    long long last = init + t * step;
+    if (last < INT_MIN || last > INT_MAX) return false;
+    *trips = t;
+    return true;
+}
+
+// Every jump back to the header comes after the induction variable steps.
+static bool steps_every_iteration(const Unroller *u, int loop, int update) {
+    const BasicBlock *hb = &u->cfg.blocks[u->loops.loops[loop].header];
+    int b = cfg_block_of_instr(&u->cfg, update);
+    for (int p = 0; p < hb->pred_count; p++) {
+        int latch = u->cfg.preds[hb->pred_start + p];
+        if (loop_contains(&u->loops, loop, latch) && !dom_dominates(&u->dom, b, latch)) return false;
+    }
+    return true;
+}
+
+static bool match_counted(Unroller *u, int loop, CountedLoop *cl) {
+    const TackyFunction *fn = u->fn;
+    const Cfg *cfg = &u->cfg;
+    const Loop *l = &u->loops.loops[loop];
+    int h = l->header;
+    int last = u->loops.blocks[l->block_start + l->block_count - 1];
+    if (u->loops.blocks[l->block_start] != h) return false;
+    // The run may not share a block with one unrolled already in this
+    // call, which has been NOPed.
+    for (int b = h; b <= last; b++) {
+        if (u->taken[b]) return false;
+    }
+
+    cl->start = cfg->blocks[h].start;
+    cl->end = cfg->blocks[last].end;
+    if (fn->body[cl->start].kind != TACKY_INSTR_LABEL) return false;
+    cl->header_label = fn->body[cl->start].label;
+    int close = cfg_last_instr(cfg, last);
+    if (close < 0 || fn->body[close].kind != TACKY_INSTR_JUMP || fn->body[close].label != cl->header_label) {
+        return false;
+    }
+    cl->test = cfg_last_instr(cfg, h);
+    const TackyInstr *jz = &fn->body[cl->test];
+    if (jz->kind != TACKY_INSTR_JUMP_IF_ZERO || jz->src1.kind != TACKY_VAL_VAR) return false;
+    cl->exit_label = jz->label;
+    if (loop_contains(&u->loops, loop, cfg_block_of_label(cfg, cl->exit_label))) return false;
+
+    // Labels inside the run are renamed in every copy, so nothing outside
+    // may jump to them. Blocks of the run outside the loop are then only
+    // reached from inside it.
+    for (int i = cl->start + 1; i < cl->end; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (ins->kind != TACKY_INSTR_LABEL) continue;
+        if (u->jump_first[ins->label] < cl->start || u->jump_last[ins->label] >= cl->end) return false;
+    }
+
+    loop_count_defs(cfg, &u->loops, loop, u->def_count, u->def_at);
+    int cond = jz->src1.value;
+    if (u->def_count[cond] != 1) return false;
+    const TackyInstr *cmp = &fn->body[u->def_at[cond]];
+    if (u->def_at[cond] < cl->start || u->def_at[cond] > cl->test) return false;
+    if (cmp->kind != TACKY_INSTR_BINARY || cmp->src1.kind != TACKY_VAL_VAR || cmp->src2.kind != TACKY_VAL_CONSTANT) {
+        return false;
+    }
+    InductionVar iv;
+    int init;
+    if (!loop_induction_var(cfg, u->def_count, u->def_at, cmp->src1.value, &iv)) return false;
+    if (iv.update < cfg->blocks[h].end || !loop_runs_once(cfg, &u->loops, loop, iv.update)) return false;
+    if (!steps_every_iteration(u, loop, iv.update)) return false;
+    if (!loop_entry_constant(cfg, &u->loops, loop, iv.var, &init)) return false;
+    if (!trip_count((TackyBinaryOp)cmp->op, init, cmp->src2.value, iv.step, &cl->trips)) return false;
+
+    cl->size = 0;
+    for (int i = cl->start; i < cl->end; i++) {
+        if (fn->body[i].kind != TACKY_INSTR_NOP) cl->size++;
+    }
+    return true;
+}
+
+static void emit(Unroller *u, const TackyInstr *ins) {
+    // A jump to the label placed right after it is dropped.
+    if (ins->kind == TACKY_INSTR_LABEL && u->out_count > 0) {
+        const TackyInstr *prev = &u->out[u->out_count - 1];
+        if (prev->kind == TACKY_INSTR_JUMP && prev->label == ins->label) u->out_count--;
+    }
+    if (u->out_count == u->out_capacity) {
+        u->out_capacity = u->out_capacity ? u->out_capacity * 2 : 64;
+        u->out = (TackyInstr *)xrealloc(u->out, (size_t)u->out_capacity * sizeof(TackyInstr));
+    }
+    u->out[u->out_count++] = *ins;
+}
+
+static int new_label_like(TackyFunction *fn, int label) {
+    return tacky_new_label(fn, (TackyLabelKind)fn->label_kinds[label]);
+}
+
+// Emits one iteration: the loop's instructions with their labels renamed,
+// starting at label. Jumps back to the header (the closing Jump, and
+// continue in a while loop) go to next instead; break keeps leaving the
+// loop. The header's test is left out unless keep_test is set.
+static void emit_iteration(Unroller *u, const CountedLoop *cl, int label, int next, bool keep_test) {
+    TackyFunction *fn = u->fn;
+    for (int i = cl->start + 1; i < cl->end; i++) {
+        if (fn->body[i].kind == TACKY_INSTR_LABEL) u->label_map[fn->body[i].label] = new_label_like(fn, fn->body[i].label);
+    }
+    TackyInstr ins = fn->body[cl->start];
+    ins.label = label;
+    emit(u, &ins);
+    for (int i = cl->start + 1; i < cl->end; i++) {
+        ins = fn->body[i];
+        if (ins.kind == TACKY_INSTR_NOP || (i == cl->test && !keep_test)) continue;
+        if (ins.kind == TACKY_INSTR_LABEL) {
+            ins.label = u->label_map[ins.label];
+        } else if (is_jump(ins.kind)) {
+            if (ins.label == cl->header_label) ins.label = next;
+            else if (ins.label < u->label_map_count && u->label_map[ins.label] >= 0) ins.label = u->label_map[ins.label];
+        }
+        emit(u, &ins);
+    }
+}
+
+// The last visit of the header after a fully unrolled loop: its
+// instructions run once more before the test fails.
+static void emit_final_test(Unroller *u, const CountedLoop *cl, int label) {
+    const TackyFunction *fn = u->fn;
+    TackyInstr ins = fn->body[cl->start];
+    ins.label = label;
+    emit(u, &ins);
+    for (int i = cl->start + 1; i < cl->test; i++) {
+        if (fn->body[i].kind != TACKY_INSTR_NOP) emit(u, &fn->body[i]);
+    }
+    if (cl->end < fn->instr_count && fn->body[cl->end].kind == TACKY_INSTR_LABEL &&
+        fn->body[cl->end].label == cl->exit_label) {
+        return;
+    }
+    memset(&ins, 0, sizeof(ins));
+    ins.kind = TACKY_INSTR_JUMP;
+    ins.label = cl->exit_label;
+    emit(u, &ins);
+}
+
+// Every iteration in a row, then the final test, which is known to fail.
+static void unroll_fully(Unroller *u, const CountedLoop *cl) {
+    int label = cl->header_label;
+    for (long long k = 0; k < cl->trips; k++) {
+        int next = new_label_like(u->fn, cl->header_label);
+        emit_iteration(u, cl, label, next, false);
+        label = next;
+    }
+    emit_final_test(u, cl, label);
+}
+
+// trips % factor iterations peeled off in front, then a loop doing factor
+// iterations per trip. Only its first test can fail: the iterations left
+// when it passes are a multiple of factor.
+static void unroll_partially(Unroller *u, const CountedLoop *cl, int factor) {
+    int label = cl->header_label;
+    int peel = (int)(cl->trips % factor);
+    int head = peel > 0 ? new_label_like(u->fn, cl->header_label) : cl->header_label;
+    for (int k = 0; k < peel; k++) {
+        int next = k + 1 < peel ? new_label_like(u->fn, cl->header_label) : head;
+        emit_iteration(u, cl, label, next, false);
+        label = next;
+    }
+    for (int k = 0; k < factor; k++) {
+        int next = k + 1 < factor ? new_label_like(u->fn, cl->header_label) : head;
+        emit_iteration(u, cl, label, next, k == 0);
+        label = next;
+    }
+}
+
+// Unrolls fully when every iteration fits the budget, otherwise by the
+// largest factor whose copies (with the peeled remainder) do.
+static bool unroll(Unroller *u, const CountedLoop *cl) {
+    int factor = 0;
+    if ((cl->trips + 1) * cl->size > UNROLL_BUDGET) {
+        for (factor = UNROLL_MAX_FACTOR; factor >= 2; factor /= 2) {
+            if (cl->trips >= 2 * factor && (2 * factor - 1) * cl->size <= UNROLL_BUDGET) break;
+        }
+        if (factor < 2) return false;
+    }
+
+    TackyFunction *fn = u->fn;
+    u->label_map_count = fn->label_count;
+    u->label_map = (int *)xmalloc((size_t)fn->label_count * sizeof(int));
+    for (int k = 0; k < fn->label_count; k++) u->label_map[k] = -1;
+    u->out_count = 0;
+    if (factor == 0) unroll_fully(u, cl);
+    else unroll_partially(u, cl, factor);
+    free(u->label_map);
+    u->label_map = NULL;
+
+    TackyInstr *at = tacky_queue_insert(&u->copies, cl->end, u->out_count);
+    memcpy(at, u->out, (size_t)u->out_count * sizeof(TackyInstr));
+    for (int i = cl->start; i < cl->end; i++) fn->body[i].kind = TACKY_INSTR_NOP;
+    return true;
+}
+
+// Where the jumps to each label are, so a run can tell whether anything
+// outside it jumps in.
+static void find_jumps(Unroller *u) {
+    const TackyFunction *fn = u->fn;
+    u->label_limit = fn->label_count;
+    u->jump_first = (int *)xmalloc((size_t)u->label_limit * sizeof(int));
+    u->jump_last = (int *)xmalloc((size_t)u->label_limit * sizeof(int));
+    for (int k = 0; k < u->label_limit; k++) {
+        u->jump_first[k] = INT_MAX;
+        u->jump_last[k] = -1;
+    }
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (!is_jump(ins->kind)) continue;
+        if (u->jump_first[ins->label] == INT_MAX) u->jump_first[ins->label] = i;
+        u->jump_last[ins->label] = i;
+    }
+}
+
+bool unroll_loops(TackyFunction *fn) {
+    if (fn->instr_count == 0) return false;
+    Unroller u = {0};
+    u.fn = fn;
+    cfg_build(&u.cfg, fn);
+    dom_compute(&u.dom, &u.cfg);
+    loops_find(&u.loops, &u.cfg, &u.dom);
+    bool changed = false;
+
+    // Innermost first, every loop whose run shares no block with one
+    // unrolled before it: a loop around an inner one unrolled in full waits
+    // for the next round, where the copies count towards its size. Each
+    // unrolled run is NOPed and its copies queued behind it, so the
+    // analyses hold for the loops still to come.
+    if (u.loops.loop_count > 0) {
+        u.def_count = (int *)xmalloc((size_t)fn->var_count * sizeof(int));
+        u.def_at = (int *)xmalloc((size_t)fn->var_count * sizeof(int));
+        u.taken = (bool *)xcalloc((size_t)u.cfg.block_count, sizeof(bool));
+        find_jumps(&u);
+        for (int l = 0; l < u.loops.loop_count; l++) {
+            CountedLoop cl;
+            if (!match_counted(&u, l, &cl) || !unroll(&u, &cl)) continue;
+            changed = true;
+            const Loop *loop = &u.loops.loops[l];
+            int last = u.loops.blocks[loop->block_start + loop->block_count - 1];
+            for (int b = loop->header; b <= last; b++) u.taken[b] = true;
+        }
+        tacky_apply_insertions(fn, &u.copies);
+        free(u.def_count);
+        free(u.def_at);
+        free(u.taken);
+        free(u.jump_first);
+        free(u.jump_last);
+    }
+    if (changed) tacky_compact(fn);
+
+    tacky_insertions_free(&u.copies);
+    free(u.out);
+    loops_free(&u.loops);
+    dom_free(&u.dom);
+    cfg_free(&u.cfg);
+    return changed;
+}
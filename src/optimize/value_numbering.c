@@ -0,0 +1,264 @@
+#include "../../include/optimize/optimize.h"
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// An expression available in the current dominator-tree scope. Entries are
+// pushed in walk order and chained per bucket, so leaving a subtree pops
+// them and restores the bucket heads.
+typedef struct {
+    unsigned char kind;
+    unsigned char op;
+    TackyVal a;
+    TackyVal b;
+    int var;            // variable holding the value
+    int next;           // next entry in the bucket, -1 at the end
+    unsigned int bucket;
+} ValueEntry;
+
+typedef struct {
+    SsaForm *ssa;
+    TackyVal *value;    // variable -> value it was found equal to
+    int var_count;
+    int *buckets;
+    unsigned int mask;
+    ValueEntry *entries;
+    int entry_count;
+    int entry_capacity;
+    bool changed;
+} ValueTable;
+
+static bool same_val(TackyVal a, TackyVal b) {
+    return a.kind == b.kind && a.value == b.value;
+}
+
+static bool val_less(TackyVal a, TackyVal b) {
+    return a.kind != b.kind ? a.kind < b.kind : a.value < b.value;
+}
+
+static void canonicalize(ValueTable *vt, TackyVal *v) {
+    if (v->kind != TACKY_VAL_VAR || v->value >= vt->var_count) return;
+    TackyVal to = vt->value[v->value];
+    if (same_val(to, *v)) return;
+    *v = to;
+    vt->changed = true;
+}
+
+static bool is_commutative(TackyBinaryOp op) {
+    switch (op) {
+        case TACKY_BIN_ADD:
+        case TACKY_BIN_MUL:
+        case TACKY_BIN_EQUAL:
+        case TACKY_BIN_NOT_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Key under which an instruction's value is looked up: commutative
+// operands in a fixed order, and a > b stated as b < a.
+static void make_key(const TackyInstr *ins, ValueEntry *key) {
+    memset(key, 0, sizeof(*key));
+    key->kind = ins->kind;
+    key->op = ins->op;
+    key->a = ins->src1;
+    if (ins->kind == TACKY_INSTR_UNARY) return;
+    key->b = ins->src2;
+    TackyBinaryOp op = (TackyBinaryOp)ins->op;
+    if (op == TACKY_BIN_GREATER || op == TACKY_BIN_GREATER_EQUAL) {
+        key->op = op == TACKY_BIN_GREATER ? TACKY_BIN_LESS : TACKY_BIN_LESS_EQUAL;
+        key->a = ins->src2;
+        key->b = ins->src1;
+    } else if (is_commutative(op) && val_less(key->b, key->a)) {
+        key->a = ins->src2;
+        key->b = ins->src1;
+    }
+}
+
+static unsigned int hash_key(const ValueEntry *key) {
+    unsigned int h = 2166136261u;
+    unsigned int parts[6] = {
+        key->kind, key->op,
+        (unsigned)key->a.kind, (unsigned)key->a.value,
+        (unsigned)key->b.kind, (unsigned)key->b.value,
+    };
+    for (int k = 0; k < 6; k++) {
+        h ^= parts[k];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int lookup(const ValueTable *vt, const ValueEntry *key, unsigned int bucket) {
+    for (int e = vt->buckets[bucket]; e >= 0; e = vt->entries[e].next) {
+        const ValueEntry *x = &vt->entries[e];
+        if (x->kind == key->kind && x->op == key->op && same_val(x->a, key->a) && same_val(x->b, key->b)) {
+            return x->var;
+        }
+    }
+    return -1;
+}
+
+static void push_entry(ValueTable *vt, const ValueEntry *key, unsigned int bucket, int var) {
+    if (vt->entry_count == vt->entry_capacity) {
+        vt->entry_capacity = vt->entry_capacity ? vt->entry_capacity * 2 : 64;
+        vt->entries = (ValueEntry *)xrealloc(vt->entries, (size_t)vt->entry_capacity * sizeof(ValueEntry));
+    }
+    ValueEntry *e = &vt->entries[vt->entry_count];
+    *e = *key;
+    e->var = var;
+    e->bucket = bucket;
+    e->next = vt->buckets[bucket];
+    vt->buckets[bucket] = vt->entry_count++;
+}
+
+static void pop_entries(ValueTable *vt, int mark) {
+    while (vt->entry_count > mark) {
+        const ValueEntry *e = &vt->entries[--vt->entry_count];
+        vt->buckets[e->bucket] = e->next;
+    }
+}
+
+static void set_value(ValueTable *vt, int var, TackyVal v) {
+    if (var < vt->var_count) vt->value[var] = v;
+    vt->changed = true;
+}
+
+// A phi whose arguments all carry one value is that value; two phis of a
+// block with the same argument on every edge are equal. Arguments along
+// back edges are compared as they stand, which can only miss a match.
+static void number_phis(ValueTable *vt, int b) {
+    SsaForm *ssa = vt->ssa;
+    for (int p = ssa->phi_start[b]; p < ssa->phi_start[b + 1]; p++) {
+        SsaPhi *phi = &ssa->phis[p];
+        if (phi->dst < 0) continue;
+        bool uniform = true;
+        bool seen = false;
+        TackyVal only = { TACKY_VAL_CONSTANT, 0 };
+        for (int k = 0; k < phi->arg_count; k++) {
+            TackyVal *arg = &ssa->args[phi->arg_start + k].value;
+            canonicalize(vt, arg);
+            if (arg->kind == TACKY_VAL_VAR && arg->value == phi->dst) continue;
+            if (!seen) only = *arg;
+            else if (!same_val(only, *arg)) uniform = false;
+            seen = true;
+        }
+        if (uniform && seen) {
+            set_value(vt, phi->dst, only);
+            phi->dst = -1;
+            continue;
+        }
+        for (int q = ssa->phi_start[b]; q < p; q++) {
+            const SsaPhi *other = &ssa->phis[q];
+            if (other->dst < 0) continue;
+            bool equal = true;
+            for (int k = 0; k < phi->arg_count && equal; k++) {
+                equal = same_val(ssa->args[phi->arg_start + k].value, ssa->args[other->arg_start + k].value);
+            }
+            if (equal) {
+                TackyVal v = { TACKY_VAL_VAR, other->dst };
+                set_value(vt, phi->dst, v);
+                phi->dst = -1;
+                break;
+            }
+        }
+    }
+}
+
+static void number_block(ValueTable *vt, int b) {
+    SsaForm *ssa = vt->ssa;
+    const BasicBlock *blk = &ssa->cfg.blocks[b];
+    number_phis(vt, b);
+    for (int i = blk->start; i < blk->end; i++) {
+        TackyInstr *ins = &ssa->fn->body[i];
+        switch ((TackyInstrKind)ins->kind) {
+            case TACKY_INSTR_COPY:
+                canonicalize(vt, &ins->src1);
+                set_value(vt, ins->dst, ins->src1);
+                ins->kind = TACKY_INSTR_NOP;
+                break;
+            case TACKY_INSTR_BINARY:
+                canonicalize(vt, &ins->src2);
+                // fall through
+            case TACKY_INSTR_UNARY: {
+                canonicalize(vt, &ins->src1);
+                ValueEntry key;
+                make_key(ins, &key);
+                unsigned int bucket = hash_key(&key) & vt->mask;
+                int found = lookup(vt, &key, bucket);
+                if (found >= 0) {
+                    TackyVal v = { TACKY_VAL_VAR, found };
+                    set_value(vt, ins->dst, v);
+                    ins->kind = TACKY_INSTR_NOP;
+                } else {
+                    push_entry(vt, &key, bucket, ins->dst);
+                }
+                break;
+            }
+            case TACKY_INSTR_RETURN:
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                canonicalize(vt, &ins->src1);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool number_values(SsaForm *ssa) {
+    const Cfg *cfg = &ssa->cfg;
+    const DomTree *dt = &ssa->dom;
+    ValueTable vt = {0};
+    vt.ssa = ssa;
+    vt.var_count = ssa->fn->var_count;
+    vt.value = (TackyVal *)xmalloc((size_t)vt.var_count * sizeof(TackyVal));
+    for (int v = 0; v < vt.var_count; v++) {
+        vt.value[v].kind = TACKY_VAL_VAR;
+        vt.value[v].value = v;
+    }
+    unsigned int size = 64;
+    while (size < (unsigned)ssa->fn->instr_count) size <<= 1;
+    vt.mask = size - 1;
+    vt.buckets = (int *)xmalloc(size * sizeof(int));
+    for (unsigned int k = 0; k < size; k++) vt.buckets[k] = -1;
+
+    // Depth-first over the dominator tree: an expression computed in a
+    // block is available in the blocks it dominates.
+    int n = cfg->block_count;
+    int *stack = (int *)xmalloc((size_t)n * sizeof(int));
+    int *next_child = (int *)xmalloc((size_t)n * sizeof(int));
+    int *mark = (int *)xmalloc((size_t)n * sizeof(int));
+    int depth = 0;
+    int entry = cfg->rpo[0];
+    mark[entry] = 0;
+    number_block(&vt, entry);
+    next_child[entry] = dt->child_start[entry];
+    stack[depth++] = entry;
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        if (next_child[b] < dt->child_start[b + 1]) {
+            int c = dt->children[next_child[b]++];
+            mark[c] = vt.entry_count;
+            number_block(&vt, c);
+            next_child[c] = dt->child_start[c];
+            stack[depth++] = c;
+        } else {
+            pop_entries(&vt, mark[b]);
+            depth--;
+        }
+    }
+
+    // Arguments along back edges were visited before their definitions.
+    for (int a = 0; a < ssa->arg_count; a++) canonicalize(&vt, &ssa->args[a].value);
+
+    free(stack);
+    free(next_child);
+    free(mark);
+    free(vt.value);
+    free(vt.buckets);
+    free(vt.entries);
+    return vt.changed;
+}
@@ -9,6 +9,7 @@ static ASTNode *create_ast_node(ASTNodeType type, const char *value, ASTNode *le
     node->type = type;
     node->value = value ? strdup(value) : NULL;
     node->owns_value = value != NULL;
+    node->var_id = -1;
     node->left = left;
     node->right = right;
     node->third = NULL;
@@ -10,102 +10,150 @@
         exit(1);                        \
     } while (0)
 
-typedef struct VarScope {
-    char **names;
-    char **resolved;
+// All bindings of the resolver live in one contiguous stack; a scope is just
+// the index at which it started (its watermark). Pushing and popping a scope
+// never allocates, and the arrays keep their high-water capacity.
+typedef struct {
+    const char *name;   // original identifier (owned via Resolver.names or the AST)
+    char *resolved;     // owned by the AST, or by Resolver.names in fused mode
+    int id;             // unique index, also the key into VarUsageTable
+} Binding;
+
+struct Resolver {
+    Binding *bindings;
     size_t count;
     size_t capacity;
-    struct VarScope *parent;
-} VarScope;
-
-typedef struct {
-    VarScope *current;
+    size_t *marks;      // start index of each open scope
+    size_t depth;
+    size_t marks_capacity;
+    char **names;       // strings kept alive until the resolver is torn down
+    size_t name_count;
+    size_t name_capacity;
     int next_unique;
-    int loop_depth;
-} ResolveContext;
+    int loop_depth;     // loop bodies entered, for break and continue
+    int usage_depth;    // loops entered, counting their tests and steps
+    VarUsageTable *usage; // optional; filled in by resolve_variables
+};
 
-static VarScope *scope_create(VarScope *parent) {
-    VarScope *scope = (VarScope *)calloc(1, sizeof(VarScope));
-    if (!scope) {
-        SEMANTIC_ERROR("Out of memory while creating scope");
+static void *grow_array(void *ptr, size_t *capacity, size_t elem_size) {
+    size_t new_cap = *capacity ? *capacity * 2 : 16;
+    void *resized = realloc(ptr, new_cap * elem_size);
+    if (!resized) {
+        SEMANTIC_ERROR("Out of memory while resolving variables");
     }
-    scope->parent = parent;
-    return scope;
+    *capacity = new_cap;
+    return resized;
 }
 
-static void scope_destroy(VarScope *scope) {
-    if (!scope) return;
-    for (size_t i = 0; i < scope->count; i++) {
-        free(scope->names[i]);
-        // resolved pointers are owned by the AST
+static void scope_push(Resolver *ctx) {
+    if (ctx->depth == ctx->marks_capacity) {
+        ctx->marks = (size_t *)grow_array(ctx->marks, &ctx->marks_capacity, sizeof(size_t));
     }
-    free(scope->names);
-    free(scope->resolved);
-    free(scope);
+    ctx->marks[ctx->depth++] = ctx->count;
 }
 
-static void scope_push(ResolveContext *ctx) {
-    ctx->current = scope_create(ctx->current);
-}
-
-static void scope_pop(ResolveContext *ctx) {
-    VarScope *scope = ctx->current;
-    if (!scope) return;
-    ctx->current = scope->parent;
-    scope_destroy(scope);
-}
-
-static void scope_ensure_capacity(VarScope *scope) {
-    if (scope->count < scope->capacity) return;
-    size_t new_cap = scope->capacity ? scope->capacity * 2 : 8;
-    char **new_names = (char **)realloc(scope->names, new_cap * sizeof(char *));
-    char **new_resolved = (char **)realloc(scope->resolved, new_cap * sizeof(char *));
-    if (!new_names || !new_resolved) {
-        free(new_names);
-        free(new_resolved);
-        SEMANTIC_ERROR("Out of memory while resolving variables");
-    }
-    scope->names = new_names;
-    scope->resolved = new_resolved;
-    scope->capacity = new_cap;
+static void scope_pop(Resolver *ctx) {
+    if (ctx->depth == 0) return;
+    ctx->count = ctx->marks[--ctx->depth];
 }
 
-static int scope_contains(VarScope *scope, const char *name) {
-    if (!scope) return 0;
-    for (size_t i = 0; i < scope->count; i++) {
-        if (strcmp(scope->names[i], name) == 0) return 1;
+static int scope_contains(Resolver *ctx, const char *name) {
+    size_t mark = ctx->marks[ctx->depth - 1];
+    for (size_t i = ctx->count; i > mark; i--) {
+        if (strcmp(ctx->bindings[i - 1].name, name) == 0) return 1;
     }
     return 0;
 }
 
-static void scope_add(ResolveContext *ctx, const char *name, char *resolved) {
-    VarScope *scope = ctx->current;
-    if (!scope) {
+static void scope_add(Resolver *ctx, const char *name, char *resolved, int id) {
+    if (ctx->depth == 0) {
         SEMANTIC_ERROR("Semantic Error: declaration outside of any scope");
     }
-    if (scope_contains(scope, name)) {
+    if (scope_contains(ctx, name)) {
         SEMANTIC_ERROR("Semantic Error: redeclaration of '%s'", name);
     }
-    scope_ensure_capacity(scope);
-    scope->names[scope->count] = strdup(name);
-    if (!scope->names[scope->count]) {
-        SEMANTIC_ERROR("Out of memory while storing variable name");
+    if (ctx->count == ctx->capacity) {
+        ctx->bindings = (Binding *)grow_array(ctx->bindings, &ctx->capacity, sizeof(Binding));
     }
-    scope->resolved[scope->count] = resolved;
-    scope->count++;
+    ctx->bindings[ctx->count].name = name;
+    ctx->bindings[ctx->count].resolved = resolved;
+    ctx->bindings[ctx->count].id = id;
+    ctx->count++;
 }
 
-static char *scope_lookup(ResolveContext *ctx, const char *name) {
-    for (VarScope *scope = ctx->current; scope; scope = scope->parent) {
-        for (size_t i = 0; i < scope->count; i++) {
-            if (strcmp(scope->names[i], name) == 0) {
-                return scope->resolved[i];
-            }
+static Binding *scope_lookup(Resolver *ctx, const char *name) {
+    for (size_t i = ctx->count; i > 0; i--) {
+        if (strcmp(ctx->bindings[i - 1].name, name) == 0) {
+            return &ctx->bindings[i - 1];
         }
     }
     return NULL;
 }
 
+static void context_keep_name(Resolver *ctx, char *name) {
+    if (ctx->name_count == ctx->name_capacity) {
+        ctx->names = (char **)grow_array(ctx->names, &ctx->name_capacity, sizeof(char *));
+    }
+    ctx->names[ctx->name_count++] = name;
+}
+
+static void context_reset(Resolver *ctx) {
+    for (size_t i = 0; i < ctx->name_count; i++) {
+        free(ctx->names[i]);
+    }
+    ctx->name_count = 0;
+    ctx->count = 0;
+    ctx->depth = 0;
+    ctx->loop_depth = 0;
+    ctx->usage_depth = 0;
+}
+
+static void context_destroy(Resolver *ctx) {
+    context_reset(ctx);
+    free(ctx->bindings);
+    free(ctx->marks);
+    free(ctx->names);
+}
+
+static VarUsage *usage_entry(Resolver *ctx, int id) {
+    VarUsageTable *t = ctx->usage;
+    if (!t || id < 0) return NULL;
+    if (id >= t->capacity) {
+        int new_cap = t->capacity ? t->capacity * 2 : 16;
+        while (new_cap <= id) new_cap *= 2;
+        VarUsage *resized = (VarUsage *)realloc(t->vars, (size_t)new_cap * sizeof(VarUsage));
+        if (!resized) {
+            SEMANTIC_ERROR("Out of memory while recording variable usage");
+        }
+        memset(resized + t->capacity, 0, (size_t)(new_cap - t->capacity) * sizeof(VarUsage));
+        t->vars = resized;
+        t->capacity = new_cap;
+    }
+    if (id >= t->count) t->count = id + 1;
+    return &t->vars[id];
+}
+
+static void record_use(Resolver *ctx, int id) {
+    VarUsage *u = usage_entry(ctx, id);
+    if (!u) return;
+    u->uses++;
+    if (ctx->usage_depth > u->loop_depth) u->loop_depth = ctx->usage_depth;
+}
+
+static void record_store(Resolver *ctx, int id, ASTNode *value) {
+    VarUsage *u = usage_entry(ctx, id);
+    if (!u) return;
+    bool literal = value && value->type == AST_EXPRESSION_CONSTANT && value->value;
+    int v = literal ? atoi(value->value) : 0;
+    if (u->assignments == 0) {
+        u->constant = literal;
+        u->const_value = v;
+    } else if (!literal || v != u->const_value) {
+        u->constant = false;
+    }
+    u->assignments++;
+}
+
 static char *make_unique_name(const char *original, int index) {
     size_t len = strlen(original);
     size_t buf_sz = len + 32;
@@ -148,32 +196,99 @@ static void set_node_value_transfer(ASTNode *node, char *value) {
     node->owns_value = true;
 }
 
-static void resolve_block_items(ASTNode *item, ResolveContext *ctx);
-static void resolve_statement(ASTNode *stmt, ResolveContext *ctx);
-static void resolve_expression(ASTNode *expr, ResolveContext *ctx);
+static void resolve_block_items(ASTNode *item, Resolver *ctx);
+static void resolve_statement(ASTNode *stmt, Resolver *ctx);
+static void resolve_expression(ASTNode *expr, Resolver *ctx);
 
-static void resolve_declaration(ASTNode *decl, ResolveContext *ctx) {
-    if (!decl || decl->type != AST_DECLARATION) return;
+// The returned binding is only valid until the next declaration.
+static Binding *declare_variable(Resolver *ctx, ASTNode *decl) {
     if (!decl->value) {
         SEMANTIC_ERROR("Semantic Error: declaration missing identifier");
     }
+    int id = ctx->next_unique++;
+    char *resolved = make_unique_name(decl->value, id);
+    scope_add(ctx, decl->value, resolved, id);
+    usage_entry(ctx, id);
+    return &ctx->bindings[ctx->count - 1];
+}
+
+static Binding *lookup_variable(Resolver *ctx, ASTNode *var) {
+    if (!var->value) {
+        SEMANTIC_ERROR("Semantic Error: unnamed variable usage");
+    }
+    Binding *binding = scope_lookup(ctx, var->value);
+    if (!binding) {
+        SEMANTIC_ERROR("Semantic Error: use of undeclared variable '%s'", var->value);
+    }
+    return binding;
+}
+
+static void check_assignment_target(ASTNode *expr) {
+    if (!expr->left || expr->left->type != AST_EXPRESSION_VARIABLE) {
+        SEMANTIC_ERROR("Semantic Error: invalid lvalue in assignment");
+    }
+}
+
+static void check_loop_jump(Resolver *ctx, ASTNode *stmt) {
+    if (ctx->loop_depth > 0) return;
+    if (stmt->type == AST_STATEMENT_BREAK) {
+        SEMANTIC_ERROR("Semantic Error: 'break' used outside of a loop");
+    }
+    SEMANTIC_ERROR("Semantic Error: 'continue' used outside of a loop");
+}
+
+static void resolve_declaration(ASTNode *decl, Resolver *ctx) {
+    if (!decl || decl->type != AST_DECLARATION) return;
 
-    char *resolved = make_unique_name(decl->value, ctx->next_unique++);
-    scope_add(ctx, decl->value, resolved);
+    Binding *binding = declare_variable(ctx, decl);
+    char *resolved = binding->resolved;
+    int id = binding->id;
+    if (decl->owns_value) {
+        // The binding keeps pointing at the original identifier, so hand it
+        // over to the context instead of freeing it.
+        context_keep_name(ctx, decl->value);
+        decl->owns_value = false;
+    }
     set_node_value_transfer(decl, resolved);
+    decl->var_id = id;
 
     if (decl->left) {
         resolve_expression(decl->left, ctx);
+        record_store(ctx, id, decl->left);
     }
 }
 
-static void resolve_statement(ASTNode *stmt, ResolveContext *ctx) {
+// Resolves an assignment; value_used says whether its result is read, which
+// counts as a use of the target.
+static void resolve_assignment(ASTNode *expr, Resolver *ctx, bool value_used) {
+    check_assignment_target(expr);
+    Binding *binding = lookup_variable(ctx, expr->left);
+    int id = binding->id;
+    set_node_value(expr->left, binding->resolved);
+    expr->left->var_id = id;
+    resolve_expression(expr->right, ctx);
+    record_store(ctx, id, expr->right);
+    if (value_used) record_use(ctx, id);
+}
+
+// Resolves an expression evaluated only for its side effects.
+static void resolve_effect(ASTNode *expr, Resolver *ctx) {
+    if (expr && expr->type == AST_EXPRESSION_ASSIGNMENT) {
+        resolve_assignment(expr, ctx, false);
+    } else {
+        resolve_expression(expr, ctx);
+    }
+}
+
+static void resolve_statement(ASTNode *stmt, Resolver *ctx) {
     if (!stmt) return;
     switch (stmt->type) {
         case AST_STATEMENT_RETURN:
-        case AST_STATEMENT_EXPRESSION:
             resolve_expression(stmt->left, ctx);
             break;
+        case AST_STATEMENT_EXPRESSION:
+            resolve_effect(stmt->left, ctx);
+            break;
         case AST_STATEMENT_NULL:
             break;
         case AST_STATEMENT_IF:
@@ -187,16 +302,20 @@ static void resolve_statement(ASTNode *stmt, ResolveContext *ctx) {
             scope_pop(ctx);
             break;
         case AST_STATEMENT_WHILE:
+            ctx->usage_depth++;
             resolve_expression(stmt->left, ctx);
             ctx->loop_depth++;
             resolve_statement(stmt->right, ctx);
             ctx->loop_depth--;
+            ctx->usage_depth--;
             break;
         case AST_STATEMENT_DO_WHILE:
+            ctx->usage_depth++;
             ctx->loop_depth++;
             resolve_statement(stmt->left, ctx);
             ctx->loop_depth--;
             resolve_expression(stmt->right, ctx);
+            ctx->usage_depth--;
             break;
         case AST_STATEMENT_FOR:
             scope_push(ctx);
@@ -207,6 +326,7 @@ static void resolve_statement(ASTNode *stmt, ResolveContext *ctx) {
                     resolve_statement(stmt->left, ctx);
                 }
             }
+            ctx->usage_depth++;
             if (stmt->right) {
                 resolve_expression(stmt->right, ctx);
             }
@@ -214,45 +334,33 @@ static void resolve_statement(ASTNode *stmt, ResolveContext *ctx) {
             resolve_statement(stmt->fourth, ctx);
             ctx->loop_depth--;
             if (stmt->third) {
-                resolve_expression(stmt->third, ctx);
+                resolve_effect(stmt->third, ctx);
             }
+            ctx->usage_depth--;
             scope_pop(ctx);
             break;
         case AST_STATEMENT_BREAK:
-            if (ctx->loop_depth <= 0) {
-                SEMANTIC_ERROR("Semantic Error: 'break' used outside of a loop");
-            }
-            break;
         case AST_STATEMENT_CONTINUE:
-            if (ctx->loop_depth <= 0) {
-                SEMANTIC_ERROR("Semantic Error: 'continue' used outside of a loop");
-            }
+            check_loop_jump(ctx, stmt);
             break;
         default:
             SEMANTIC_ERROR("Semantic Error: unexpected node type in statement");
     }
 }
 
-static void resolve_expression(ASTNode *expr, ResolveContext *ctx) {
+static void resolve_expression(ASTNode *expr, Resolver *ctx) {
     if (!expr) return;
 
     switch (expr->type) {
         case AST_EXPRESSION_ASSIGNMENT:
-            if (!expr->left || expr->left->type != AST_EXPRESSION_VARIABLE) {
-                SEMANTIC_ERROR("Semantic Error: invalid lvalue in assignment");
-            }
-            resolve_expression(expr->left, ctx);
-            resolve_expression(expr->right, ctx);
+            resolve_assignment(expr, ctx, true);
             break;
         case AST_EXPRESSION_VARIABLE: {
-            if (!expr->value) {
-                SEMANTIC_ERROR("Semantic Error: unnamed variable usage");
-            }
-            char *resolved = scope_lookup(ctx, expr->value);
-            if (!resolved) {
-                SEMANTIC_ERROR("Semantic Error: use of undeclared variable '%s'", expr->value);
-            }
-            set_node_value(expr, resolved);
+            Binding *binding = lookup_variable(ctx, expr);
+            int id = binding->id;
+            set_node_value(expr, binding->resolved);
+            expr->var_id = id;
+            record_use(ctx, id);
             break;
         }
         case AST_EXPRESSION_NEGATE:
@@ -288,7 +396,7 @@ static void resolve_expression(ASTNode *expr, ResolveContext *ctx) {
     }
 }
 
-static void resolve_block_items(ASTNode *item, ResolveContext *ctx) {
+static void resolve_block_items(ASTNode *item, Resolver *ctx) {
     for (ASTNode *curr = item; curr; curr = curr->right) {
         if (!curr || curr->type != AST_BLOCK_ITEM) {
             SEMANTIC_ERROR("Semantic Error: invalid block item");
@@ -303,7 +411,7 @@ static void resolve_block_items(ASTNode *item, ResolveContext *ctx) {
     }
 }
 
-void resolve_variables(ASTNode *program) {
+void resolve_variables(ASTNode *program, VarUsageTable *usage) {
     if (!program || program->type != AST_PROGRAM) {
         SEMANTIC_ERROR("Semantic Error: expected program node");
     }
@@ -313,8 +421,70 @@ void resolve_variables(ASTNode *program) {
         SEMANTIC_ERROR("Semantic Error: expected function definition");
     }
 
-    ResolveContext ctx = {0};
+    Resolver ctx = {0};
+    ctx.usage = usage;
     scope_push(&ctx); // function scope
     resolve_block_items(function->left, &ctx);
     scope_pop(&ctx);
+    context_destroy(&ctx);
+}
+
+Resolver *resolver_create(void) {
+    Resolver *r = (Resolver *)calloc(1, sizeof(Resolver));
+    if (!r) {
+        SEMANTIC_ERROR("Out of memory while creating resolver");
+    }
+    scope_push(r); // function scope
+    return r;
+}
+
+void resolver_destroy(Resolver *r) {
+    if (!r) return;
+    context_destroy(r);
+    free(r);
+}
+
+void resolver_scope_push(Resolver *r) {
+    scope_push(r);
+}
+
+void resolver_scope_pop(Resolver *r) {
+    scope_pop(r);
+}
+
+void resolver_loop_enter(Resolver *r) {
+    r->loop_depth++;
+}
+
+void resolver_loop_exit(Resolver *r) {
+    r->loop_depth--;
+}
+
+const char *resolver_declare(Resolver *r, ASTNode *decl) {
+    // The AST keeps its original identifier, so the resolver owns the
+    // unique name for as long as it lives.
+    char *resolved = declare_variable(r, decl)->resolved;
+    context_keep_name(r, resolved);
+    return resolved;
+}
+
+const char *resolver_lookup(Resolver *r, ASTNode *var) {
+    return lookup_variable(r, var)->resolved;
+}
+
+const char *resolver_assignment_target(Resolver *r, ASTNode *assign) {
+    check_assignment_target(assign);
+    return lookup_variable(r, assign->left)->resolved;
+}
+
+void resolver_check_jump(Resolver *r, ASTNode *stmt) {
+    check_loop_jump(r, stmt);
+}
+
+void var_usage_free(VarUsageTable *usage) {
+    if (!usage) return;
+    free(usage->vars);
+    usage->vars = NULL;
+    usage->count = 0;
+    usage->capacity = 0;
 }
@@ -1,20 +1,29 @@
 #include "../../include/tacky/tacky.h"
+#include "../../include/semantic/semantic.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 typedef struct LoopContext {
-    const char *break_label;
-    const char *continue_label;
+    int break_label;
+    int continue_label;
     struct LoopContext *parent;
 } LoopContext;
 
+// Hash index from source variable names to their index in the function's
+// var_names, so each variable gets a single index however often it is used.
 typedef struct {
-    int temp_counter;
-    int label_counter;
-    TackyInstr *head;
-    TackyInstr *tail;
+    int *slots;   // var index + 1, 0 when empty
+    int capacity; // power of two
+    int used;
+} VarIndex;
+
+typedef struct {
+    TackyFunction *fn;
     LoopContext *loop_stack;
+    VarIndex vars;
+    Resolver *resolver; // set when names are resolved during lowering
+    const VarUsageTable *usage; // optional facts from resolve_variables
 } TackyGenCtx;
 
 static char *xstrdup_local(const char *s) {
@@ -25,29 +34,217 @@ static char *xstrdup_local(const char *s) {
     return p;
 }
 
-static char *make_temp(TackyGenCtx *ctx) {
-    char buf[32];
-    snprintf(buf, sizeof(buf), "t%d", ctx->temp_counter++);
-    return xstrdup_local(buf);
+static void out_of_memory(void) {
+    fprintf(stderr, "Out of memory while generating TACKY\n");
+    exit(1);
+}
+
+static unsigned int hash_name(const char *s) {
+    unsigned int h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int append_var(TackyFunction *fn, char *name) {
+    if (fn->var_count == fn->var_capacity) {
+        int new_cap = fn->var_capacity ? fn->var_capacity * 2 : 16;
+        char **resized = (char **)realloc(fn->var_names, (size_t)new_cap * sizeof(char *));
+        if (!resized) out_of_memory();
+        fn->var_names = resized;
+        fn->var_capacity = new_cap;
+    }
+    fn->var_names[fn->var_count] = name;
+    return fn->var_count++;
+}
+
+int tacky_new_temp(TackyFunction *fn) {
+    return append_var(fn, NULL);
 }
 
-static char *make_label(TackyGenCtx *ctx, const char *prefix) {
-    char buf[64];
-    snprintf(buf, sizeof(buf), "%s%d", prefix, ctx->label_counter++);
-    return xstrdup_local(buf);
+int tacky_new_var(TackyFunction *fn, const char *name) {
+    if (!name) return append_var(fn, NULL);
+    char *copy = xstrdup_local(name);
+    if (!copy) out_of_memory();
+    return append_var(fn, copy);
 }
 
-static void emit_instr(TackyGenCtx *ctx, TackyInstr *ins) {
-    ins->next = NULL;
-    if (!ctx->head) {
-        ctx->head = ctx->tail = ins;
+int tacky_new_label(TackyFunction *fn, TackyLabelKind kind) {
+    if (fn->label_count == fn->label_capacity) {
+        int new_cap = fn->label_capacity ? fn->label_capacity * 2 : 16;
+        unsigned char *resized = (unsigned char *)realloc(fn->label_kinds, (size_t)new_cap);
+        if (!resized) out_of_memory();
+        fn->label_kinds = resized;
+        fn->label_capacity = new_cap;
+    }
+    fn->label_kinds[fn->label_count] = (unsigned char)kind;
+    return fn->label_count++;
+}
+
+static void var_index_insert(VarIndex *idx, const TackyFunction *fn, int var) {
+    unsigned int mask = (unsigned int)idx->capacity - 1;
+    unsigned int slot = hash_name(fn->var_names[var]) & mask;
+    while (idx->slots[slot]) slot = (slot + 1) & mask;
+    idx->slots[slot] = var + 1;
+    idx->used++;
+}
+
+static int intern_var(TackyGenCtx *ctx, const char *name) {
+    TackyFunction *fn = ctx->fn;
+    VarIndex *idx = &ctx->vars;
+    if (idx->capacity) {
+        unsigned int mask = (unsigned int)idx->capacity - 1;
+        for (unsigned int slot = hash_name(name) & mask; idx->slots[slot]; slot = (slot + 1) & mask) {
+            int var = idx->slots[slot] - 1;
+            if (strcmp(fn->var_names[var], name) == 0) return var;
+        }
+    }
+    char *copy = xstrdup_local(name);
+    if (!copy) out_of_memory();
+    int var = append_var(fn, copy);
+    if ((idx->used + 1) * 2 > idx->capacity) {
+        int new_cap = idx->capacity ? idx->capacity * 2 : 64;
+        free(idx->slots);
+        idx->slots = (int *)calloc((size_t)new_cap, sizeof(int));
+        if (!idx->slots) out_of_memory();
+        idx->capacity = new_cap;
+        idx->used = 0;
+        for (int i = 0; i < fn->var_count; i++) {
+            if (fn->var_names[i]) var_index_insert(idx, fn, i);
+        }
     } else {
-        ctx->tail->next = ins;
-        ctx->tail = ins;
+        var_index_insert(idx, fn, var);
+    }
+    return var;
+}
+
+static int make_temp(TackyGenCtx *ctx) {
+    return tacky_new_temp(ctx->fn);
+}
+
+static int make_label(TackyGenCtx *ctx, TackyLabelKind kind) {
+    return tacky_new_label(ctx->fn, kind);
+}
+
+static void reserve_instrs(TackyFunction *fn, int extra) {
+    if (fn->instr_count + extra <= fn->instr_capacity) return;
+    int new_cap = fn->instr_capacity ? fn->instr_capacity * 2 : 64;
+    while (new_cap < fn->instr_count + extra) new_cap *= 2;
+    TackyInstr *resized = (TackyInstr *)realloc(fn->body, (size_t)new_cap * sizeof(TackyInstr));
+    if (!resized) out_of_memory();
+    fn->body = resized;
+    fn->instr_capacity = new_cap;
+}
+
+TackyInstr *tacky_append(TackyFunction *fn, TackyInstrKind kind) {
+    reserve_instrs(fn, 1);
+    TackyInstr *ins = &fn->body[fn->instr_count++];
+    memset(ins, 0, sizeof(*ins));
+    ins->kind = (unsigned char)kind;
+    return ins;
+}
+
+// Opens a gap of count NOPs before index at and returns its first slot.
+TackyInstr *tacky_insert(TackyFunction *fn, int at, int count) {
+    reserve_instrs(fn, count);
+    memmove(&fn->body[at + count], &fn->body[at], (size_t)(fn->instr_count - at) * sizeof(TackyInstr));
+    memset(&fn->body[at], 0, (size_t)count * sizeof(TackyInstr));
+    for (int i = 0; i < count; i++) fn->body[at + i].kind = TACKY_INSTR_NOP;
+    fn->instr_count += count;
+    return &fn->body[at];
+}
+
+void tacky_compact(TackyFunction *fn) {
+    int out = 0;
+    for (int i = 0; i < fn->instr_count; i++) {
+        if (fn->body[i].kind == TACKY_INSTR_NOP) continue;
+        fn->body[out++] = fn->body[i];
+    }
+    fn->instr_count = out;
+}
+
+TackyInstr *tacky_queue_insert(TackyInsertions *q, int at, int count) {
+    if (q->count + count > q->capacity) {
+        int new_cap = q->capacity ? q->capacity * 2 : 64;
+        while (new_cap < q->count + count) new_cap *= 2;
+        TackyInstr *instrs = (TackyInstr *)realloc(q->instrs, (size_t)new_cap * sizeof(TackyInstr));
+        if (!instrs) out_of_memory();
+        q->instrs = instrs;
+        int *positions = (int *)realloc(q->at, (size_t)new_cap * sizeof(int));
+        if (!positions) out_of_memory();
+        q->at = positions;
+        q->capacity = new_cap;
+    }
+    TackyInstr *slots = &q->instrs[q->count];
+    memset(slots, 0, (size_t)count * sizeof(TackyInstr));
+    for (int i = 0; i < count; i++) {
+        slots[i].kind = TACKY_INSTR_NOP;
+        q->at[q->count + i] = at;
     }
+    q->count += count;
+    return slots;
 }
 
-static void loop_push(TackyGenCtx *ctx, const char *break_label, const char *continue_label) {
+// A counting sort of the queue by position, stable so runs for the same
+// index keep their order, then one merge with the body from the back.
+void tacky_apply_insertions(TackyFunction *fn, TackyInsertions *q) {
+    if (q->count == 0) return;
+    int n = fn->instr_count;
+    int *start = (int *)calloc((size_t)n + 2, sizeof(int));
+    int *order = (int *)malloc((size_t)q->count * sizeof(int));
+    if (!start || !order) out_of_memory();
+    for (int k = 0; k < q->count; k++) start[q->at[k] + 1]++;
+    for (int i = 0; i <= n; i++) start[i + 1] += start[i];
+    for (int k = 0; k < q->count; k++) order[start[q->at[k]]++] = k;
+
+    reserve_instrs(fn, q->count);
+    int out = n + q->count;
+    int k = q->count;
+    for (int i = n; i >= 0; i--) {
+        if (i < n) fn->body[--out] = fn->body[i];
+        while (k > 0 && q->at[order[k - 1]] == i) fn->body[--out] = q->instrs[order[--k]];
+    }
+    fn->instr_count = n + q->count;
+    q->count = 0;
+    free(start);
+    free(order);
+}
+
+void tacky_insertions_free(TackyInsertions *q) {
+    free(q->instrs);
+    free(q->at);
+    memset(q, 0, sizeof(*q));
+}
+
+static TackyInstr *emit_instr(TackyGenCtx *ctx, TackyInstrKind kind) {
+    return tacky_append(ctx->fn, kind);
+}
+
+static void emit_copy(TackyGenCtx *ctx, TackyVal src, int dst) {
+    TackyInstr *ins = emit_instr(ctx, TACKY_INSTR_COPY);
+    ins->src1 = src;
+    ins->dst = dst;
+}
+
+static void emit_jump(TackyGenCtx *ctx, int target) {
+    TackyInstr *ins = emit_instr(ctx, TACKY_INSTR_JUMP);
+    ins->label = target;
+}
+
+static void emit_cond_jump(TackyGenCtx *ctx, TackyInstrKind kind, TackyVal cond, int target) {
+    TackyInstr *ins = emit_instr(ctx, kind);
+    ins->src1 = cond;
+    ins->label = target;
+}
+
+static void emit_label(TackyGenCtx *ctx, int label) {
+    TackyInstr *ins = emit_instr(ctx, TACKY_INSTR_LABEL);
+    ins->label = label;
+}
+
+static void loop_push(TackyGenCtx *ctx, int break_label, int continue_label) {
     LoopContext *loop = (LoopContext *)malloc(sizeof(LoopContext));
     if (!loop) {
         fprintf(stderr, "Out of memory while creating loop context\n");
@@ -66,31 +263,54 @@ static void loop_pop(TackyGenCtx *ctx) {
     free(loop);
 }
 
-static const char *current_break_label(TackyGenCtx *ctx) {
-    return ctx->loop_stack ? ctx->loop_stack->break_label : NULL;
+static int current_break_label(TackyGenCtx *ctx) {
+    return ctx->loop_stack ? ctx->loop_stack->break_label : -1;
+}
+
+static int current_continue_label(TackyGenCtx *ctx) {
+    return ctx->loop_stack ? ctx->loop_stack->continue_label : -1;
 }
 
-static const char *current_continue_label(TackyGenCtx *ctx) {
-    return ctx->loop_stack ? ctx->loop_stack->continue_label : NULL;
+static const char *variable_name(TackyGenCtx *ctx, ASTNode *var) {
+    return ctx->resolver ? resolver_lookup(ctx->resolver, var) : var->value;
+}
+
+static const VarUsage *usage_of(TackyGenCtx *ctx, ASTNode *node) {
+    if (!ctx->usage || !node || node->var_id < 0 || node->var_id >= ctx->usage->count) return NULL;
+    return &ctx->usage->vars[node->var_id];
+}
+
+// A variable that is never read needs no stores at all.
+static bool is_dead_variable(const VarUsage *u) {
+    return u && u->uses == 0;
+}
+
+// A variable whose every store writes the same literal reads as that literal.
+static bool is_constant_variable(const VarUsage *u) {
+    return u && u->constant;
+}
+
+static void scope_enter(TackyGenCtx *ctx) {
+    if (ctx->resolver) resolver_scope_push(ctx->resolver);
+}
+
+static void scope_leave(TackyGenCtx *ctx) {
+    if (ctx->resolver) resolver_scope_pop(ctx->resolver);
+}
+
+static void loop_body_enter(TackyGenCtx *ctx) {
+    if (ctx->resolver) resolver_loop_enter(ctx->resolver);
+}
+
+static void loop_body_leave(TackyGenCtx *ctx) {
+    if (ctx->resolver) resolver_loop_exit(ctx->resolver);
 }
 
 static TackyVal tv_const(int v) {
-    TackyVal t; t.kind = TACKY_VAL_CONSTANT; t.constant = v; t.var_name = NULL; t.owns_name = false; return t;
-}
-static TackyVal tv_var(const char *name, bool take_ownership) {
-    TackyVal t; t.kind = TACKY_VAL_VAR; t.constant = 0;
-    if (take_ownership) {
-        t.var_name = xstrdup_local(name);
-        if (!t.var_name) {
-            fprintf(stderr, "Out of memory while duplicating variable name\n");
-            exit(1);
-        }
-        t.owns_name = true;
-    } else {
-        t.var_name = (char *)name;
-        t.owns_name = false;
-    }
-    return t;
+    TackyVal t; t.kind = TACKY_VAL_CONSTANT; t.value = v; return t;
+}
+static TackyVal tv_var(int var) {
+    TackyVal t; t.kind = TACKY_VAL_VAR; t.value = var; return t;
 }
 
 static TackyUnaryOp convert_unop(ASTNodeType t) {
@@ -123,39 +343,94 @@ static void gen_block_items(ASTNode *item, TackyGenCtx *ctx);
 static void gen_statement(ASTNode *stmt, TackyGenCtx *ctx);
 static void gen_declaration(ASTNode *decl, TackyGenCtx *ctx);
 
+static TackyVal gen_exp(ASTNode *e, TackyGenCtx *ctx);
+
+// Jumping code for a condition: jumps to target if e's truth value is
+// jump_if and falls through otherwise. &&, || and ! become branches
+// straight to where their outcome leads, so a condition built from them
+// never stores an intermediate 0/1 value.
+static void gen_branch(ASTNode *e, TackyGenCtx *ctx, bool jump_if, int target) {
+    switch (e->type) {
+        case AST_EXPRESSION_NOT:
+            gen_branch(e->left, ctx, !jump_if, target);
+            return;
+        case AST_EXPRESSION_LOGICAL_AND:
+        case AST_EXPRESSION_LOGICAL_OR: {
+            // Either operand decides && when false and || when true; the
+            // right one decides otherwise.
+            bool decides = e->type == AST_EXPRESSION_LOGICAL_OR;
+            if (jump_if == decides) {
+                gen_branch(e->left, ctx, decides, target);
+                gen_branch(e->right, ctx, decides, target);
+            } else {
+                int skip = make_label(ctx, decides ? TACKY_LABEL_OR_TRUE : TACKY_LABEL_AND_FALSE);
+                gen_branch(e->left, ctx, decides, skip);
+                gen_branch(e->right, ctx, jump_if, target);
+                emit_label(ctx, skip);
+            }
+            return;
+        }
+        case AST_EXPRESSION_CONDITIONAL: {
+            int else_label = make_label(ctx, TACKY_LABEL_COND_ELSE);
+            int end_label = make_label(ctx, TACKY_LABEL_COND_END);
+            gen_branch(e->left, ctx, false, else_label);
+            gen_branch(e->right, ctx, jump_if, target);
+            emit_jump(ctx, end_label);
+            emit_label(ctx, else_label);
+            gen_branch(e->third, ctx, jump_if, target);
+            emit_label(ctx, end_label);
+            return;
+        }
+        default: {
+            TackyVal v = gen_exp(e, ctx);
+            if (v.kind == TACKY_VAL_CONSTANT) {
+                if ((v.value != 0) == jump_if) emit_jump(ctx, target);
+                return;
+            }
+            emit_cond_jump(ctx, jump_if ? TACKY_INSTR_JUMP_IF_NOT_ZERO : TACKY_INSTR_JUMP_IF_ZERO, v, target);
+            return;
+        }
+    }
+}
+
 static TackyVal gen_exp(ASTNode *e, TackyGenCtx *ctx) {
     switch (e->type) {
         case AST_EXPRESSION_CONSTANT: {
             int v = atoi(e->value);
             return tv_const(v);
         }
-        case AST_EXPRESSION_VARIABLE:
-            return tv_var(e->value, true);
+        case AST_EXPRESSION_VARIABLE: {
+            const VarUsage *u = usage_of(ctx, e);
+            if (is_constant_variable(u)) return tv_const(u->const_value);
+            return tv_var(intern_var(ctx, variable_name(ctx, e)));
+        }
         case AST_EXPRESSION_ASSIGNMENT: {
-            if (!e->left || e->left->type != AST_EXPRESSION_VARIABLE) {
+            const char *name;
+            if (ctx->resolver) {
+                name = resolver_assignment_target(ctx->resolver, e);
+            } else if (!e->left || e->left->type != AST_EXPRESSION_VARIABLE) {
                 return tv_const(0);
+            } else {
+                name = e->left->value;
             }
-            const char *name = e->left->value;
+            const VarUsage *u = usage_of(ctx, e->left);
+            if (is_constant_variable(u)) return tv_const(u->const_value);
             TackyVal rhs = gen_exp(e->right, ctx);
-            TackyInstr *copy = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            copy->kind = TACKY_INSTR_COPY;
-            copy->copy_src = rhs;
-            copy->copy_dst = xstrdup_local(name);
-            emit_instr(ctx, copy);
-            return tv_var(name, true);
+            if (is_dead_variable(u)) return rhs;
+            int var = intern_var(ctx, name);
+            emit_copy(ctx, rhs, var);
+            return tv_var(var);
         }
         case AST_EXPRESSION_NEGATE:
         case AST_EXPRESSION_COMPLEMENT:
         case AST_EXPRESSION_NOT: {
             TackyVal src = gen_exp(e->left, ctx);
-            char *dst = make_temp(ctx);
-            TackyInstr *ins = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            ins->kind = TACKY_INSTR_UNARY;
-            ins->un_op = convert_unop(e->type);
-            ins->un_src = src;
-            ins->un_dst = dst;
-            emit_instr(ctx, ins);
-            return tv_var(dst, false);
+            int dst = make_temp(ctx);
+            TackyInstr *ins = emit_instr(ctx, TACKY_INSTR_UNARY);
+            ins->op = (unsigned char)convert_unop(e->type);
+            ins->src1 = src;
+            ins->dst = dst;
+            return tv_var(dst);
         }
         case AST_EXPRESSION_ADD:
         case AST_EXPRESSION_SUBTRACT:
@@ -170,157 +445,55 @@ static TackyVal gen_exp(ASTNode *e, TackyGenCtx *ctx) {
         case AST_EXPRESSION_GREATER_EQUAL: {
             TackyVal v1 = gen_exp(e->left, ctx);
             TackyVal v2 = gen_exp(e->right, ctx);
-            char *dst = make_temp(ctx);
-            TackyInstr *ins = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            ins->kind = TACKY_INSTR_BINARY;
-            ins->bin_op = convert_binop(e->type);
-            ins->bin_src1 = v1;
-            ins->bin_src2 = v2;
-            ins->bin_dst = dst;
-            emit_instr(ctx, ins);
-            return tv_var(dst, false);
+            int dst = make_temp(ctx);
+            TackyInstr *ins = emit_instr(ctx, TACKY_INSTR_BINARY);
+            ins->op = (unsigned char)convert_binop(e->type);
+            ins->src1 = v1;
+            ins->src2 = v2;
+            ins->dst = dst;
+            return tv_var(dst);
         }
         case AST_EXPRESSION_LOGICAL_AND: {
-            TackyVal left = gen_exp(e->left, ctx);
-            char *result = make_temp(ctx);
-            char *false_label = make_label(ctx, "and_false");
-            char *end_label = make_label(ctx, "and_end");
-
-            TackyInstr *jump1 = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump1->kind = TACKY_INSTR_JUMP_IF_ZERO;
-            jump1->cond_val = left;
-            jump1->jump_target = xstrdup_local(false_label);
-            emit_instr(ctx, jump1);
-
-            TackyVal right = gen_exp(e->right, ctx);
-            TackyInstr *jump2 = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump2->kind = TACKY_INSTR_JUMP_IF_ZERO;
-            jump2->cond_val = right;
-            jump2->jump_target = xstrdup_local(false_label);
-            emit_instr(ctx, jump2);
-
-            TackyInstr *copy_true = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            copy_true->kind = TACKY_INSTR_COPY;
-            copy_true->copy_src = tv_const(1);
-            copy_true->copy_dst = result;
-            emit_instr(ctx, copy_true);
-
-            TackyInstr *jump_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_end->kind = TACKY_INSTR_JUMP;
-            jump_end->jump_target = xstrdup_local(end_label);
-            emit_instr(ctx, jump_end);
-
-            TackyInstr *label_false = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_false->kind = TACKY_INSTR_LABEL;
-            label_false->label = false_label;
-            emit_instr(ctx, label_false);
-
-            TackyInstr *copy_false = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            copy_false->kind = TACKY_INSTR_COPY;
-            copy_false->copy_src = tv_const(0);
-            copy_false->copy_dst = xstrdup_local(result);
-            emit_instr(ctx, copy_false);
-
-            TackyInstr *label_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_end->kind = TACKY_INSTR_LABEL;
-            label_end->label = end_label;
-            emit_instr(ctx, label_end);
-
-            return tv_var(result, false);
+            int result = make_temp(ctx);
+            int false_label = make_label(ctx, TACKY_LABEL_AND_FALSE);
+            int end_label = make_label(ctx, TACKY_LABEL_AND_END);
+
+            gen_branch(e, ctx, false, false_label);
+            emit_copy(ctx, tv_const(1), result);
+            emit_jump(ctx, end_label);
+            emit_label(ctx, false_label);
+            emit_copy(ctx, tv_const(0), result);
+            emit_label(ctx, end_label);
+            return tv_var(result);
         }
         case AST_EXPRESSION_LOGICAL_OR: {
-            TackyVal left = gen_exp(e->left, ctx);
-            char *result = make_temp(ctx);
-            char *true_label = make_label(ctx, "or_true");
-            char *end_label = make_label(ctx, "or_end");
-
-            TackyInstr *jump1 = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump1->kind = TACKY_INSTR_JUMP_IF_NOT_ZERO;
-            jump1->cond_val = left;
-            jump1->jump_target = xstrdup_local(true_label);
-            emit_instr(ctx, jump1);
-
-            TackyVal right = gen_exp(e->right, ctx);
-            TackyInstr *jump2 = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump2->kind = TACKY_INSTR_JUMP_IF_NOT_ZERO;
-            jump2->cond_val = right;
-            jump2->jump_target = xstrdup_local(true_label);
-            emit_instr(ctx, jump2);
-
-            TackyInstr *copy_false = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            copy_false->kind = TACKY_INSTR_COPY;
-            copy_false->copy_src = tv_const(0);
-            copy_false->copy_dst = result;
-            emit_instr(ctx, copy_false);
-
-            TackyInstr *jump_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_end->kind = TACKY_INSTR_JUMP;
-            jump_end->jump_target = xstrdup_local(end_label);
-            emit_instr(ctx, jump_end);
-
-            TackyInstr *label_true = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_true->kind = TACKY_INSTR_LABEL;
-            label_true->label = true_label;
-            emit_instr(ctx, label_true);
-
-            TackyInstr *copy_true = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            copy_true->kind = TACKY_INSTR_COPY;
-            copy_true->copy_src = tv_const(1);
-            copy_true->copy_dst = xstrdup_local(result);
-            emit_instr(ctx, copy_true);
-
-            TackyInstr *label_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_end->kind = TACKY_INSTR_LABEL;
-            label_end->label = end_label;
-            emit_instr(ctx, label_end);
-
-            return tv_var(result, false);
+            int result = make_temp(ctx);
+            int true_label = make_label(ctx, TACKY_LABEL_OR_TRUE);
+            int end_label = make_label(ctx, TACKY_LABEL_OR_END);
+
+            gen_branch(e, ctx, true, true_label);
+            emit_copy(ctx, tv_const(0), result);
+            emit_jump(ctx, end_label);
+            emit_label(ctx, true_label);
+            emit_copy(ctx, tv_const(1), result);
+            emit_label(ctx, end_label);
+            return tv_var(result);
         }
         case AST_EXPRESSION_CONDITIONAL: {
             TackyVal cond = gen_exp(e->left, ctx);
-            char *else_label = make_label(ctx, "cond_else");
-            char *end_label = make_label(ctx, "cond_end");
-            char *result = make_temp(ctx);
-
-            TackyInstr *jump = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump->kind = TACKY_INSTR_JUMP_IF_ZERO;
-            jump->cond_val = cond;
-            jump->jump_target = xstrdup_local(else_label);
-            emit_instr(ctx, jump);
+            int else_label = make_label(ctx, TACKY_LABEL_COND_ELSE);
+            int end_label = make_label(ctx, TACKY_LABEL_COND_END);
+            int result = make_temp(ctx);
 
+            emit_cond_jump(ctx, TACKY_INSTR_JUMP_IF_ZERO, cond, else_label);
             TackyVal then_val = gen_exp(e->right, ctx);
-            TackyInstr *copy_then = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            copy_then->kind = TACKY_INSTR_COPY;
-            copy_then->copy_src = then_val;
-            copy_then->copy_dst = xstrdup_local(result);
-            emit_instr(ctx, copy_then);
-
-            TackyInstr *jump_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_end->kind = TACKY_INSTR_JUMP;
-            jump_end->jump_target = xstrdup_local(end_label);
-            emit_instr(ctx, jump_end);
-
-            TackyInstr *label_else = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_else->kind = TACKY_INSTR_LABEL;
-            label_else->label = xstrdup_local(else_label);
-            emit_instr(ctx, label_else);
-
+            emit_copy(ctx, then_val, result);
+            emit_jump(ctx, end_label);
+            emit_label(ctx, else_label);
             TackyVal else_val = gen_exp(e->third, ctx);
-            TackyInstr *copy_else = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            copy_else->kind = TACKY_INSTR_COPY;
-            copy_else->copy_src = else_val;
-            copy_else->copy_dst = xstrdup_local(result);
-            emit_instr(ctx, copy_else);
-
-            TackyInstr *label_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_end->kind = TACKY_INSTR_LABEL;
-            label_end->label = xstrdup_local(end_label);
-            emit_instr(ctx, label_end);
-
-            free(else_label);
-            free(end_label);
-
-            return tv_var(result, false);
+            emit_copy(ctx, else_val, result);
+            emit_label(ctx, end_label);
+            return tv_var(result);
         }
         default:
             return tv_const(0);
@@ -333,132 +506,75 @@ static void gen_statement(ASTNode *stmt, TackyGenCtx *ctx) {
     if (!stmt) return;
     switch (stmt->type) {
         case AST_STATEMENT_RETURN: {
-            TackyInstr *retins = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            retins->kind = TACKY_INSTR_RETURN;
-            retins->ret_val = stmt->left ? gen_exp(stmt->left, ctx) : tv_const(0);
-            emit_instr(ctx, retins);
+            TackyVal val = stmt->left ? gen_exp(stmt->left, ctx) : tv_const(0);
+            TackyInstr *retins = emit_instr(ctx, TACKY_INSTR_RETURN);
+            retins->src1 = val;
             break;
         }
-        case AST_STATEMENT_EXPRESSION: {
-            TackyVal tmp = gen_exp(stmt->left, ctx);
-            if (tmp.kind == TACKY_VAL_VAR && tmp.owns_name && tmp.var_name) {
-                free(tmp.var_name);
-            }
+        case AST_STATEMENT_EXPRESSION:
+            (void)gen_exp(stmt->left, ctx);
             break;
-        }
         case AST_STATEMENT_NULL:
             break;
         case AST_STATEMENT_COMPOUND:
+            scope_enter(ctx);
             gen_block_items(stmt->left, ctx);
+            scope_leave(ctx);
             break;
         case AST_STATEMENT_IF: {
-            TackyVal cond = gen_exp(stmt->left, ctx);
-            char *else_label = NULL;
-            char *end_label = make_label(ctx, "if_end");
+            int else_label = -1;
+            int end_label = make_label(ctx, TACKY_LABEL_IF_END);
 
             if (stmt->third) {
-                else_label = make_label(ctx, "if_else");
+                else_label = make_label(ctx, TACKY_LABEL_IF_ELSE);
             }
 
-            TackyInstr *jump_zero = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_zero->kind = TACKY_INSTR_JUMP_IF_ZERO;
-            jump_zero->cond_val = cond;
-            jump_zero->jump_target = xstrdup_local(stmt->third ? else_label : end_label);
-            emit_instr(ctx, jump_zero);
+            gen_branch(stmt->left, ctx, false, stmt->third ? else_label : end_label);
 
             gen_statement(stmt->right, ctx);
 
             if (stmt->third) {
-                TackyInstr *jump_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-                jump_end->kind = TACKY_INSTR_JUMP;
-                jump_end->jump_target = xstrdup_local(end_label);
-                emit_instr(ctx, jump_end);
-
-                TackyInstr *label_else = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-                label_else->kind = TACKY_INSTR_LABEL;
-                label_else->label = xstrdup_local(else_label);
-                emit_instr(ctx, label_else);
-
+                emit_jump(ctx, end_label);
+                emit_label(ctx, else_label);
                 gen_statement(stmt->third, ctx);
             }
 
-            TackyInstr *label_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_end->kind = TACKY_INSTR_LABEL;
-            label_end->label = xstrdup_local(end_label);
-            emit_instr(ctx, label_end);
-
-            if (else_label) free(else_label);
-            free(end_label);
+            emit_label(ctx, end_label);
             break;
         }
         case AST_STATEMENT_WHILE: {
-            char *cond_label = make_label(ctx, "while_cond");
-            char *end_label = make_label(ctx, "while_end");
+            int cond_label = make_label(ctx, TACKY_LABEL_WHILE_COND);
+            int end_label = make_label(ctx, TACKY_LABEL_WHILE_END);
 
-            TackyInstr *label_cond = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_cond->kind = TACKY_INSTR_LABEL;
-            label_cond->label = xstrdup_local(cond_label);
-            emit_instr(ctx, label_cond);
-
-            TackyVal cond_val = gen_exp(stmt->left, ctx);
-            TackyInstr *jump_zero = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_zero->kind = TACKY_INSTR_JUMP_IF_ZERO;
-            jump_zero->cond_val = cond_val;
-            jump_zero->jump_target = xstrdup_local(end_label);
-            emit_instr(ctx, jump_zero);
+            emit_label(ctx, cond_label);
+            gen_branch(stmt->left, ctx, false, end_label);
 
             loop_push(ctx, end_label, cond_label);
+            loop_body_enter(ctx);
             gen_statement(stmt->right, ctx);
+            loop_body_leave(ctx);
             loop_pop(ctx);
 
-            TackyInstr *jump_back = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_back->kind = TACKY_INSTR_JUMP;
-            jump_back->jump_target = xstrdup_local(cond_label);
-            emit_instr(ctx, jump_back);
-
-            TackyInstr *label_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_end->kind = TACKY_INSTR_LABEL;
-            label_end->label = xstrdup_local(end_label);
-            emit_instr(ctx, label_end);
-
-            free(cond_label);
-            free(end_label);
+            emit_jump(ctx, cond_label);
+            emit_label(ctx, end_label);
             break;
         }
         case AST_STATEMENT_DO_WHILE: {
-            char *body_label = make_label(ctx, "do_body");
-            char *continue_label = make_label(ctx, "do_continue");
-            char *end_label = make_label(ctx, "do_end");
+            int body_label = make_label(ctx, TACKY_LABEL_DO_BODY);
+            int continue_label = make_label(ctx, TACKY_LABEL_DO_CONTINUE);
+            int end_label = make_label(ctx, TACKY_LABEL_DO_END);
 
-            TackyInstr *label_body = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_body->kind = TACKY_INSTR_LABEL;
-            label_body->label = xstrdup_local(body_label);
-            emit_instr(ctx, label_body);
+            emit_label(ctx, body_label);
 
             loop_push(ctx, end_label, continue_label);
+            loop_body_enter(ctx);
             gen_statement(stmt->left, ctx);
+            loop_body_leave(ctx);
             loop_pop(ctx);
 
-            TackyInstr *label_continue = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_continue->kind = TACKY_INSTR_LABEL;
-            label_continue->label = xstrdup_local(continue_label);
-            emit_instr(ctx, label_continue);
-
-            TackyVal cond_val = gen_exp(stmt->right, ctx);
-            TackyInstr *jump_back = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_back->kind = TACKY_INSTR_JUMP_IF_NOT_ZERO;
-            jump_back->cond_val = cond_val;
-            jump_back->jump_target = xstrdup_local(body_label);
-            emit_instr(ctx, jump_back);
-
-            TackyInstr *label_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_end->kind = TACKY_INSTR_LABEL;
-            label_end->label = xstrdup_local(end_label);
-            emit_instr(ctx, label_end);
-
-            free(body_label);
-            free(continue_label);
-            free(end_label);
+            emit_label(ctx, continue_label);
+            gen_branch(stmt->right, ctx, true, body_label);
+            emit_label(ctx, end_label);
             break;
         }
         case AST_STATEMENT_FOR: {
@@ -467,6 +583,7 @@ static void gen_statement(ASTNode *stmt, TackyGenCtx *ctx) {
             ASTNode *post = stmt->third;
             ASTNode *body = stmt->fourth;
 
+            scope_enter(ctx);
             if (init) {
                 if (init->type == AST_DECLARATION) {
                     gen_declaration(init, ctx);
@@ -475,79 +592,54 @@ static void gen_statement(ASTNode *stmt, TackyGenCtx *ctx) {
                 }
             }
 
-            char *cond_label = make_label(ctx, "for_cond");
-            char *continue_label = make_label(ctx, "for_continue");
-            char *end_label = make_label(ctx, "for_end");
+            int cond_label = make_label(ctx, TACKY_LABEL_FOR_COND);
+            int continue_label = make_label(ctx, TACKY_LABEL_FOR_CONTINUE);
+            int end_label = make_label(ctx, TACKY_LABEL_FOR_END);
 
-            TackyInstr *label_cond = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_cond->kind = TACKY_INSTR_LABEL;
-            label_cond->label = xstrdup_local(cond_label);
-            emit_instr(ctx, label_cond);
+            emit_label(ctx, cond_label);
 
             if (condition) {
-                TackyVal cond_val = gen_exp(condition, ctx);
-                TackyInstr *jump_zero = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-                jump_zero->kind = TACKY_INSTR_JUMP_IF_ZERO;
-                jump_zero->cond_val = cond_val;
-                jump_zero->jump_target = xstrdup_local(end_label);
-                emit_instr(ctx, jump_zero);
+                gen_branch(condition, ctx, false, end_label);
             }
 
             loop_push(ctx, end_label, continue_label);
+            loop_body_enter(ctx);
             if (body) {
                 gen_statement(body, ctx);
             }
+            loop_body_leave(ctx);
             loop_pop(ctx);
 
-            TackyInstr *label_continue = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_continue->kind = TACKY_INSTR_LABEL;
-            label_continue->label = xstrdup_local(continue_label);
-            emit_instr(ctx, label_continue);
+            emit_label(ctx, continue_label);
 
             if (post) {
-                TackyVal post_val = gen_exp(post, ctx);
-                if (post_val.kind == TACKY_VAL_VAR && post_val.owns_name && post_val.var_name) {
-                    free(post_val.var_name);
-                }
+                (void)gen_exp(post, ctx);
             }
 
-            TackyInstr *jump_back = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jump_back->kind = TACKY_INSTR_JUMP;
-            jump_back->jump_target = xstrdup_local(cond_label);
-            emit_instr(ctx, jump_back);
+            emit_jump(ctx, cond_label);
+            emit_label(ctx, end_label);
 
-            TackyInstr *label_end = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            label_end->kind = TACKY_INSTR_LABEL;
-            label_end->label = xstrdup_local(end_label);
-            emit_instr(ctx, label_end);
-
-            free(cond_label);
-            free(continue_label);
-            free(end_label);
+            scope_leave(ctx);
             break;
         }
         case AST_STATEMENT_BREAK: {
-            const char *target = current_break_label(ctx);
-            if (!target) {
+            if (ctx->resolver) resolver_check_jump(ctx->resolver, stmt);
+            int target = current_break_label(ctx);
+            if (target < 0) {
                 fprintf(stderr, "Internal error: 'break' encountered outside of loop during code generation\n");
                 exit(1);
             }
-            TackyInstr *jmp = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jmp->kind = TACKY_INSTR_JUMP;
-            jmp->jump_target = xstrdup_local(target);
-            emit_instr(ctx, jmp);
+            emit_jump(ctx, target);
             break;
         }
         case AST_STATEMENT_CONTINUE: {
-            const char *target = current_continue_label(ctx);
-            if (!target) {
+            if (ctx->resolver) resolver_check_jump(ctx->resolver, stmt);
+            int target = current_continue_label(ctx);
+            if (target < 0) {
                 fprintf(stderr, "Internal error: 'continue' encountered outside of loop during code generation\n");
                 exit(1);
             }
-            TackyInstr *jmp = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-            jmp->kind = TACKY_INSTR_JUMP;
-            jmp->jump_target = xstrdup_local(target);
-            emit_instr(ctx, jmp);
+            emit_jump(ctx, target);
             break;
         }
         default:
@@ -557,14 +649,14 @@ static void gen_statement(ASTNode *stmt, TackyGenCtx *ctx) {
 
 static void gen_declaration(ASTNode *decl, TackyGenCtx *ctx) {
     if (!decl || decl->type != AST_DECLARATION) return;
+    const char *name = ctx->resolver ? resolver_declare(ctx->resolver, decl) : decl->value;
     if (!decl->left) return; // no initializer
 
+    const VarUsage *u = usage_of(ctx, decl);
+    if (is_constant_variable(u)) return; // the initializer is the literal itself
     TackyVal init = gen_exp(decl->left, ctx);
-    TackyInstr *copy = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-    copy->kind = TACKY_INSTR_COPY;
-    copy->copy_src = init;
-    copy->copy_dst = xstrdup_local(decl->value);
-    emit_instr(ctx, copy);
+    if (is_dead_variable(u)) return; // keep the initializer's side effects, drop the store
+    emit_copy(ctx, init, intern_var(ctx, name));
 }
 
 static void gen_block_items(ASTNode *item, TackyGenCtx *ctx) {
@@ -580,26 +672,79 @@ static void gen_block_items(ASTNode *item, TackyGenCtx *ctx) {
     }
 }
 
-TackyProgram *tacky_from_ast(ASTNode *ast) {
+static TackyProgram *lower_program(ASTNode *ast, Resolver *resolver, const VarUsageTable *usage) {
     if (!ast || ast->type != AST_PROGRAM || !ast->left) return NULL;
     ASTNode *fn = ast->left;
     if (!fn || fn->type != AST_FUNCTION) return NULL;
 
+    TackyFunction *out = (TackyFunction *)calloc(1, sizeof(TackyFunction));
+    if (!out) out_of_memory();
+    out->name = fn->value ? xstrdup_local(fn->value) : xstrdup_local("main");
+
     TackyGenCtx ctx = {0};
+    ctx.fn = out;
+    ctx.resolver = resolver;
+    ctx.usage = usage;
     gen_block_items(fn->left, &ctx);
 
-    TackyInstr *retins = (TackyInstr *)calloc(1, sizeof(TackyInstr));
-    retins->kind = TACKY_INSTR_RETURN;
-    retins->ret_val = tv_const(0);
-    emit_instr(&ctx, retins);
+    TackyInstr *retins = emit_instr(&ctx, TACKY_INSTR_RETURN);
+    retins->src1 = tv_const(0);
+    free(ctx.vars.slots);
 
     TackyProgram *p = (TackyProgram *)malloc(sizeof(TackyProgram));
-    p->fn = (TackyFunction *)malloc(sizeof(TackyFunction));
-    p->fn->name = fn->value ? xstrdup_local(fn->value) : xstrdup_local("main");
-    p->fn->body = ctx.head;
+    p->fn = out;
+    return p;
+}
+
+TackyProgram *tacky_from_ast(ASTNode *ast, const VarUsageTable *usage) {
+    return lower_program(ast, NULL, usage);
+}
+
+TackyProgram *tacky_from_ast_fused(ASTNode *ast) {
+    Resolver *resolver = resolver_create();
+    TackyProgram *p = lower_program(ast, resolver, NULL);
+    resolver_destroy(resolver);
     return p;
 }
 
+const char *tacky_var_name(const TackyFunction *fn, int var, char *buf) {
+    if (!fn || var < 0 || var >= fn->var_count) return "?";
+    if (fn->var_names[var]) return fn->var_names[var];
+    // Resolved source names always carry a "_<n>" suffix, so "t<n>" is free.
+    snprintf(buf, TACKY_NAME_MAX, "t%d", var);
+    return buf;
+}
+
+const char *tacky_label_prefix(TackyLabelKind kind) {
+    switch (kind) {
+        case TACKY_LABEL_AND_FALSE: return "and_false";
+        case TACKY_LABEL_AND_END: return "and_end";
+        case TACKY_LABEL_OR_TRUE: return "or_true";
+        case TACKY_LABEL_OR_END: return "or_end";
+        case TACKY_LABEL_COND_ELSE: return "cond_else";
+        case TACKY_LABEL_COND_END: return "cond_end";
+        case TACKY_LABEL_IF_ELSE: return "if_else";
+        case TACKY_LABEL_IF_END: return "if_end";
+        case TACKY_LABEL_WHILE_COND: return "while_cond";
+        case TACKY_LABEL_WHILE_END: return "while_end";
+        case TACKY_LABEL_DO_BODY: return "do_body";
+        case TACKY_LABEL_DO_CONTINUE: return "do_continue";
+        case TACKY_LABEL_DO_END: return "do_end";
+        case TACKY_LABEL_FOR_COND: return "for_cond";
+        case TACKY_LABEL_FOR_CONTINUE: return "for_continue";
+        case TACKY_LABEL_FOR_END: return "for_end";
+        case TACKY_LABEL_BLOCK: return "block";
+        case TACKY_LABEL_PREHEADER: return "preheader";
+        default: return "L";
+    }
+}
+
+const char *tacky_label_name(const TackyFunction *fn, int label, char *buf) {
+    if (!fn || label < 0 || label >= fn->label_count) return "?";
+    snprintf(buf, TACKY_NAME_MAX, "%s%d", tacky_label_prefix((TackyLabelKind)fn->label_kinds[label]), label);
+    return buf;
+}
+
 static const char *unop_name(TackyUnaryOp op) {
     switch (op) {
         case TACKY_UN_NEGATE: return "Negate";
@@ -626,61 +771,59 @@ static const char *binop_name(TackyBinaryOp op) {
     }
 }
 
-static void free_tacky_val(TackyVal v) {
-    if (v.kind == TACKY_VAL_VAR && v.owns_name && v.var_name) {
-        free(v.var_name);
-    }
+static void print_val_txt(FILE *out, const TackyFunction *fn, TackyVal v) {
+    char buf[TACKY_NAME_MAX];
+    if (v.kind == TACKY_VAL_CONSTANT) fprintf(out, "%d", v.value);
+    else fprintf(out, "%s", tacky_var_name(fn, v.value, buf));
 }
 
-void tacky_print_txt(TackyProgram *p) {
+void tacky_print_txt(TackyProgram *p, FILE *out) {
     if (!p || !p->fn) return;
-    printf("Function %s()\n", p->fn->name);
-    for (TackyInstr *ins = p->fn->body; ins; ins = ins->next) {
-        switch (ins->kind) {
+    const TackyFunction *fn = p->fn;
+    char buf[TACKY_NAME_MAX];
+    fprintf(out, "Function %s()\n", fn->name);
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        switch ((TackyInstrKind)ins->kind) {
             case TACKY_INSTR_UNARY:
-                if (ins->un_src.kind == TACKY_VAL_CONSTANT)
-                    printf("  %s %d -> %s\n", unop_name(ins->un_op), ins->un_src.constant, ins->un_dst);
-                else
-                    printf("  %s %s -> %s\n", unop_name(ins->un_op), ins->un_src.var_name, ins->un_dst);
+                fprintf(out, "  %s ", unop_name((TackyUnaryOp)ins->op));
+                print_val_txt(out, fn, ins->src1);
+                fprintf(out, " -> %s\n", tacky_var_name(fn, ins->dst, buf));
                 break;
-            case TACKY_INSTR_BINARY: {
-                printf("  %s ", binop_name(ins->bin_op));
-                if (ins->bin_src1.kind == TACKY_VAL_CONSTANT) printf("%d, ", ins->bin_src1.constant);
-                else printf("%s, ", ins->bin_src1.var_name);
-                if (ins->bin_src2.kind == TACKY_VAL_CONSTANT) printf("%d ", ins->bin_src2.constant);
-                else printf("%s ", ins->bin_src2.var_name);
-                printf("-> %s\n", ins->bin_dst);
+            case TACKY_INSTR_BINARY:
+                fprintf(out, "  %s ", binop_name((TackyBinaryOp)ins->op));
+                print_val_txt(out, fn, ins->src1);
+                fprintf(out, ", ");
+                print_val_txt(out, fn, ins->src2);
+                fprintf(out, " -> %s\n", tacky_var_name(fn, ins->dst, buf));
                 break;
-            }
             case TACKY_INSTR_COPY:
-                printf("  Copy ");
-                if (ins->copy_src.kind == TACKY_VAL_CONSTANT) printf("%d", ins->copy_src.constant);
-                else printf("%s", ins->copy_src.var_name);
-                printf(" -> %s\n", ins->copy_dst);
+                fprintf(out, "  Copy ");
+                print_val_txt(out, fn, ins->src1);
+                fprintf(out, " -> %s\n", tacky_var_name(fn, ins->dst, buf));
                 break;
             case TACKY_INSTR_JUMP:
-                printf("  Jump %s\n", ins->jump_target);
+                fprintf(out, "  Jump %s\n", tacky_label_name(fn, ins->label, buf));
                 break;
             case TACKY_INSTR_JUMP_IF_ZERO:
-                printf("  JumpIfZero ");
-                if (ins->cond_val.kind == TACKY_VAL_CONSTANT) printf("%d", ins->cond_val.constant);
-                else printf("%s", ins->cond_val.var_name);
-                printf(" -> %s\n", ins->jump_target);
+                fprintf(out, "  JumpIfZero ");
+                print_val_txt(out, fn, ins->src1);
+                fprintf(out, " -> %s\n", tacky_label_name(fn, ins->label, buf));
                 break;
             case TACKY_INSTR_JUMP_IF_NOT_ZERO:
-                printf("  JumpIfNotZero ");
-                if (ins->cond_val.kind == TACKY_VAL_CONSTANT) printf("%d", ins->cond_val.constant);
-                else printf("%s", ins->cond_val.var_name);
-                printf(" -> %s\n", ins->jump_target);
+                fprintf(out, "  JumpIfNotZero ");
+                print_val_txt(out, fn, ins->src1);
+                fprintf(out, " -> %s\n", tacky_label_name(fn, ins->label, buf));
                 break;
             case TACKY_INSTR_LABEL:
-                printf("  Label %s\n", ins->label);
+                fprintf(out, "  Label %s\n", tacky_label_name(fn, ins->label, buf));
                 break;
             case TACKY_INSTR_RETURN:
-                if (ins->ret_val.kind == TACKY_VAL_CONSTANT)
-                    printf("  Return %d\n", ins->ret_val.constant);
-                else
-                    printf("  Return %s\n", ins->ret_val.var_name);
+                fprintf(out, "  Return ");
+                print_val_txt(out, fn, ins->src1);
+                fprintf(out, "\n");
+                break;
+            case TACKY_INSTR_NOP:
                 break;
         }
     }
@@ -702,109 +845,89 @@ static void json_escape(FILE *f, const char *s) {
     }
 }
 
-void tacky_print_json(TackyProgram *p) {
-    if (!p || !p->fn) { printf("null\n"); return; }
-    printf("{\n  \"function\": \"%s\",\n  \"body\": [\n", p->fn->name);
+static void print_val_json(FILE *out, const TackyFunction *fn, TackyVal v) {
+    if (v.kind == TACKY_VAL_CONSTANT) {
+        fprintf(out, "{\"const\": %d}", v.value);
+    } else {
+        char buf[TACKY_NAME_MAX];
+        fprintf(out, "{\"var\": \"");
+        json_escape(out, tacky_var_name(fn, v.value, buf));
+        fprintf(out, "\"}");
+    }
+}
+
+static void print_name_json(FILE *out, const char *key, const char *name) {
+    fprintf(out, ", \"%s\": \"", key);
+    json_escape(out, name);
+    fprintf(out, "\"");
+}
+
+void tacky_print_json(TackyProgram *p, FILE *out) {
+    if (!p || !p->fn) { fprintf(out, "null\n"); return; }
+    const TackyFunction *fn = p->fn;
+    fprintf(out, "{\n  \"function\": \"");
+    json_escape(out, fn->name);
+    fprintf(out, "\",\n  \"body\": [\n");
+    char buf[TACKY_NAME_MAX];
     int first = 1;
-    for (TackyInstr *ins = p->fn->body; ins; ins = ins->next) {
-        if (!first) printf(",\n");
+    for (int i = 0; i < fn->instr_count; i++) {
+        const TackyInstr *ins = &fn->body[i];
+        if (ins->kind == TACKY_INSTR_NOP) continue;
+        if (!first) fprintf(out, ",\n");
         first = 0;
-        printf("    {");
-        if (ins->kind == TACKY_INSTR_UNARY) {
-            printf("\"kind\": \"Unary\", ");
-            printf("\"op\": \"%s\", ", unop_name(ins->un_op));
-            printf("\"src\": ");
-            if (ins->un_src.kind == TACKY_VAL_CONSTANT) printf("{\"const\": %d}", ins->un_src.constant);
-            else { printf("{\"var\": \""); json_escape(stdout, ins->un_src.var_name); printf("\"}"); }
-            printf(", \"dst\": \""); json_escape(stdout, ins->un_dst); printf("\"");
-        } else if (ins->kind == TACKY_INSTR_BINARY) {
-            printf("\"kind\": \"Binary\", ");
-            printf("\"op\": \"%s\", ", binop_name(ins->bin_op));
-            printf("\"src1\": ");
-            if (ins->bin_src1.kind == TACKY_VAL_CONSTANT) printf("{\"const\": %d}", ins->bin_src1.constant);
-            else { printf("{\"var\": \""); json_escape(stdout, ins->bin_src1.var_name); printf("\"}"); }
-            printf(", \"src2\": ");
-            if (ins->bin_src2.kind == TACKY_VAL_CONSTANT) printf("{\"const\": %d}", ins->bin_src2.constant);
-            else { printf("{\"var\": \""); json_escape(stdout, ins->bin_src2.var_name); printf("\"}"); }
-            printf(", \"dst\": \""); json_escape(stdout, ins->bin_dst); printf("\"");
-        } else if (ins->kind == TACKY_INSTR_COPY) {
-            printf("\"kind\": \"Copy\", ");
-            printf("\"src\": ");
-            if (ins->copy_src.kind == TACKY_VAL_CONSTANT) printf("{\"const\": %d}", ins->copy_src.constant);
-            else { printf("{\"var\": \""); json_escape(stdout, ins->copy_src.var_name); printf("\"}"); }
-            printf(", \"dst\": \""); json_escape(stdout, ins->copy_dst); printf("\"");
-        } else if (ins->kind == TACKY_INSTR_JUMP) {
-            printf("\"kind\": \"Jump\", \"target\": \"");
-            json_escape(stdout, ins->jump_target);
-            printf("\"");
-        } else if (ins->kind == TACKY_INSTR_JUMP_IF_ZERO) {
-            printf("\"kind\": \"JumpIfZero\", \"condition\": ");
-            if (ins->cond_val.kind == TACKY_VAL_CONSTANT) printf("{\"const\": %d}", ins->cond_val.constant);
-            else { printf("{\"var\": \""); json_escape(stdout, ins->cond_val.var_name); printf("\"}"); }
-            printf(", \"target\": \"");
-            json_escape(stdout, ins->jump_target);
-            printf("\"");
-        } else if (ins->kind == TACKY_INSTR_JUMP_IF_NOT_ZERO) {
-            printf("\"kind\": \"JumpIfNotZero\", \"condition\": ");
-            if (ins->cond_val.kind == TACKY_VAL_CONSTANT) printf("{\"const\": %d}", ins->cond_val.constant);
-            else { printf("{\"var\": \""); json_escape(stdout, ins->cond_val.var_name); printf("\"}"); }
-            printf(", \"target\": \"");
-            json_escape(stdout, ins->jump_target);
-            printf("\"");
-        } else if (ins->kind == TACKY_INSTR_LABEL) {
-            printf("\"kind\": \"Label\", \"name\": \"");
-            json_escape(stdout, ins->label);
-            printf("\"");
-        } else if (ins->kind == TACKY_INSTR_RETURN) {
-            printf("\"kind\": \"Return\", \"value\": ");
-            if (ins->ret_val.kind == TACKY_VAL_CONSTANT) printf("{\"const\": %d}", ins->ret_val.constant);
-            else { printf("{\"var\": \""); json_escape(stdout, ins->ret_val.var_name); printf("\"}"); }
+        fprintf(out, "    {");
+        switch ((TackyInstrKind)ins->kind) {
+            case TACKY_INSTR_UNARY:
+                fprintf(out, "\"kind\": \"Unary\", \"op\": \"%s\", \"src\": ", unop_name((TackyUnaryOp)ins->op));
+                print_val_json(out, fn, ins->src1);
+                print_name_json(out, "dst", tacky_var_name(fn, ins->dst, buf));
+                break;
+            case TACKY_INSTR_BINARY:
+                fprintf(out, "\"kind\": \"Binary\", \"op\": \"%s\", \"src1\": ", binop_name((TackyBinaryOp)ins->op));
+                print_val_json(out, fn, ins->src1);
+                fprintf(out, ", \"src2\": ");
+                print_val_json(out, fn, ins->src2);
+                print_name_json(out, "dst", tacky_var_name(fn, ins->dst, buf));
+                break;
+            case TACKY_INSTR_COPY:
+                fprintf(out, "\"kind\": \"Copy\", \"src\": ");
+                print_val_json(out, fn, ins->src1);
+                print_name_json(out, "dst", tacky_var_name(fn, ins->dst, buf));
+                break;
+            case TACKY_INSTR_JUMP:
+                fprintf(out, "\"kind\": \"Jump\"");
+                print_name_json(out, "target", tacky_label_name(fn, ins->label, buf));
+                break;
+            case TACKY_INSTR_JUMP_IF_ZERO:
+            case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+                fprintf(out, "\"kind\": \"%s\", \"condition\": ",
+                        ins->kind == TACKY_INSTR_JUMP_IF_ZERO ? "JumpIfZero" : "JumpIfNotZero");
+                print_val_json(out, fn, ins->src1);
+                print_name_json(out, "target", tacky_label_name(fn, ins->label, buf));
+                break;
+            case TACKY_INSTR_LABEL:
+                fprintf(out, "\"kind\": \"Label\"");
+                print_name_json(out, "name", tacky_label_name(fn, ins->label, buf));
+                break;
+            case TACKY_INSTR_RETURN:
+                fprintf(out, "\"kind\": \"Return\", \"value\": ");
+                print_val_json(out, fn, ins->src1);
+                break;
+            case TACKY_INSTR_NOP:
+                break;
         }
-        printf("}");
+        fprintf(out, "}");
     }
-    printf("\n  ]\n}\n");
+    fprintf(out, "\n  ]\n}\n");
 }
 
 void tacky_free(TackyProgram *p) {
     if (!p) return;
     if (p->fn) {
-        TackyInstr *ins = p->fn->body;
-        while (ins) {
-            TackyInstr *n = ins->next;
-            switch (ins->kind) {
-                case TACKY_INSTR_UNARY:
-                    free_tacky_val(ins->un_src);
-                    free(ins->un_dst);
-                    break;
-                case TACKY_INSTR_BINARY:
-                    free_tacky_val(ins->bin_src1);
-                    free_tacky_val(ins->bin_src2);
-                    free(ins->bin_dst);
-                    break;
-                case TACKY_INSTR_COPY:
-                    free_tacky_val(ins->copy_src);
-                    free(ins->copy_dst);
-                    break;
-                case TACKY_INSTR_JUMP:
-                    free(ins->jump_target);
-                    break;
-                case TACKY_INSTR_JUMP_IF_ZERO:
-                case TACKY_INSTR_JUMP_IF_NOT_ZERO:
-                    if (ins->kind != TACKY_INSTR_JUMP) {
-                        free_tacky_val(ins->cond_val);
-                    }
-                    free(ins->jump_target);
-                    break;
-                case TACKY_INSTR_LABEL:
-                    free(ins->label);
-                    break;
-                case TACKY_INSTR_RETURN:
-                    free_tacky_val(ins->ret_val);
-                    break;
-            }
-            free(ins);
-            ins = n;
-        }
+        free(p->fn->body);
+        for (int i = 0; i < p->fn->var_count; i++) free(p->fn->var_names[i]);
+        free(p->fn->var_names);
+        free(p->fn->label_kinds);
         free(p->fn->name);
         free(p->fn);
     }
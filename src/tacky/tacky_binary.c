@@ -0,0 +1,300 @@
+#include "../../include/tacky/tacky_binary.h"
+#include "../../include/util/alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+static size_t pad4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+static void put_u32(unsigned char *at, uint32_t v) {
+    for (int i = 0; i < 4; i++) at[i] = (unsigned char)(v >> (8 * i));
+}
+
+// Strings go into the table in the order they are first written; the
+// function name is always at offset 0.
+typedef struct {
+    char *bytes;
+    size_t size;
+} StrTab;
+
+static uint32_t strtab_add(StrTab *st, const char *s) {
+    size_t n = strlen(s) + 1;
+    uint32_t at = (uint32_t)st->size;
+    st->bytes = (char *)xrealloc(st->bytes, st->size + n);
+    memcpy(st->bytes + st->size, s, n);
+    st->size += n;
+    return at;
+}
+
+bool tacky_write_binary(const TackyProgram *p, FILE *out) {
+    if (!p || !p->fn) return false;
+    const TackyFunction *fn = p->fn;
+    StrTab st = {0};
+    uint32_t name = strtab_add(&st, fn->name ? fn->name : "");
+
+    size_t instr_bytes = (size_t)fn->instr_count * sizeof(TackyBinInstr);
+    size_t var_bytes = (size_t)fn->var_count * 4;
+    size_t label_bytes = pad4((size_t)fn->label_count);
+    unsigned char *buf = (unsigned char *)xmalloc(instr_bytes + var_bytes + label_bytes);
+    memset(buf, 0, instr_bytes + var_bytes + label_bytes);
+
+    unsigned char *at = buf;
+    for (int i = 0; i < fn->instr_count; i++, at += sizeof(TackyBinInstr)) {
+        const TackyInstr *ins = &fn->body[i];
+        at[0] = ins->kind;
+        at[1] = ins->op;
+        at[2] = (unsigned char)ins->src1.kind;
+        at[3] = (unsigned char)ins->src2.kind;
+        put_u32(at + 4, (uint32_t)ins->dst);
+        put_u32(at + 8, (uint32_t)ins->src1.value);
+        put_u32(at + 12, (uint32_t)ins->src2.value);
+    }
+    for (int v = 0; v < fn->var_count; v++, at += 4) {
+        put_u32(at, fn->var_names[v] ? strtab_add(&st, fn->var_names[v]) : TACKY_BIN_NO_NAME);
+    }
+    if (fn->label_count) memcpy(at, fn->label_kinds, (size_t)fn->label_count);
+
+    unsigned char header[sizeof(TackyBinHeader)];
+    memcpy(header, TACKY_BIN_MAGIC, 8);
+    put_u32(header + 8, TACKY_BIN_VERSION);
+    put_u32(header + 12, (uint32_t)fn->instr_count);
+    put_u32(header + 16, (uint32_t)fn->var_count);
+    put_u32(header + 20, (uint32_t)fn->label_count);
+    put_u32(header + 24, (uint32_t)st.size);
+    put_u32(header + 28, name);
+
+    size_t body = instr_bytes + var_bytes + label_bytes;
+    bool ok = fwrite(header, 1, sizeof(header), out) == sizeof(header) &&
+              fwrite(buf, 1, body, out) == body &&
+              fwrite(st.bytes, 1, st.size, out) == st.size;
+    free(buf);
+    free(st.bytes);
+    return ok;
+}
+
+// The file's bytes: mapped read-only where mmap exists, read into memory
+// elsewhere.
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    bool mapped;
+} FileView;
+
+static bool view_open(FileView *view, const char *path) {
+    memset(view, 0, sizeof(*view));
+#ifdef _WIN32
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    struct stat sb;
+    if (fstat(_fileno(f), &sb) != 0) { fclose(f); return false; }
+    unsigned char *buf = (unsigned char *)xmalloc((size_t)sb.st_size);
+    view->size = fread(buf, 1, (size_t)sb.st_size, f);
+    fclose(f);
+    view->data = buf;
+    return true;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) { close(fd); return false; }
+    view->size = (size_t)sb.st_size;
+    if (view->size == 0) { close(fd); return true; }
+    void *p = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    view->data = (const unsigned char *)p;
+    view->mapped = true;
+    return true;
+#endif
+}
+
+static void view_close(FileView *view) {
+#ifndef _WIN32
+    if (view->mapped) {
+        munmap((void *)view->data, view->size);
+        return;
+    }
+#endif
+    free((void *)view->data);
+}
+
+static bool host_is_little_endian(void) {
+    const uint32_t one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+// The sections of a file whose header has been checked.
+typedef struct {
+    const TackyBinHeader *header;
+    const TackyBinInstr *instrs;
+    const uint32_t *vars;
+    const uint8_t *label_kinds;
+    const char *strtab;
+} Sections;
+
+static bool valid_name(const Sections *s, uint32_t at) {
+    return at < s->header->strtab_size;
+}
+
+static bool valid_val(const Sections *s, uint8_t kind, int32_t value) {
+    if (kind == TACKY_VAL_CONSTANT) return true;
+    return kind == TACKY_VAL_VAR && value >= 0 && (uint32_t)value < s->header->var_count;
+}
+
+static bool valid_label(const Sections *s, int32_t label) {
+    return label >= 0 && (uint32_t)label < s->header->label_count;
+}
+
+static bool valid_instr(const Sections *s, const TackyBinInstr *r) {
+    switch (r->kind) {
+        case TACKY_INSTR_RETURN:
+            return valid_val(s, r->src1_kind, r->src1);
+        case TACKY_INSTR_UNARY:
+            return r->op <= TACKY_UN_NOT && valid_val(s, r->src1_kind, r->src1) &&
+                   valid_val(s, TACKY_VAL_VAR, r->dst_or_label);
+        case TACKY_INSTR_BINARY:
+            return r->op <= TACKY_BIN_GREATER_EQUAL && valid_val(s, r->src1_kind, r->src1) &&
+                   valid_val(s, r->src2_kind, r->src2) && valid_val(s, TACKY_VAL_VAR, r->dst_or_label);
+        case TACKY_INSTR_COPY:
+            return valid_val(s, r->src1_kind, r->src1) && valid_val(s, TACKY_VAL_VAR, r->dst_or_label);
+        case TACKY_INSTR_JUMP:
+        case TACKY_INSTR_LABEL:
+            return valid_label(s, r->dst_or_label);
+        case TACKY_INSTR_JUMP_IF_ZERO:
+        case TACKY_INSTR_JUMP_IF_NOT_ZERO:
+            return valid_val(s, r->src1_kind, r->src1) && valid_label(s, r->dst_or_label);
+        case TACKY_INSTR_NOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns what is wrong with the file, or NULL if every section fits in
+// it, every index in them is in range and the function cannot run off
+// its end.
+static const char *check_file(const FileView *view, Sections *s) {
+    if (view->size < sizeof(TackyBinHeader) || memcmp(view->data, TACKY_BIN_MAGIC, 8) != 0) {
+        return "not a binary TACKY file";
+    }
+    if (!host_is_little_endian()) return "binary TACKY can only be read on little-endian hosts";
+    const TackyBinHeader *h = (const TackyBinHeader *)view->data;
+    if (h->version != TACKY_BIN_VERSION) return "unsupported binary TACKY version";
+
+    uint64_t size = sizeof(TackyBinHeader) + (uint64_t)h->instr_count * sizeof(TackyBinInstr) +
+                    (uint64_t)h->var_count * 4 + pad4(h->label_count) + h->strtab_size;
+    if (size != view->size) return "section sizes do not match the file size";
+    if (h->instr_count > INT32_MAX || h->var_count > INT32_MAX || h->label_count > INT32_MAX) {
+        return "counts out of range";
+    }
+
+    s->header = h;
+    s->instrs = (const TackyBinInstr *)(view->data + sizeof(TackyBinHeader));
+    s->vars = (const uint32_t *)(s->instrs + h->instr_count);
+    s->label_kinds = (const uint8_t *)(s->vars + h->var_count);
+    s->strtab = (const char *)(s->label_kinds + pad4(h->label_count));
+
+    if (h->strtab_size == 0 || s->strtab[h->strtab_size - 1] != '\0') return "string table is not terminated";
+    if (!valid_name(s, h->name)) return "function name out of range";
+    for (uint32_t v = 0; v < h->var_count; v++) {
+        if (s->vars[v] != TACKY_BIN_NO_NAME && !valid_name(s, s->vars[v])) return "variable name out of range";
+    }
+    for (uint32_t l = 0; l < h->label_count; l++) {
+        if (s->label_kinds[l] > TACKY_LABEL_PREHEADER) return "unknown label kind";
+    }
+
+    // Every label is placed exactly once and every jump has a target.
+    unsigned char *placed = (unsigned char *)xmalloc(h->label_count);
+    memset(placed, 0, h->label_count);
+    const char *error = NULL;
+    for (uint32_t i = 0; i < h->instr_count && !error; i++) {
+        const TackyBinInstr *r = &s->instrs[i];
+        if (!valid_instr(s, r)) error = "malformed instruction";
+        else if (r->kind == TACKY_INSTR_LABEL && placed[r->dst_or_label]++) error = "label placed twice";
+    }
+    for (uint32_t i = 0; i < h->instr_count && !error; i++) {
+        const TackyBinInstr *r = &s->instrs[i];
+        bool jumps = r->kind == TACKY_INSTR_JUMP || r->kind == TACKY_INSTR_JUMP_IF_ZERO ||
+                     r->kind == TACKY_INSTR_JUMP_IF_NOT_ZERO;
+        if (jumps && !placed[r->dst_or_label]) error = "jump to a label that is never placed";
+    }
+    free(placed);
+
+    // Lowering always ends in Return 0, and passes only delete it when it
+    // cannot be reached, after a Jump; the back ends rely on that.
+    uint32_t last = h->instr_count;
+    while (last > 0 && s->instrs[last - 1].kind == TACKY_INSTR_NOP) last--;
+    if (!error && (last == 0 || (s->instrs[last - 1].kind != TACKY_INSTR_RETURN &&
+                                 s->instrs[last - 1].kind != TACKY_INSTR_JUMP))) {
+        error = "function does not end in a return";
+    }
+    return error;
+}
+
+static char *copy_name(const char *s) {
+    size_t n = strlen(s) + 1;
+    char *p = (char *)xmalloc(n);
+    memcpy(p, s, n);
+    return p;
+}
+
+static TackyProgram *build_program(const Sections *s) {
+    const TackyBinHeader *h = s->header;
+    TackyFunction *fn = (TackyFunction *)xmalloc(sizeof(TackyFunction));
+    memset(fn, 0, sizeof(*fn));
+    fn->name = copy_name(s->strtab + h->name);
+
+    fn->instr_count = fn->instr_capacity = (int)h->instr_count;
+    fn->body = (TackyInstr *)xmalloc(sizeof(TackyInstr) * h->instr_count);
+    for (uint32_t i = 0; i < h->instr_count; i++) {
+        const TackyBinInstr *r = &s->instrs[i];
+        TackyInstr *ins = &fn->body[i];
+        memset(ins, 0, sizeof(*ins));
+        ins->kind = r->kind;
+        ins->op = r->op;
+        ins->dst = r->dst_or_label;
+        ins->src1.kind = (TackyValKind)r->src1_kind;
+        ins->src1.value = r->src1;
+        ins->src2.kind = (TackyValKind)r->src2_kind;
+        ins->src2.value = r->src2;
+    }
+
+    fn->var_count = fn->var_capacity = (int)h->var_count;
+    fn->var_names = (char **)xmalloc(sizeof(char *) * h->var_count);
+    for (uint32_t v = 0; v < h->var_count; v++) {
+        fn->var_names[v] = s->vars[v] == TACKY_BIN_NO_NAME ? NULL : copy_name(s->strtab + s->vars[v]);
+    }
+
+    fn->label_count = fn->label_capacity = (int)h->label_count;
+    fn->label_kinds = (unsigned char *)xmalloc(h->label_count);
+    if (h->label_count) memcpy(fn->label_kinds, s->label_kinds, h->label_count);
+
+    TackyProgram *p = (TackyProgram *)xmalloc(sizeof(TackyProgram));
+    p->fn = fn;
+    return p;
+}
+
+TackyProgram *tacky_load_binary(const char *path) {
+    FileView view;
+    if (!view_open(&view, path)) {
+        perror("Error: Could not read binary TACKY");
+        return NULL;
+    }
+    Sections s;
+    const char *error = check_file(&view, &s);
+    TackyProgram *p = NULL;
+    if (error) fprintf(stderr, "Error: %s: %s.\n", path, error);
+    else p = build_program(&s);
+    view_close(&view);
+    return p;
+}
@@ -0,0 +1,23 @@
+#include "../../include/util/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void *check(void *p) {
+    if (!p) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+void *xmalloc(size_t size) {
+    return check(malloc(size ? size : 1));
+}
+
+void *xcalloc(size_t count, size_t size) {
+    return check(calloc(count ? count : 1, size ? size : 1));
+}
+
+void *xrealloc(void *ptr, size_t size) {
+    return check(realloc(ptr, size ? size : 1));
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Runs each program in tests/copy_propagation with and without
+# --propagate-copies and checks both exit codes against expected.txt.
+# usage: tests/copy_propagation.sh [compiler]
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+COMPILER=${1:-$ROOT/bin/main.exe}
+DIR=$ROOT/tests/copy_propagation
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# A miscompiled loop may never end, so each run gets a time limit where
+# timeout(1) exists.
+LIMIT=
+command -v timeout >/dev/null 2>&1 && LIMIT="timeout 10"
+
+# --run builds <name>.out in the current directory and prints its exit code.
+exit_code() {
+    (cd "$WORK" && $LIMIT "$COMPILER" --quiet --run "$@" 2>>"$WORK/log") | sed -n 's/^Program exited with code //p'
+}
+
+failed=0
+while read -r program expected _; do
+    case $program in ''|'#'*) continue ;; esac
+    plain=$(exit_code "$DIR/$program")
+    propagated=$(exit_code --propagate-copies "$DIR/$program")
+    if [ "$plain" != "$expected" ] || [ "$propagated" != "$expected" ]; then
+        echo "FAIL $program: expected $expected, got ${plain:-no result} without and ${propagated:-no result} with --propagate-copies"
+        cat "$WORK/log"
+        failed=1
+    fi
+    : > "$WORK/log"
+done < "$DIR/expected.txt"
+
+[ $failed -eq 0 ] && echo "copy propagation: all tests passed"
+exit $failed
@@ -0,0 +1,16 @@
+int main(void) {
+    int a = 5;
+    int b = 40;
+    int total = 0;
+    for (int i = 0; i < 3; i = i + 1) {
+        int y;
+        if (i == 1) {
+            y = a;
+        } else {
+            y = b;
+            a = a + 1;
+        }
+        total = total + y;
+    }
+    return total - a - 33 + 40;
+}
@@ -0,0 +1,15 @@
+int main(void) {
+    int x = 0;
+    int y = 0;
+    int i = 0;
+    do {
+        i = i + 1;
+        y = x;
+        if (i % 2) {
+            x = x + i;
+            continue;
+        }
+        x = y + 1;
+    } while (y < 10);
+    return x + y + i;
+}
@@ -0,0 +1,11 @@
+int main(void) {
+    int x = 1;
+    int y = x;
+    int sum = 0;
+    for (int i = 0; i < 4; i = i + 1) {
+        sum = sum + y;
+        x = x + 2;
+        y = x;
+    }
+    return sum + y - x + 1 + 2;
+}
@@ -0,0 +1,13 @@
+int main(void) {
+    int a = 3;
+    int b = 8;
+    int t = 0;
+    int n = 0;
+    while (n < 5) {
+        t = a;
+        a = b;
+        b = t;
+        n = n + 1;
+    }
+    return a * 2 + b + t - 3;
+}
@@ -0,0 +1,173 @@
+// Check of division by a constant. For each divisor below it compiles C
+// programs that fold n / d and n % d over a run of int32 dividends n into
+// a hash, through the whole compiler at -O2, runs them with the JIT and
+// compares each hash with the same computation done in C. Divisors that
+// still go through idivl (0, 1, -1, INT_MIN) are left out; the point is
+// the multiply-high and shift sequences.
+//
+// Each divisor gets two programs: one divides every n, the other only the
+// n that pass `if (n >= 0)`, where range analysis proves the dividend not
+// negative, so the shift skips its bias and % by a power of two becomes an
+// andl. A last program divides by a variable known to be positive, which
+// takes divl.
+//
+// usage: div_by_constant [step]
+// With a step, only every step-th dividend is tried, for a quick run. An
+// even step is made odd: it would only reach even dividends, and range
+// analysis would see their low bits are zero and fold % by 2 away.
+
+#include "../include/assembly/assembly.h"
+#include "../include/jit/jit.h"
+#include "../include/optimize/pass_manager.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    SHAPE_SIGNED,       // n / d and n % d for every n
+    SHAPE_NONNEG,       // the same under if (n >= 0)
+    SHAPE_VARIABLE,     // n / e and n % e with e = n % 1000 + 1, under if (n >= 0)
+} Shape;
+
+static const char *const shape_names[] = { "signed", "non-negative", "variable" };
+
+// The loop walks n from INT_MIN by step while n + step does not overflow.
+static void write_program(char *buf, size_t size, Shape shape, int d, int step) {
+    static const char *const bodies[] = {
+        "    h = h * 31 + n / (%d);\n"
+        "    h = h * 31 + n %% (%d);\n",
+        "    if (n >= 0) {\n"
+        "      h = h * 31 + n / (%d);\n"
+        "      h = h * 31 + n %% (%d);\n"
+        "    }\n",
+        "    if (n >= 0) {\n"
+        "      int e = n %% 1000 + 1;\n"
+        "      h = h * 31 + n / e;\n"
+        "      h = h * 31 + n %% e;\n"
+        "    }\n",
+    };
+    char body[256];
+    snprintf(body, sizeof(body), bodies[shape], d, d);
+    snprintf(buf, size,
+             "int main(void) {\n"
+             "  int n = -2147483647 - 1;\n"
+             "  int h = 0;\n"
+             "  for (;;) {\n"
+             "%s"
+             "    if (n > %d) break;\n"
+             "    n = n + %d;\n"
+             "  }\n"
+             "  return h;\n"
+             "}\n",
+             body, INT_MAX - step, step);
+}
+
+// The hash the program computes, with C's / and %.
+static int reference(Shape shape, int d, int step) {
+    unsigned h = 0;
+    for (long long x = INT_MIN;; x += step) {
+        int n = (int)x;
+        if (shape == SHAPE_SIGNED || n >= 0) {
+            int e = shape == SHAPE_VARIABLE ? n % 1000 + 1 : d;
+            h = h * 31 + (unsigned)(n / e);
+            h = h * 31 + (unsigned)(n % e);
+        }
+        if (x > INT_MAX - step) break;
+    }
+    return (int)h;
+}
+
+static bool is_power_of_two(int d) {
+    unsigned m = d < 0 ? 0u - (unsigned)d : (unsigned)d;
+    return (m & (m - 1)) == 0;
+}
+
+// What the generated code must contain for the program to test what it is
+// meant to: no division instruction for a constant divisor, an andl for %
+// by a power of two on a non-negative dividend, divl for the variable one.
+static bool check_code(const AssemblyProgram *a, Shape shape, int d) {
+    bool idiv = false, divl = false, andl = false;
+    for (const AssemblyInstruction *i = a->function->instructions; i; i = i->next) {
+        if (i->type == ASM_IDIV_ECX) idiv = true;
+        if (i->type == ASM_DIV_ECX) divl = true;
+        if (i->type == ASM_AND) andl = true;
+    }
+    const char *problem = NULL;
+    if (shape == SHAPE_VARIABLE) {
+        if (idiv || !divl) problem = "does not divide with divl";
+    } else if (idiv || divl) {
+        problem = "still divides with idivl or divl";
+    } else if (shape == SHAPE_NONNEG && is_power_of_two(d) && !andl) {
+        problem = "computes % without andl";
+    }
+    if (problem) fprintf(stderr, "%s program for %d %s\n", shape_names[shape], d, problem);
+    return !problem;
+}
+
+// Compiles source the way the driver does at -O2, into jit.
+static bool compile(JitCode *jit, const char *source, Shape shape, int d) {
+    Lexer lexer;
+    lexer_init(&lexer, source);
+    Parser parser;
+    parser_init(&parser, &lexer);
+    ASTNode *ast = parse_program(&parser);
+    VarUsageTable usage = {0};
+    resolve_variables(ast, &usage);
+    TackyProgram *p = tacky_from_ast(ast, &usage);
+    var_usage_free(&usage);
+    free_ast(ast);
+
+    PassConfig passes;
+    pass_config_init(&passes, PASS_MAX_LEVEL);
+    pass_manager_run(p->fn, &passes, NULL);
+    AssemblyProgram *a = generate_assembly(p, passes.enabled[PASS_FOLD_RANGES]);
+    bool ok = check_code(a, shape, d) && jit_compile(jit, a);
+    free_assembly(a);
+    tacky_free(p);
+    return ok;
+}
+
+// Runs one program and compares its hash; false if it does not agree.
+static bool check(Shape shape, int d, int step) {
+    char source[1024];
+    write_program(source, sizeof(source), shape, d, step);
+    JitCode jit;
+    if (!compile(&jit, source, shape, d)) return false;
+    int got;
+    int signal = jit_call(&jit, &got);
+    jit_free(&jit);
+    int want = reference(shape, d, step);
+    if (signal || got != want) {
+        if (shape == SHAPE_VARIABLE) printf("FAIL %s divisor: ", shape_names[shape]);
+        else printf("FAIL divisor %d, %s dividends: ", d, shape_names[shape]);
+        if (signal) printf("signal %d\n", signal);
+        else printf("hash %d, want %d\n", got, want);
+        return false;
+    }
+    return true;
+}
+
+// Powers of two (shift and bias), then reciprocals with and without the
+// add or subtract of n, and the extremes of the int range.
+static const int divisors[] = {
+    2, 8, 1024, 1 << 30, -2, -16, -(1 << 30),
+    3, 5, 7, 10, 641, 65537, 715827883, INT_MAX,
+    -3, -7, -641, -INT_MAX,
+};
+
+int main(int argc, char **argv) {
+    long long step = argc > 1 ? atoll(argv[1]) : 1;
+    if (step < 1) step = 1;
+    if (step > INT_MAX) step = INT_MAX;
+    step |= 1;
+    int count = (int)(sizeof(divisors) / sizeof(divisors[0]));
+    bool ok = true;
+    for (int c = 0; c < count; c++) {
+        if (!check(SHAPE_SIGNED, divisors[c], (int)step)) ok = false;
+        if (!check(SHAPE_NONNEG, divisors[c], (int)step)) ok = false;
+    }
+    if (!check(SHAPE_VARIABLE, 0, (int)step)) ok = false;
+    if (ok) printf("division by constants: %d divisors agree with / and %%\n", count);
+    return ok ? 0 : 1;
+}
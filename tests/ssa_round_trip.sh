@@ -0,0 +1,36 @@
+#!/bin/sh
+# Compiles and runs every program under examples/ with and without --ssa
+# and fails if any of them behaves differently after the round trip
+# through SSA form. Programs the compiler rejects must be rejected both
+# ways.
+# usage: tests/ssa_round_trip.sh [compiler]
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+COMPILER=${1:-$ROOT/bin/main.exe}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+LIMIT=
+command -v timeout >/dev/null 2>&1 && LIMIT="timeout 10"
+
+# The compiler's own status and the program's exit code, if it ran.
+outcome() {
+    code=$(cd "$WORK" && $LIMIT "$COMPILER" --quiet --run "$@" 2>/dev/null)
+    status=$?
+    echo "$status $(echo "$code" | sed -n 's/^Program exited with code //p')"
+}
+
+failed=0
+count=0
+for program in "$ROOT"/examples/*/*.c; do
+    plain=$(outcome "$program")
+    ssa=$(outcome --ssa "$program")
+    count=$((count + 1))
+    if [ "$plain" != "$ssa" ]; then
+        echo "FAIL ${program#$ROOT/}: '$plain' without --ssa, '$ssa' with it"
+        failed=1
+    fi
+done
+
+[ $failed -eq 0 ] && echo "ssa round trip: $count examples unchanged"
+exit $failed